@@ -0,0 +1,416 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Lox/Lox.hpp>
+
+#ifndef LOX_BENCHMARKS_DIR
+    #define LOX_BENCHMARKS_DIR "LoxBenchmark/benchmarks"
+#endif
+
+#ifndef LOX_BUILD_TYPE
+    #define LOX_BUILD_TYPE "unknown"
+#endif
+
+struct BenchmarkResult
+{
+    std::string name;
+    
+    bool ok = false;
+    std::string error;
+    
+    std::vector<double> runSeconds;
+    double compileSeconds = 0;
+    
+    std::uint64_t instructions = 0;
+    std::size_t minorCollections = 0;
+    std::size_t majorCollections = 0;
+    std::size_t peakHeapBytes = 0;
+    double longestPauseSeconds = 0;
+};
+
+struct BenchmarkOptions
+{
+    std::vector<std::filesystem::path> files;
+    std::size_t iterations = 3;
+    std::string jsonPath;
+    std::size_t incrementalGCBudget = 0;
+    std::size_t markingThreads = 1;
+    bool backgroundSweeping = false;
+};
+
+void PrintUsage();
+
+bool ParseArguments(int argc, const char* argv[], BenchmarkOptions& options);
+
+std::vector<std::filesystem::path> FindBenchmarks(const std::filesystem::path& dir);
+
+BenchmarkResult RunBenchmark(const std::filesystem::path& path, const BenchmarkOptions& options);
+
+bool RunOnce(const std::string& path, const std::string& source, const BenchmarkOptions& options,
+             BenchmarkResult& result);
+
+void PrintTable(std::ostream& out, const std::vector<BenchmarkResult>& results);
+
+void PrintJson(std::ostream& out, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options);
+
+std::string EscapeJson(std::string_view str);
+
+double GetBest(const BenchmarkResult& result);
+
+double GetMean(const BenchmarkResult& result);
+
+// Runs every benchmark through the same pipeline as `LoxInterpreter`:
+// `Compile`, then `ChunkOptimizer` and `ChunkFuser`, then `VirtualMachine::RunScript`.
+int main(int argc, const char* argv[])
+{
+    BenchmarkOptions options;
+    
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+    
+    if (options.files.empty())
+    {
+        options.files = FindBenchmarks(LOX_BENCHMARKS_DIR);
+    }
+    
+    if (options.files.empty())
+    {
+        std::cerr << "Error: no benchmarks found." << std::endl;
+        return 1;
+    }
+    
+    std::vector<BenchmarkResult> results;
+    
+    for (const auto& path: options.files)
+    {
+        std::cerr << "Running " << path.stem().string() << "..." << std::endl;
+        results.push_back(RunBenchmark(path, options));
+    }
+    
+    PrintTable(std::cerr, results);
+    
+    if (options.jsonPath.empty() || options.jsonPath == "-")
+    {
+        PrintJson(std::cout, results, options);
+    }
+    else
+    {
+        std::ofstream file(options.jsonPath);
+        if (!file)
+        {
+            std::cerr << "Error: could not write to file '" << options.jsonPath << "'" << std::endl;
+            return 1;
+        }
+        
+        PrintJson(file, results, options);
+    }
+    
+    bool allOk = std::all_of(results.begin(), results.end(), [](const BenchmarkResult& result)
+    {
+        return result.ok;
+    });
+    
+    return allOk ? 0 : 1;
+}
+
+void PrintUsage()
+{
+    std::cerr << "Usage: LoxBenchmark [--iterations N] [--json path] [--incremental-gc N] [--gc-threads N] [--background-sweep]"
+              << " [file.lox...]" << std::endl;
+    std::cerr << "Where:" << std::endl;
+    std::cerr << "  --iterations N - run every benchmark N times (default: 3)" << std::endl;
+    std::cerr << "  --incremental-gc N - incremental major collections with N objects per step" << std::endl;
+    std::cerr << "  --gc-threads N - mark the heap of the major collections with N threads (default: 1)" << std::endl;
+    std::cerr << "  --background-sweep - sweep the old generation on a thread" << std::endl;
+    std::cerr << "  --json path - write the JSON report to the file (default: stdout)" << std::endl;
+    std::cerr << "  file.lox - benchmarks to run (default: all in " << LOX_BENCHMARKS_DIR << ")" << std::endl;
+}
+
+bool ParseArguments(int argc, const char* argv[], BenchmarkOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            options.iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            options.jsonPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--incremental-gc") == 0 && i + 1 < argc)
+        {
+            options.incrementalGCBudget = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--gc-threads") == 0 && i + 1 < argc)
+        {
+            options.markingThreads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--background-sweep") == 0)
+        {
+            options.backgroundSweeping = true;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            return false;
+        }
+        else
+        {
+            options.files.emplace_back(argv[i]);
+        }
+    }
+    
+    return true;
+}
+
+std::vector<std::filesystem::path> FindBenchmarks(const std::filesystem::path& dir)
+{
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    
+    for (const auto& entry: std::filesystem::directory_iterator(dir, error))
+    {
+        if (entry.path().extension() == ".lox")
+        {
+            files.push_back(entry.path());
+        }
+    }
+    
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+BenchmarkResult RunBenchmark(const std::filesystem::path& path, const BenchmarkOptions& options)
+{
+    BenchmarkResult result;
+    result.name = path.stem().string();
+    
+    std::ifstream file(path);
+    if (!file)
+    {
+        result.error = "could not read file";
+        return result;
+    }
+    
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string source = ss.str();
+    
+    for (std::size_t i = 0; i < options.iterations; ++i)
+    {
+        if (!RunOnce(path.string(), source, options, result))
+        {
+            return result;
+        }
+    }
+    
+    result.ok = true;
+    return result;
+}
+
+bool RunOnce(const std::string& path, const std::string& source, const BenchmarkOptions& options,
+             BenchmarkResult& result)
+{
+    class BenchmarkErrorReporter final : public Lox::CompilerErrorReporter
+    {
+    public:
+        void Error(Lox::SourcePosition pos, std::string_view msg) override
+        {
+            std::cerr << "Error [" << pos << "]: " << msg << std::endl;
+        }
+    }; // class BenchmarkErrorReporter
+    
+    // Every run has a fresh VM, so the GC statistics are of this run only.
+    // The output of the benchmark is not interesting.
+    std::ostringstream userOutput;
+    Lox::VirtualMachineConfiguration conf(userOutput, std::cin, std::cerr);
+    conf.SetIncrementalGCBudget(options.incrementalGCBudget);
+    conf.SetMarkingThreads(options.markingThreads);
+    conf.SetBackgroundSweeping(options.backgroundSweeping);
+    Lox::VirtualMachine vm(conf);
+    
+    try
+    {
+        auto compileStart = std::chrono::steady_clock::now();
+        
+        BenchmarkErrorReporter errorReporter;
+        Lox::GcPtr<Lox::Closure> func = Lox::Compile(vm, errorReporter, path, source);
+        
+        if (func.IsNullptr())
+        {
+            result.error = "compile error";
+            return false;
+        }
+        
+        Lox::ChunkOptimizer optimizer(vm, func->GetChunk());
+        optimizer.Optimize();
+        
+        Lox::ChunkFuser fuser(func->GetChunk());
+        fuser.Fuse();
+        
+        auto runStart = std::chrono::steady_clock::now();
+        vm.RunScript(func);
+        auto runEnd = std::chrono::steady_clock::now();
+        
+        result.compileSeconds = std::chrono::duration<double>(runStart - compileStart).count();
+        result.runSeconds.push_back(std::chrono::duration<double>(runEnd - runStart).count());
+    }
+    catch (const Lox::Exceptions::RuntimeException& e)
+    {
+        std::cerr << e << std::endl;
+        result.error = e.what();
+        return false;
+    }
+    catch (const Lox::Exceptions::OptimizerFailure& e)
+    {
+        std::cerr << e << std::endl;
+        result.error = e.what();
+        return false;
+    }
+    
+    const Lox::MemoryManager& memory = vm.GetMemoryManager();
+    
+    result.instructions = vm.GetExecutedInstructionsCount();
+    result.minorCollections = memory.GetMinorCollectionsCount();
+    result.majorCollections = memory.GetMajorCollectionsCount();
+    result.peakHeapBytes = memory.GetPeakBytesAllocated();
+    
+    double longestPause = std::chrono::duration<double>(memory.GetLongestPause()).count();
+    result.longestPauseSeconds = std::max(result.longestPauseSeconds, longestPause);
+    
+    return true;
+}
+
+void PrintTable(std::ostream& out, const std::vector<BenchmarkResult>& results)
+{
+    out << std::endl;
+    
+    for (const auto& result: results)
+    {
+        out << std::left << std::setw(18) << result.name << std::right;
+        
+        if (!result.ok)
+        {
+            out << "FAILED: " << result.error << std::endl;
+            continue;
+        }
+        
+        double best = GetBest(result);
+        
+        out << std::fixed << std::setprecision(3)
+            << std::setw(9) << best << " s"
+            << std::setw(10) << std::setprecision(1) << result.instructions / best / 1e6 << " M instr/s"
+            << std::setw(6) << result.minorCollections + result.majorCollections << " GCs"
+            << std::setw(10) << result.peakHeapBytes / 1024 << " KiB peak"
+            << std::setw(9) << std::setprecision(2) << result.longestPauseSeconds * 1e3 << " ms pause" << std::endl;
+    }
+    
+    out << std::endl;
+}
+
+void PrintJson(std::ostream& out, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options)
+{
+    out << std::setprecision(9);
+    
+    out << "{\n";
+    out << "  \"build_type\": \"" << EscapeJson(LOX_BUILD_TYPE) << "\",\n";
+    out << "  \"debug_mode\": " << (Lox::Configuration::DebugMode ? "true" : "false") << ",\n";
+    out << "  \"iterations\": " << options.iterations << ",\n";
+    out << "  \"incremental_gc_budget\": " << options.incrementalGCBudget << ",\n";
+    out << "  \"gc_marking_threads\": " << options.markingThreads << ",\n";
+    out << "  \"gc_background_sweeping\": " << (options.backgroundSweeping ? "true" : "false") << ",\n";
+    out << "  \"benchmarks\": [\n";
+    
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& result = results[i];
+        
+        out << "    {\n";
+        out << "      \"name\": \"" << EscapeJson(result.name) << "\",\n";
+        out << "      \"ok\": " << (result.ok ? "true" : "false");
+        
+        if (!result.ok)
+        {
+            out << ",\n      \"error\": \"" << EscapeJson(result.error) << "\"\n";
+        }
+        else
+        {
+            double best = GetBest(result);
+            
+            out << ",\n";
+            out << "      \"wall_time_s\": " << best << ",\n";
+            out << "      \"mean_wall_time_s\": " << GetMean(result) << ",\n";
+            out << "      \"compile_time_s\": " << result.compileSeconds << ",\n";
+            out << "      \"instructions\": " << result.instructions << ",\n";
+            out << "      \"instructions_per_second\": " << result.instructions / best << ",\n";
+            out << "      \"minor_gc_count\": " << result.minorCollections << ",\n";
+            out << "      \"major_gc_count\": " << result.majorCollections << ",\n";
+            out << "      \"gc_count\": " << result.minorCollections + result.majorCollections << ",\n";
+            out << "      \"peak_heap_bytes\": " << result.peakHeapBytes << ",\n";
+            out << "      \"max_gc_pause_s\": " << result.longestPauseSeconds << "\n";
+        }
+        
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    
+    out << "  ]\n";
+    out << "}" << std::endl;
+}
+
+std::string EscapeJson(std::string_view str)
+{
+    std::string result;
+    
+    for (char ch: str)
+    {
+        switch (ch)
+        {
+        case '"':
+            result += "\\\"";
+            break;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(ch) >= 0x20)
+            {
+                result += ch;
+            }
+            break;
+        }
+    }
+    
+    return result;
+}
+
+double GetBest(const BenchmarkResult& result)
+{
+    return *std::min_element(result.runSeconds.begin(), result.runSeconds.end());
+}
+
+double GetMean(const BenchmarkResult& result)
+{
+    double sum = 0;
+    
+    for (double seconds: result.runSeconds)
+    {
+        sum += seconds;
+    }
+    
+    return sum / result.runSeconds.size();
+}
@@ -7,13 +7,23 @@ using namespace Lox;
 static VirtualMachineConfiguration conf(std::cout, std::cin, std::cout);
 static VirtualMachine vm(conf);
 
+class CheckerErrorReporter final : public CompilerErrorReporter
+{
+public:
+    void Error(SourcePosition pos, std::string_view msg) override
+    {
+        ADD_FAILURE() << "Error [" << pos << "]: " << msg << ".";
+    }
+};
+
 void GenericCheck(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants, bool result);
 
 void GenericCheckFail(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants);
 
 void GenericCheckPass(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants);
 
-/*
+void GenericMaxStackSize(std::initializer_list<uint8_t> code, std::optional<std::size_t> result);
+
 TEST(CheckerTest, EmptyFail)
 {
     GenericCheckFail({}, {});
@@ -21,7 +31,7 @@ TEST(CheckerTest, EmptyFail)
 
 TEST(CheckerTest, OnlyReturnPass)
 {
-    GenericCheckPass({ OpcodeReturn }, {});
+    GenericCheckPass({ OpcodeNil, OpcodeReturn }, {});
 }
 
 TEST(CheckerTest, NoSuchOpcodeFail)
@@ -45,7 +55,189 @@ TEST(CheckerTest, InvalidGetLocal)
                      },
                      {});
 }
- */
+
+TEST(CheckerTest, NoReturnFail)
+{
+    GenericCheckFail({ OpcodeNil, OpcodePrint }, {});
+}
+
+TEST(CheckerTest, StackUnderflowFail)
+{
+    GenericCheckFail({ OpcodeNil, OpcodeAdd, OpcodeReturn }, {});
+}
+
+TEST(CheckerTest, NameNotStringFail)
+{
+    GenericCheckFail({ OpcodeGetGlobal, 0, OpcodeReturn }, { Value(1.0) });
+}
+
+TEST(CheckerTest, JumpIntoOperandFail)
+{
+    GenericCheckFail({
+                             OpcodeTrue,
+                             OpcodeJumpIfFalse,
+                             0,
+                             1,
+                             OpcodePushConstant,
+                             OpcodeReturn,
+                             OpcodeReturn
+                     },
+                     { Value(1.0) });
+}
+
+TEST(CheckerTest, MergeHeightsFail)
+{
+    GenericCheckFail({
+                             OpcodeFalse,
+                             OpcodeJumpIfFalse,
+                             0,
+                             1,
+                             OpcodeTrue,
+                             OpcodePrint,
+                             OpcodeNil,
+                             OpcodeReturn
+                     },
+                     {});
+}
+
+TEST(CheckerTest, LoopPass)
+{
+    GenericCheckPass({
+                             OpcodeTrue,
+                             OpcodeJumpIfFalse,
+                             0,
+                             6,
+                             OpcodePop,
+                             OpcodeNil,
+                             OpcodePop,
+                             OpcodeLoop,
+                             0,
+                             10,
+                             OpcodePop,
+                             OpcodeNil,
+                             OpcodeReturn
+                     },
+                     {});
+}
+
+TEST(CheckerTest, Locals)
+{
+    GenericCheckPass({ OpcodeNil, OpcodeGetLocal, 1, OpcodeSetLocal, 0, OpcodeReturn }, {});
+    GenericCheckFail({ OpcodeNil, OpcodeGetLocal, 2, OpcodeReturn }, {});
+}
+
+TEST(CheckerTest, Upvalues)
+{
+    GenericCheckFail({ OpcodeGetUpvalue, 0, OpcodeReturn }, {});
+    
+    Chunk chunk;
+    chunk.PushCode(OpcodeGetUpvalue, 1);
+    chunk.PushCode(0, 1);
+    chunk.PushCode(OpcodeReturn, 1);
+    
+    EXPECT_EQ(ChunkChecker(chunk, 0, 1).Check(), true);
+    EXPECT_EQ(ChunkChecker(chunk, 0, 0).Check(), false);
+}
+
+TEST(CheckerTest, CompiledCodePass)
+{
+    std::string_view source = R"(
+        class A
+        {
+            init(x) { this.x = x; }
+            get() { return this.x; }
+        }
+        
+        class B < A
+        {
+            get() { return super.get() + 1; }
+        }
+        
+        fun counter()
+        {
+            var i = 0;
+            fun next() { i = i + 1; return i; }
+            return next;
+        }
+        
+        var c = counter();
+        var i = 0;
+        while (i < 3) { if (c() > 1) print B(i).get(); else print "no"; i = i + 1; }
+    )";
+    
+    CheckerErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(vm, errorReporter, "<test>", source);
+    
+    ASSERT_FALSE(func.IsNullptr());
+    EXPECT_EQ(ChunkChecker(func->GetChunk()).Check(), true);
+}
+
+TEST(CheckerTest, MaxStackSizeStraight)
+{
+    GenericMaxStackSize({
+                                OpcodeTrue,
+                                OpcodeFalse,
+                                OpcodeEqual,
+                                OpcodePrint,
+                                OpcodeNil,
+                                OpcodeReturn
+                        },
+                        2);
+}
+
+TEST(CheckerTest, MaxStackSizeCall)
+{
+    GenericMaxStackSize({
+                                OpcodeNil,
+                                OpcodeTrue,
+                                OpcodeFalse,
+                                OpcodeCall,
+                                2,
+                                OpcodeNil,
+                                OpcodeNil,
+                                OpcodeReturn
+                        },
+                        3);
+}
+
+TEST(CheckerTest, MaxStackSizeLoop)
+{
+    GenericMaxStackSize({
+                                OpcodeTrue,
+                                OpcodeJumpIfFalse,
+                                0,
+                                6,
+                                OpcodePop,
+                                OpcodeNil,
+                                OpcodePop,
+                                OpcodeLoop,
+                                0,
+                                10,
+                                OpcodePop,
+                                OpcodeNil,
+                                OpcodeReturn
+                        },
+                        1);
+}
+
+TEST(CheckerTest, MaxStackSizeGrowingLoop)
+{
+    GenericMaxStackSize({
+                                OpcodeNil,
+                                OpcodeLoop,
+                                0,
+                                4
+                        },
+                        std::nullopt);
+}
+
+TEST(CheckerTest, MaxStackSizeMalformed)
+{
+    GenericMaxStackSize({ OpcodeJump, 0, 10, OpcodeNil, OpcodeReturn }, std::nullopt);
+    GenericMaxStackSize({ OpcodeNil, OpcodeCall }, std::nullopt);
+    GenericMaxStackSize({ OpcodeNil }, std::nullopt);
+    GenericMaxStackSize({ 255 }, std::nullopt);
+}
 
 void GenericCheck(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants, bool result)
 {
@@ -74,3 +266,16 @@ void GenericCheckPass(std::initializer_list<uint8_t> code, std::initializer_list
 {
     GenericCheck(code, constants, true);
 }
+
+void GenericMaxStackSize(std::initializer_list<uint8_t> code, std::optional<std::size_t> result)
+{
+    Chunk chunk;
+    
+    for (uint8_t byte: code)
+    {
+        chunk.PushCode(byte, 1);
+    }
+    
+    ChunkChecker checker(chunk);
+    EXPECT_EQ(checker.ComputeMaxStackSize(), result);
+}
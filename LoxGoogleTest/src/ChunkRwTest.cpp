@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <cmath>
+#include <cstring>
 #include <random>
 
 #include <Lox/Lox.hpp>
@@ -23,6 +25,69 @@ TEST(ChunkRwTest, Strings)
                      { Value(vm.InternString("abc")) });
 }
 
+TEST(ChunkRwTest, Lines)
+{
+    Chunk chunk;
+    
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        chunk.PushCode(OpcodeNil, 1 + i / 10);
+    }
+    
+    chunk.PushConstant(Value(1.0), 3);
+    chunk.PushConstant(Value(2.0), 3);
+    
+    std::stringstream ss;
+    
+    ChunkWriter writer(chunk, ss);
+    writer.Write();
+    
+    std::unique_ptr<Chunk> readChunk = ReadChunk(vm, ss);
+    ASSERT_TRUE(readChunk != nullptr);
+    
+    EXPECT_EQ(readChunk->GetCodeLines().GetRuns().size(), 10);
+    
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(readChunk->GetCodeLine(i), 1 + i / 10);
+    }
+    
+    EXPECT_EQ(readChunk->GetConstantLine(1), 3);
+}
+
+TEST(ChunkRwTest, NanConstantsCanNotForgeValues)
+{
+    // Quiet NaNs with the payloads of true and of an object pointer.
+    for (uint64_t forged : { uint64_t(0x7ffc000000000003), uint64_t(0xfffc000012345678) })
+    {
+        Chunk chunk;
+        chunk.PushCode(OpcodePushConstant, 1);
+        chunk.PushCode(0, 1);
+        chunk.PushCode(OpcodeReturn, 1);
+        chunk.PushConstant(Value(1.5), 1);
+        
+        std::stringstream ss;
+        
+        ChunkWriter writer(chunk, ss);
+        writer.Write();
+        
+        // Replace the bits of 1.5 in the file.
+        std::string bytes = ss.str();
+        double marker = 1.5;
+        std::size_t offset = bytes.find(std::string(reinterpret_cast<const char*>(&marker), sizeof(marker)));
+        ASSERT_NE(offset, std::string::npos);
+        std::memcpy(bytes.data() + offset, &forged, sizeof(forged));
+        
+        std::stringstream forgedStream(bytes);
+        std::unique_ptr<Chunk> readChunk = ReadChunk(vm, forgedStream);
+        ASSERT_TRUE(readChunk != nullptr);
+        
+        Value constant = readChunk->GetConstant(0);
+        EXPECT_TRUE(constant.IsDouble());
+        EXPECT_TRUE(std::isnan(constant.AsDouble()));
+    }
+}
+
 void GenericWriteRead(const std::vector<uint8_t>& bytes, const std::vector<Value>& constants)
 {
     Chunk chunk;
@@ -297,29 +297,32 @@ TEST(CompilerTest, Block)
 static VirtualMachineConfiguration conf(std::cout, std::cin, std::cout);
 static VirtualMachine vm(conf);
 
+// Globals are compiled to slots of the VM, so the operand depends on the previous tests.
+#define GLOBAL_SLOT(name)                                                       \
+    static_cast<uint8_t>(vm.GetGlobalSlot(vm.InternString(name)) >> 8),         \
+    static_cast<uint8_t>(vm.GetGlobalSlot(vm.InternString(name)) & 0xff)
+
 TEST(CompilerTest, CallZero)
 {
     GenericTestChunkPass("func();",
                          {
-                                 OpcodeGetGlobal,
-                                 0,
+                                 OpcodeGetGlobalSlot,
+                                 GLOBAL_SLOT("func"),
                                  OpcodeCall,
                                  0,
                                  OpcodePop,
                                  OpcodeNil,
                                  OpcodeReturn
                          },
-                         {
-                                 Value(vm.InternString("func"))
-                         });
+                         {});
 }
 
 TEST(CompilerTest, CallOne)
 {
     GenericTestChunkPass("func(true);",
                          {
-                                 OpcodeGetGlobal,
-                                 0,
+                                 OpcodeGetGlobalSlot,
+                                 GLOBAL_SLOT("func"),
                                  OpcodeTrue,
                                  OpcodeCall,
                                  1,
@@ -327,17 +330,15 @@ TEST(CompilerTest, CallOne)
                                  OpcodeNil,
                                  OpcodeReturn
                          },
-                         {
-                                 Value(vm.InternString("func"))
-                         });
+                         {});
 }
 
 TEST(CompilerTest, CallTwo)
 {
     GenericTestChunkPass("func(true, false);",
                          {
-                                 OpcodeGetGlobal,
-                                 0,
+                                 OpcodeGetGlobalSlot,
+                                 GLOBAL_SLOT("func"),
                                  OpcodeTrue,
                                  OpcodeFalse,
                                  OpcodeCall,
@@ -346,9 +347,7 @@ TEST(CompilerTest, CallTwo)
                                  OpcodeNil,
                                  OpcodeReturn
                          },
-                         {
-                                 Value(vm.InternString("func"))
-                         });
+                         {});
 }
 
 TEST(CompilerTest, CallNoRightParen)
@@ -434,13 +433,11 @@ TEST(CompilerTest, VarDecl)
     GenericTestChunkPass("var a = true;",
                          {
                                  OpcodeTrue,
-                                 OpcodeDefineGlobal,
-                                 0,
+                                 OpcodeDefineGlobalSlot,
+                                 GLOBAL_SLOT("a"),
                                  OpcodeNil, OpcodeReturn
                          },
-                         {
-                                 Value(vm.InternString("a"))
-                         });
+                         {});
 }
 
 TEST(CompilerTest, VarDeclNil)
@@ -448,25 +445,23 @@ TEST(CompilerTest, VarDeclNil)
     GenericTestChunkPass("var b;",
                          {
                                  OpcodeNil,
-                                 OpcodeDefineGlobal,
-                                 0,
+                                 OpcodeDefineGlobalSlot,
+                                 GLOBAL_SLOT("b"),
                                  OpcodeNil, OpcodeReturn
                          },
-                         {
-                                 Value(vm.InternString("b"))
-                         });
+                         {});
 }
 
 TEST(CompilerTest, GlobalVarGet)
 {
     GenericTestChunkPass("abc;",
                          {
-                                 OpcodeGetGlobal,
-                                 0,
+                                 OpcodeGetGlobalSlot,
+                                 GLOBAL_SLOT("abc"),
                                  OpcodePop,
                                  OpcodeNil, OpcodeReturn
                          },
-                         { Value(vm.InternString("abc")) });
+                         {});
 }
 
 TEST(CompilerTest, GlobalVarSet)
@@ -474,14 +469,13 @@ TEST(CompilerTest, GlobalVarSet)
     GenericTestChunkPass("abc = 123;",
                          {
                                  OpcodePushConstant,
-                                 1,
-                                 OpcodeSetGlobal,
                                  0,
+                                 OpcodeSetGlobalSlot,
+                                 GLOBAL_SLOT("abc"),
                                  OpcodePop,
                                  OpcodeNil, OpcodeReturn
                          },
                          {
-                                 Value(vm.InternString("abc")),
                                  Value(123.0)
                          });
 }
@@ -859,8 +853,8 @@ TEST(CompilerTest, EmptyFunction)
                                                             {
                                                                      OpcodePushConstant,
                                                                      0,
-                                                                     OpcodeDefineGlobal,
-                                                                     1,
+                                                                     OpcodeDefineGlobalSlot,
+                                                                     GLOBAL_SLOT("abc"),
                                                                      
                                                                      OpcodeNil,
                                                                      OpcodeReturn
@@ -874,14 +868,13 @@ TEST(CompilerTest, EmptyFunction)
     
     const Chunk& chunk = script->GetChunk();
     
-    EXPECT_EQ(chunk.GetConstantsCount(), 2);
-    if (chunk.GetConstantsCount() != 2)
+    EXPECT_EQ(chunk.GetConstantsCount(), 1);
+    if (chunk.GetConstantsCount() != 1)
     {
         return;
     }
     
     Value first = chunk.GetConstant(0);
-    Value second = chunk.GetConstant(1);
     
     EXPECT_TRUE(first.IsObject<Closure>());
     if (first.IsObject<Closure>())
@@ -896,12 +889,6 @@ TEST(CompilerTest, EmptyFunction)
                           OpcodeReturn
                   }));
     }
-    
-    EXPECT_TRUE(second.IsObject<String>());
-    if (second.IsObject<String>())
-    {
-        EXPECT_EQ(second.AsObject<String>(), vm.InternString("abc"));
-    }
 }
 
 // TODO: FUNCTIONS TESTS.
@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+
+#include <Lox/Lox.hpp>
+
+using namespace Lox;
+
+static VirtualMachineConfiguration conf(std::cout, std::cin, std::cout);
+static VirtualMachine vm(conf);
+
+void GenericFuseTest(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants,
+                     std::initializer_list<uint8_t> newCode, std::size_t fusedCount);
+
+std::string RunSource(std::string_view source, bool fuse);
+
+void PushAddConstantWithoutAdd(Chunk& chunk);
+
+TEST(FuserTest, Pairs)
+{
+    GenericFuseTest(
+            {
+                    OpcodeGetLocal,
+                    0,
+                    OpcodeGetProperty,
+                    0,
+                    OpcodeGetLocal,
+                    0,
+                    OpcodeGetLocal,
+                    0,
+                    OpcodePop,
+                    OpcodePushConstant,
+                    1,
+                    OpcodeAdd,
+                    OpcodeSetLocal,
+                    0,
+                    OpcodePop,
+                    OpcodeReturn
+            },
+            {
+                    Value(vm.InternString("field")),
+                    Value(1.0)
+            },
+            {
+                    OpcodeGetLocalProperty,
+                    0,
+                    OpcodeGetProperty,
+                    0,
+                    OpcodeGetLocalLocal,
+                    0,
+                    OpcodeGetLocal,
+                    0,
+                    OpcodePop,
+                    OpcodeAddConstant,
+                    1,
+                    OpcodeAdd,
+                    OpcodeSetLocalPop,
+                    0,
+                    OpcodePop,
+                    OpcodeReturn
+            },
+            4);
+}
+
+TEST(FuserTest, TriplesFirst)
+{
+    GenericFuseTest(
+            {
+                    OpcodeTrue,
+                    OpcodeFalse,
+                    OpcodeEqual,
+                    OpcodeJumpIfFalse,
+                    0,
+                    2,
+                    OpcodePop,
+                    OpcodeNil,
+                    OpcodePop,
+                    OpcodeNil,
+                    OpcodeReturn
+            },
+            {},
+            {
+                    OpcodeTrue,
+                    OpcodeFalse,
+                    OpcodeEqualJumpIfFalse,
+                    OpcodeJumpIfFalse,
+                    0,
+                    2,
+                    OpcodePop,
+                    OpcodeNil,
+                    OpcodePop,
+                    OpcodeNil,
+                    OpcodeReturn
+            },
+            1);
+}
+
+TEST(FuserTest, SameOutput)
+{
+    std::string source = "class Point {"
+                         "  init(x, y) { this.x = x; this.y = y; }"
+                         "  sum() { return this.x + this.y; }"
+                         "}"
+                         "fun count(n) {"
+                         "  var i = 0; var sum = 0;"
+                         "  while (i < n) { if (i == 3) sum = sum + 10; sum = sum + i; i = i + 1; }"
+                         "  return sum;"
+                         "}"
+                         "var total = 0;"
+                         "var i = 0;"
+                         "while (i < 5) { total = total + Point(i, 2).sum(); i = i + 1; }"
+                         "print total;"
+                         "print count(6);"
+                         "print \"a\" == \"a\" and 1 < 2;";
+    
+    EXPECT_EQ(RunSource(source, true), RunSource(source, false));
+    EXPECT_EQ(RunSource(source, true), "20\n25\ntrue\n");
+}
+
+TEST(FuserTest, CheckerRequiresFusedInstructions)
+{
+    Chunk chunk;
+    
+    PushAddConstantWithoutAdd(chunk);
+    
+    EXPECT_FALSE(ChunkChecker(chunk).Check());
+    
+    chunk.GetCode(4) = OpcodeAdd;
+    EXPECT_TRUE(ChunkChecker(chunk).Check());
+}
+
+TEST(FuserTest, MalformedSuperinstruction)
+{
+    GcPtr<Closure> func = vm.AllocateObject<Closure>(vm.InternString("<script>"), 0);
+    Chunk& chunk = func->GetChunk();
+    
+    PushAddConstantWithoutAdd(chunk);
+    
+    EXPECT_THROW(vm.RunScript(func), Exceptions::RuntimeException);
+}
+
+void GenericFuseTest(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants,
+                     std::initializer_list<uint8_t> newCode, std::size_t fusedCount)
+{
+    Chunk chunk;
+    
+    for (uint8_t byte: code)
+    {
+        chunk.PushCode(byte, 1);
+    }
+    
+    for (auto value: constants)
+    {
+        chunk.PushConstant(value, 1);
+    }
+    
+    EXPECT_EQ(ChunkFuser(chunk).Fuse(), fusedCount);
+    
+    ChunkDumper dumper(chunk, "<script>", std::cout);
+    dumper.Dump();
+    
+    auto chunkCode = std::vector<uint8_t>(chunk.CodeBegin(), chunk.CodeEnd());
+    auto newChunkCode = std::vector<uint8_t>(newCode.begin(), newCode.end());
+    
+    EXPECT_EQ(chunkCode, newChunkCode);
+    
+    // The fused code is not fused again.
+    EXPECT_EQ(ChunkFuser(chunk).Fuse(), 0);
+    
+    // Superinstructions are ordinary opcodes for the bytecode files.
+    std::stringstream ss;
+    ChunkWriter(chunk, ss).Write();
+    
+    std::unique_ptr<Chunk> readChunk = ReadChunk(vm, ss);
+    ASSERT_TRUE(readChunk != nullptr);
+    
+    EXPECT_EQ(std::vector<uint8_t>(readChunk->CodeBegin(), readChunk->CodeEnd()), newChunkCode);
+}
+
+std::string RunSource(std::string_view source, bool fuse)
+{
+    class FuserErrorReporter final : public CompilerErrorReporter
+    {
+    public:
+        void Error(SourcePosition pos, std::string_view msg) override
+        {
+            ADD_FAILURE() << "Error [" << pos << "]: " << msg << ".";
+        }
+    }; // class FuserErrorReporter
+    
+    std::stringstream output;
+    VirtualMachineConfiguration runConf(output, std::cin, std::cout);
+    VirtualMachine runVm(runConf);
+    
+    FuserErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(runVm, errorReporter, "<test>", source);
+    if (func.IsNullptr())
+    {
+        return {};
+    }
+    
+    if (fuse)
+    {
+        EXPECT_GT(ChunkFuser(func->GetChunk()).Fuse(), 0);
+        EXPECT_TRUE(ChunkChecker(func->GetChunk()).Check());
+    }
+    
+    runVm.RunScript(func);
+    return output.str();
+}
+
+void PushAddConstantWithoutAdd(Chunk& chunk)
+{
+    std::initializer_list<uint8_t> code = {
+            OpcodePushConstant,
+            0,
+            OpcodeAddConstant,
+            0,
+            OpcodePop,
+            OpcodePop,
+            OpcodeNil,
+            OpcodeReturn
+    };
+    
+    for (uint8_t byte: code)
+    {
+        chunk.PushCode(byte, 1);
+    }
+    
+    chunk.PushConstant(Value(1.0), 1);
+}
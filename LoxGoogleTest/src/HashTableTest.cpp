@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include <Lox/Lox.hpp>
+
+#include <Lox/DataStructures/HashTable.hpp>
+
+using namespace Lox;
+
+static VirtualMachineConfiguration conf(std::cout, std::cin, std::cout);
+static VirtualMachine vm(conf);
+
+TEST(HashTableTest, Empty)
+{
+    HashTable<int> table;
+    GcPtr<String> key = vm.InternString("key");
+    
+    EXPECT_EQ(table.GetSize(), 0);
+    EXPECT_EQ(table.Find(key), nullptr);
+    EXPECT_TRUE(table.FindString("key", key->GetHash()).IsNullptr());
+    EXPECT_FALSE(table.Erase(key));
+}
+
+TEST(HashTableTest, InsertFindErase)
+{
+    HashTable<int> table;
+    GcPtr<String> a = vm.InternString("a");
+    GcPtr<String> b = vm.InternString("b");
+    
+    EXPECT_TRUE(table.Insert(a, 1));
+    EXPECT_TRUE(table.Insert(b, 2));
+    EXPECT_FALSE(table.Insert(a, 3));
+    
+    EXPECT_EQ(table.GetSize(), 2);
+    ASSERT_NE(table.Find(a), nullptr);
+    EXPECT_EQ(*table.Find(a), 3);
+    EXPECT_EQ(*table.Find(b), 2);
+    
+    EXPECT_TRUE(table.Erase(a));
+    EXPECT_EQ(table.Find(a), nullptr);
+    EXPECT_EQ(*table.Find(b), 2);
+    EXPECT_EQ(table.GetSize(), 1);
+}
+
+TEST(HashTableTest, FindString)
+{
+    HashTable<std::monostate> table;
+    GcPtr<String> str = vm.InternString("hello");
+    
+    table.Insert(str, std::monostate());
+    
+    EXPECT_EQ(table.FindString("hello", String::ComputeHash("hello")), str);
+    EXPECT_TRUE(table.FindString("world", String::ComputeHash("world")).IsNullptr());
+}
+
+TEST(HashTableTest, GrowAndTombstones)
+{
+    HashTable<std::size_t> table;
+    std::vector<GcPtr<String>> keys;
+    
+    for (std::size_t i = 0; i < 1000; ++i)
+    {
+        keys.push_back(vm.InternString("key" + std::to_string(i)));
+        table.Insert(keys.back(), i);
+    }
+    
+    EXPECT_EQ(table.GetSize(), 1000);
+    EXPECT_GE(table.GetCapacity() * 3, table.GetSize() * 4);
+    
+    table.EraseIf([](GcPtr<String>, std::size_t value)
+                  {
+                      return value % 2 == 0;
+                  });
+    
+    EXPECT_EQ(table.GetSize(), 500);
+    
+    // Tombstones are reused, so erasing and inserting the same keys does not grow the table.
+    std::size_t capacity = table.GetCapacity();
+    for (std::size_t round = 0; round < 10; ++round)
+    {
+        for (std::size_t i = 1; i < keys.size(); i += 2)
+        {
+            table.Erase(keys[i]);
+            table.Insert(keys[i], i);
+        }
+    }
+    
+    EXPECT_EQ(table.GetCapacity(), capacity);
+    
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        const std::size_t* value = table.Find(keys[i]);
+        
+        if (i % 2 == 0)
+        {
+            EXPECT_EQ(value, nullptr);
+        }
+        else
+        {
+            ASSERT_NE(value, nullptr);
+            EXPECT_EQ(*value, i);
+        }
+    }
+}
+
+TEST(HashTableTest, InsertAllKeepsExisting)
+{
+    HashTable<int> base;
+    HashTable<int> derived;
+    GcPtr<String> a = vm.InternString("a");
+    GcPtr<String> b = vm.InternString("b");
+    
+    base.Insert(a, 1);
+    base.Insert(b, 2);
+    derived.Insert(a, 10);
+    
+    derived.InsertAll(base);
+    
+    EXPECT_EQ(*derived.Find(a), 10);
+    EXPECT_EQ(*derived.Find(b), 2);
+}
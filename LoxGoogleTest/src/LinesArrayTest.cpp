@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <Lox/Lox.hpp>
+
+using namespace Lox;
+
+void ExpectLines(const LinesArray& lines, const std::vector<std::size_t>& should);
+
+TEST(LinesArrayTest, Runs)
+{
+    LinesArray lines;
+    
+    lines.PushLine(1);
+    lines.PushLine(1);
+    lines.PushLine(1);
+    lines.PushLine(2);
+    lines.PushLines(3, 4);
+    
+    EXPECT_EQ(lines.GetRuns().size(), 3);
+    EXPECT_EQ(lines.GetRunLength(2), 4);
+    ExpectLines(lines, { 1, 1, 1, 2, 3, 3, 3, 3 });
+}
+
+TEST(LinesArrayTest, InsertSplits)
+{
+    LinesArray lines;
+    lines.PushLines(1, 4);
+    
+    lines.Insert(2, 5);
+    ExpectLines(lines, { 1, 1, 5, 1, 1 });
+    EXPECT_EQ(lines.GetRuns().size(), 3);
+    
+    lines.Insert(0, 7);
+    lines.Insert(6, 1);
+    ExpectLines(lines, { 7, 1, 1, 5, 1, 1, 1 });
+}
+
+TEST(LinesArrayTest, EraseMerges)
+{
+    LinesArray lines;
+    lines.PushLines(1, 2);
+    lines.PushLine(2);
+    lines.PushLines(1, 2);
+    
+    lines.Erase(2);
+    ExpectLines(lines, { 1, 1, 1, 1 });
+    EXPECT_EQ(lines.GetRuns().size(), 1);
+    
+    lines.Erase(0, 4);
+    EXPECT_EQ(lines.GetSize(), 0);
+    EXPECT_TRUE(lines.GetRuns().empty());
+}
+
+TEST(LinesArrayTest, Random)
+{
+    std::mt19937 random(42);
+    
+    LinesArray lines;
+    std::vector<std::size_t> should;
+    
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::size_t line = random() % 4;
+        
+        switch (should.empty() ? 0 : random() % 3)
+        {
+        case 0:
+            lines.PushLine(line);
+            should.push_back(line);
+            break;
+        
+        case 1:
+        {
+            std::size_t index = random() % (should.size() + 1);
+            lines.Insert(index, line);
+            should.insert(should.begin() + index, line);
+            break;
+        }
+        
+        case 2:
+        {
+            std::size_t index = random() % should.size();
+            lines.Erase(index);
+            should.erase(should.begin() + index);
+            break;
+        }
+        }
+    }
+    
+    ExpectLines(lines, should);
+    
+    for (std::size_t i = 1; i < lines.GetRuns().size(); ++i)
+    {
+        EXPECT_NE(lines.GetRuns()[i - 1].line, lines.GetRuns()[i].line);
+    }
+}
+
+void ExpectLines(const LinesArray& lines, const std::vector<std::size_t>& should)
+{
+    ASSERT_EQ(lines.GetSize(), should.size());
+    
+    for (std::size_t i = 0; i < should.size(); ++i)
+    {
+        EXPECT_EQ(lines[i], should[i]) << "at " << i;
+    }
+}
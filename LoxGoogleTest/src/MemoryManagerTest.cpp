@@ -0,0 +1,456 @@
+#include <gtest/gtest.h>
+
+#include <Lox/Lox.hpp>
+
+#include <Lox/Runtime/MemoryManager.hpp>
+#include <Lox/Runtime/Objects/Class.hpp>
+#include <Lox/Runtime/Objects/Instance.hpp>
+#include <Lox/Runtime/Objects/Shape.hpp>
+
+using namespace Lox;
+
+class TestRoots : public RootsSource
+{
+public:
+    std::vector<GcPtr<Object>> objects;
+    MemoryManager* memory = nullptr;
+    
+    void MarkRoots() override
+    {
+        for (GcPtr<Object> obj : objects)
+        {
+            memory->MarkObject(obj);
+        }
+    }
+};
+
+// GC is not allowed in these tests, so collections happen only when they are called explicitly.
+
+TEST(MemoryManagerTest, MinorCollectionPromotesSurvivors)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    
+    memory.AllocateObject<String>("garbage");
+    GcPtr<String> alive = memory.AllocateObject<String>("alive");
+    roots.objects.push_back(alive);
+    
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 2);
+    EXPECT_EQ(memory.GetBytesAllocated(), 2 * sizeof(String));
+    
+    memory.CollectYoungGeneration();
+    
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 1);
+    EXPECT_EQ(memory.GetBytesAllocated(ObjectType::String), sizeof(String));
+    EXPECT_EQ(memory.GetYoungBytesAllocated(), 0);
+    EXPECT_EQ(memory.GetMinorCollectionsCount(), 1);
+    EXPECT_TRUE(alive->IsOld());
+}
+
+TEST(MemoryManagerTest, WriteBarrierKeepsYoungObjects)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    
+    GcPtr<String> name = memory.AllocateObject<String>("A");
+    GcPtr<Class> klass = memory.AllocateObject<Class>(name);
+    GcPtr<Shape> emptyShape = memory.AllocateObject<Shape>();
+    GcPtr<Shape> shape = memory.AllocateObject<Shape>(emptyShape, name);
+    GcPtr<Instance> old = memory.AllocateObject<Instance>(klass, emptyShape);
+    roots.objects.push_back(old);
+    roots.objects.push_back(shape);
+    
+    memory.CollectYoungGeneration();
+    ASSERT_TRUE(old->IsOld());
+    ASSERT_TRUE(klass->IsOld());
+    
+    GcPtr<Instance> young = memory.AllocateObject<Instance>(klass, emptyShape);
+    old->AddSlot(shape, Value(young));
+    memory.WriteBarrier(old, Value(young));
+    
+    EXPECT_TRUE(old->IsRemembered());
+    
+    memory.CollectYoungGeneration();
+    
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), 2);
+    EXPECT_TRUE(young->IsOld());
+    EXPECT_FALSE(old->IsRemembered());
+}
+
+TEST(MemoryManagerTest, MajorCollectionFreesOldObjects)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    
+    roots.objects.push_back(memory.AllocateObject<String>("a"));
+    memory.CollectYoungGeneration();
+    
+    roots.objects.clear();
+    
+    memory.CollectYoungGeneration();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 1);
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 0);
+    EXPECT_EQ(memory.GetBytesAllocated(), 0);
+    EXPECT_EQ(memory.GetMajorCollectionsCount(), 1);
+    EXPECT_EQ(memory.GetPeakBytesAllocated(), sizeof(String));
+}
+
+TEST(MemoryManagerTest, DeepListDoesNotOverflowStack)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    
+    GcPtr<String> name = memory.AllocateObject<String>("next");
+    GcPtr<Class> klass = memory.AllocateObject<Class>(name);
+    GcPtr<Shape> emptyShape = memory.AllocateObject<Shape>();
+    GcPtr<Shape> shape = memory.AllocateObject<Shape>(emptyShape, name);
+    roots.objects.push_back(shape);
+    
+    // Recursive marking would need a native frame for every node.
+    constexpr std::size_t length = 500000;
+    
+    GcPtr<Instance> head = memory.AllocateObject<Instance>(klass, emptyShape);
+    for (std::size_t i = 1; i < length; ++i)
+    {
+        GcPtr<Instance> node = memory.AllocateObject<Instance>(klass, emptyShape);
+        node->AddSlot(shape, Value(head));
+        head = node;
+    }
+    
+    roots.objects.push_back(head);
+    
+    memory.CollectYoungGeneration();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), length);
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), length);
+    
+    roots.objects.pop_back();
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), 0);
+}
+
+TEST(MemoryManagerTest, IncrementalWriteBarrierKeepsObjects)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    memory.SetIncrementalBudget(1);
+    
+    GcPtr<String> name = memory.AllocateObject<String>("field");
+    GcPtr<Class> klass = memory.AllocateObject<Class>(name);
+    GcPtr<Shape> emptyShape = memory.AllocateObject<Shape>();
+    GcPtr<Shape> shape = memory.AllocateObject<Shape>(emptyShape, name);
+    
+    GcPtr<Instance> moved = memory.AllocateObject<Instance>(klass, emptyShape);
+    GcPtr<Instance> holder = memory.AllocateObject<Instance>(klass, emptyShape);
+    holder->AddSlot(shape, Value(moved));
+    GcPtr<Instance> traced = memory.AllocateObject<Instance>(klass, emptyShape);
+    traced->AddSlot(shape, Value());
+    
+    // The gray stack is LIFO, `traced` is the first to be traced.
+    roots.objects = {name, klass, emptyShape, shape, holder, traced};
+    memory.CollectYoungGeneration();
+    
+    memory.CollectGarbageStep();
+    memory.CollectGarbageStep();
+    ASSERT_TRUE(memory.IsCollecting());
+    
+    // `moved` goes from the gray `holder` to the traced one.
+    traced->SetSlot(0, Value(moved));
+    memory.WriteBarrier(traced, Value(moved));
+    holder->SetSlot(0, Value());
+    
+    while (memory.IsCollecting())
+    {
+        memory.CollectGarbageStep();
+    }
+    
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), 3);
+    EXPECT_EQ(memory.GetMajorCollectionsCount(), 1);
+    EXPECT_FALSE(moved->IsMarked());
+}
+
+TEST(MemoryManagerTest, IncrementalCollectionKeepsPromotedObjects)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    memory.SetIncrementalBudget(1);
+    
+    GcPtr<String> name = memory.AllocateObject<String>("field");
+    GcPtr<Class> klass = memory.AllocateObject<Class>(name);
+    GcPtr<Shape> emptyShape = memory.AllocateObject<Shape>();
+    GcPtr<Shape> shape = memory.AllocateObject<Shape>(emptyShape, name);
+    
+    GcPtr<Instance> moved = memory.AllocateObject<Instance>(klass, emptyShape);
+    GcPtr<Instance> keeper = memory.AllocateObject<Instance>(klass, emptyShape);
+    keeper->AddSlot(shape, Value(moved));
+    GcPtr<Instance> traced = memory.AllocateObject<Instance>(klass, emptyShape);
+    traced->AddSlot(shape, Value());
+    
+    roots.objects = {name, klass, emptyShape, shape, keeper, traced, memory.AllocateObject<String>("garbage")};
+    memory.CollectYoungGeneration();
+    roots.objects.pop_back();
+    
+    memory.CollectGarbageStep();
+    memory.CollectGarbageStep();
+    ASSERT_TRUE(memory.IsCollecting());
+    
+    // `moved` is reachable only through a young object, which is promoted in the middle of the marking.
+    GcPtr<Instance> young = memory.AllocateObject<Instance>(klass, emptyShape);
+    young->AddSlot(shape, Value(moved));
+    traced->SetSlot(0, Value(young));
+    memory.WriteBarrier(traced, Value(young));
+    keeper->SetSlot(0, Value());
+    
+    memory.CollectYoungGeneration();
+    EXPECT_TRUE(young->IsOld());
+    EXPECT_TRUE(memory.IsCollecting());
+    
+    // Young objects survive the incremental collection, even the unreachable ones.
+    memory.AllocateObject<String>("young garbage");
+    
+    while (memory.IsCollecting())
+    {
+        memory.CollectGarbageStep();
+    }
+    
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), 4);
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 2);
+    
+    memory.CollectYoungGeneration();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 1);
+}
+
+TEST(MemoryManagerTest, FreedMemoryIsReused)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    
+    String* garbage = memory.AllocateObject<String>("garbage").GetRawPointer();
+    
+    memory.CollectYoungGeneration();
+    EXPECT_GE(memory.GetFreeBytes(), sizeof(String));
+    
+    GcPtr<String> str = memory.AllocateObject<String>("str");
+    EXPECT_EQ(str.GetRawPointer(), garbage);
+    EXPECT_EQ(memory.GetFreeBytes(), 0);
+}
+
+TEST(MemoryManagerTest, OldGenerationIsSweptLazily)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    memory.SetStressGC(true);
+    memory.AllowGC();
+    
+    constexpr std::size_t count = 200;
+    
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        roots.objects.push_back(memory.AllocateObject<String>("old"));
+    }
+    
+    roots.objects.clear();
+    
+    while (memory.IsCollecting())
+    {
+        memory.AllocateObject<String>("young");
+    }
+    
+    while (!memory.IsCollecting())
+    {
+        memory.AllocateObject<String>("young");
+    }
+    
+    // The old strings are marked as dead, but they are freed by the next allocations.
+    std::size_t marked = memory.GetObjectsCount(ObjectType::String);
+    EXPECT_GE(marked, count);
+    
+    memory.AllocateObject<String>("young");
+    EXPECT_LT(memory.GetObjectsCount(ObjectType::String), marked);
+    EXPECT_GT(memory.GetObjectsCount(ObjectType::String), count / 2);
+    
+    while (memory.IsCollecting())
+    {
+        memory.AllocateObject<String>("young");
+    }
+    
+    EXPECT_LE(memory.GetObjectsCount(ObjectType::String), 2);
+    
+    memory.DisallowGC();
+}
+
+TEST(MemoryManagerTest, PayloadsTriggerCollections)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    memory.AllowGC();
+    
+    constexpr std::size_t length = 128 * 1024;
+    
+    roots.objects.push_back(memory.AllocateObject<String>(std::string(length, 'a')));
+    EXPECT_GE(memory.GetBytesAllocated(ObjectType::String), sizeof(String) + length);
+    
+    // The characters are counted, so the garbage strings are collected long before
+    // their headers fill the young generation.
+    for (std::size_t i = 0; i < 200; ++i)
+    {
+        memory.AllocateObject<String>(std::string(length, 'x'));
+    }
+    
+    EXPECT_GT(memory.GetMinorCollectionsCount(), 50);
+    EXPECT_LE(memory.GetObjectsCount(ObjectType::String), 3);
+    EXPECT_LT(memory.GetPeakBytesAllocated(), Configuration::YoungGenerationSize + 3 * length);
+    
+    memory.DisallowGC();
+    
+    roots.objects.clear();
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetBytesAllocated(), 0);
+}
+
+TEST(MemoryManagerTest, ObjectsAreCarvedFromPages)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    
+    GcPtr<String> first = memory.AllocateObject<String>("first");
+    GcPtr<String> second = memory.AllocateObject<String>("second");
+    
+    // A pointer bump, the cells are rounded up to the granularity.
+    std::size_t cellSize = (sizeof(String) + ObjectAllocator::Granularity - 1) / ObjectAllocator::Granularity
+                           * ObjectAllocator::Granularity;
+    EXPECT_EQ(reinterpret_cast<std::byte*>(second.GetRawPointer()),
+              reinterpret_cast<std::byte*>(first.GetRawPointer()) + cellSize);
+    EXPECT_EQ(memory.GetPagesCount(), 1);
+    
+    first->SetMarked();
+    EXPECT_TRUE(first->IsMarked());
+    EXPECT_FALSE(second->IsMarked());
+    first->Unmark();
+    
+    constexpr std::size_t count = 2000;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        memory.AllocateObject<String>("garbage");
+    }
+    
+    EXPECT_GT(memory.GetPagesCount(), count * cellSize / ObjectAllocator::PageSize);
+    
+    // The empty pages are given back at the end of a major collection.
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 0);
+    EXPECT_EQ(memory.GetPagesCount(), 0);
+    EXPECT_EQ(memory.GetFreeBytes(), 0);
+}
+
+TEST(MemoryManagerTest, ParallelMarking)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    memory.SetMarkingThreads(4);
+    
+    GcPtr<String> name = memory.AllocateObject<String>("next");
+    GcPtr<Class> klass = memory.AllocateObject<Class>(name);
+    GcPtr<Shape> emptyShape = memory.AllocateObject<Shape>();
+    GcPtr<Shape> shape = memory.AllocateObject<Shape>(emptyShape, name);
+    roots.objects = {name, klass, emptyShape, shape};
+    
+    // Long lists to share between the threads, and the shared nodes are traced once.
+    constexpr std::size_t lists = 8;
+    constexpr std::size_t length = 5000;
+    
+    GcPtr<Instance> shared = memory.AllocateObject<Instance>(klass, emptyShape);
+    for (std::size_t i = 0; i < lists; ++i)
+    {
+        GcPtr<Instance> head = shared;
+        for (std::size_t j = 0; j < length; ++j)
+        {
+            GcPtr<Instance> node = memory.AllocateObject<Instance>(klass, emptyShape);
+            node->AddSlot(shape, Value(head));
+            head = node;
+        }
+        
+        roots.objects.push_back(head);
+    }
+    
+    memory.AllocateObject<Instance>(klass, emptyShape);
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), lists * length + 1);
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), lists * length + 1);
+    
+    roots.objects.resize(roots.objects.size() - lists / 2);
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), lists / 2 * length + 1);
+    
+    memory.SetMarkingThreads(1);
+    roots.objects.resize(4);
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::Instance), 0);
+}
+
+TEST(MemoryManagerTest, BackgroundSweeping)
+{
+    TestRoots roots;
+    MemoryManager memory(roots);
+    roots.memory = &memory;
+    memory.SetBackgroundSweeping(true);
+    
+    constexpr std::size_t count = 1000;
+    
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        roots.objects.push_back(memory.AllocateObject<String>("old"));
+    }
+    
+    memory.CollectYoungGeneration();
+    roots.objects.resize(count / 2);
+    
+    // The roots and the whole marking, then the steps free the objects swept by the thread.
+    memory.SetIncrementalBudget(2 * count);
+    memory.CollectGarbageStep();
+    memory.CollectGarbageStep();
+    ASSERT_TRUE(memory.IsCollecting());
+    
+    // The new objects are not swept.
+    roots.objects.push_back(memory.AllocateObject<String>("young"));
+    
+    while (memory.IsCollecting())
+    {
+        memory.CollectGarbageStep();
+    }
+    
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), count / 2 + 1);
+    EXPECT_EQ(memory.GetMajorCollectionsCount(), 1);
+    
+    for (GcPtr<Object> obj : roots.objects)
+    {
+        EXPECT_FALSE(obj->IsMarked());
+    }
+    
+    // The survivors are old again, so they are swept by the next collection.
+    roots.objects.clear();
+    
+    memory.CollectGarbage();
+    EXPECT_EQ(memory.GetObjectsCount(ObjectType::String), 0);
+    EXPECT_EQ(memory.GetMajorCollectionsCount(), 2);
+}
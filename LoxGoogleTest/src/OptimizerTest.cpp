@@ -133,6 +133,90 @@ TEST(OptimizerTest, StringConc)
                      });
 }
 
+TEST(OptimizerTest, OperandsAreSkipped)
+{
+    GenericChunkTest({
+                             OpcodeGetLocal,
+                             OpcodeTrue,
+                             OpcodeNot,
+                             OpcodePrint,
+                             OpcodeReturn
+                     },
+                     {},
+                     {
+                             OpcodeGetLocal,
+                             OpcodeTrue,
+                             OpcodeNot,
+                             OpcodePrint,
+                             OpcodeReturn
+                     },
+                     {});
+}
+
+TEST(OptimizerTest, JumpsRelocation)
+{
+    GenericChunkTest({
+                             OpcodeFalse,
+                             OpcodeJumpIfFalse,
+                             0,
+                             4,
+                             OpcodePop,
+                             OpcodeTrue,
+                             OpcodeTrue,
+                             OpcodeEqual,
+                             OpcodePrint,
+                             OpcodeNil,
+                             OpcodeLoop,
+                             0,
+                             13
+                     },
+                     {},
+                     {
+                             OpcodeFalse,
+                             OpcodeJumpIfFalse,
+                             0,
+                             2,
+                             OpcodePop,
+                             OpcodeTrue,
+                             OpcodePrint,
+                             OpcodeNil,
+                             OpcodeLoop,
+                             0,
+                             11
+                     },
+                     {});
+}
+
+TEST(OptimizerTest, JumpTargetIsNotFolded)
+{
+    GenericChunkTest({
+                             OpcodeFalse,
+                             OpcodeJumpIfFalse,
+                             0,
+                             2,
+                             OpcodePop,
+                             OpcodeTrue,
+                             OpcodeNot,
+                             OpcodePrint,
+                             OpcodeNil,
+                             OpcodeReturn
+                     },
+                     {},
+                     {
+                             OpcodeFalse,
+                             OpcodeJumpIfFalse,
+                             0,
+                             2,
+                             OpcodePop,
+                             OpcodeTrue,
+                             OpcodeNot,
+                             OpcodePrint,
+                             OpcodeNil,
+                             OpcodeReturn
+                     },
+                     {});
+}
+
 void GenericChunkTest(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants,
                       std::initializer_list<uint8_t> newCode, std::initializer_list<Value> newConstants)
 {
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <cmath>
+
 #include <Lox/Lox.hpp>
 
 std::string PrintValue(Lox::Value val);
@@ -27,6 +29,59 @@ TEST(ValueRepr, DoublesRepr)
     GenericValueTest(3.14, "3.14");
 }
 
+TEST(ValueRepr, NanIsDouble)
+{
+    Lox::Value val(std::nan(""));
+    
+    EXPECT_TRUE(val.IsDouble());
+    EXPECT_TRUE(std::isnan(val.AsDouble()));
+}
+
+TEST(ValueRepr, ObjectRepr)
+{
+    Lox::String str(Lox::GcPtr<Lox::Object>(nullptr), "abc");
+    Lox::GcPtr<Lox::String> ptr(&str);
+    
+    Lox::Value val(ptr);
+    
+    EXPECT_TRUE(val.IsObject());
+    EXPECT_TRUE(val.IsObject<Lox::String>());
+    EXPECT_EQ(val.AsObject<Lox::String>(), ptr);
+    EXPECT_EQ(PrintValue(val), "\"abc\"");
+}
+
+TEST(ValueRepr, Size)
+{
+    if constexpr (Lox::Configuration::NanBoxing)
+    {
+        EXPECT_EQ(sizeof(Lox::Value), 8);
+    }
+}
+
+TEST(ValueEquality, Doubles)
+{
+    EXPECT_EQ(Lox::Value(1.5), Lox::Value(1.5));
+    EXPECT_EQ(Lox::Value(0.0), Lox::Value(-0.0));
+    EXPECT_NE(Lox::Value(std::nan("")), Lox::Value(std::nan("")));
+}
+
+TEST(ValueEquality, DifferentTypes)
+{
+    EXPECT_NE(Lox::Value(false), Lox::NIL);
+    EXPECT_NE(Lox::Value(0.0), Lox::Value(false));
+    EXPECT_NE(Lox::Value(0.0), Lox::NIL);
+    EXPECT_NE(Lox::Value(true), Lox::Value(1.0));
+}
+
+TEST(ValueTruthiness, Falsey)
+{
+    EXPECT_TRUE(Lox::NIL.IsFalse());
+    EXPECT_TRUE(Lox::Value(false).IsFalse());
+    
+    EXPECT_TRUE(Lox::Value(true).IsTrue());
+    EXPECT_TRUE(Lox::Value(0.0).IsTrue());
+}
+
 template <typename T>
 void GenericValueTest(T actual, std::string_view actualPrint)
 {
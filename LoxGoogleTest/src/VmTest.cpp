@@ -2,15 +2,34 @@
 
 #include <Lox/Lox.hpp>
 
+#include <Lox/DataStructures/InlineCache.hpp>
+#include <Lox/Runtime/Objects/Class.hpp>
+#include <Lox/Runtime/Objects/Shape.hpp>
+
 using namespace Lox;
 
 static std::stringstream testOutput;
-static VirtualMachineConfiguration conf(testOutput, std::cin, std::cout);
+
+// The GC bugs show up much earlier when it runs on every allocation.
+static VirtualMachineConfiguration MakeStressConfiguration()
+{
+    VirtualMachineConfiguration result(testOutput, std::cin, std::cout);
+    result.SetStressGC(true);
+    return result;
+}
+
+static VirtualMachineConfiguration conf = MakeStressConfiguration();
 static VirtualMachine vm(conf);
 
 void GenericTest(std::initializer_list<uint8_t> code, std::initializer_list<Value> constants,
                  std::string_view outputShould);
 
+void GenericSourceTest(std::string_view source, std::string_view outputShould);
+
+/// Run the source on a VM of its own, the user output of `runConf` should be `testOutput`.
+void GenericSourceTest(const VirtualMachineConfiguration& runConf, std::string_view source,
+                       std::string_view outputShould);
+
 TEST(VmTest, OnlyReturn)
 {
     GenericTest(
@@ -349,7 +368,8 @@ TEST(VmTest, JumpIfFalseJump)
                         OpcodeFalse,
                         OpcodeJumpIfFalse,
                         0,
-                        1,
+                        2,
+                        OpcodePop,
                         OpcodeTrue,
                         OpcodePrint,
                         OpcodeNil,
@@ -426,6 +446,144 @@ TEST(VmTest, CallTest)
                 "true\n");
 }
 
+TEST(VmTest, PolymorphicInlineCache)
+{
+    GenericSourceTest("class A { name() { return \"A\"; } }\n"
+                      "class B < A { name() { return \"B\"; } }\n"
+                      "fun f(obj) { print obj.name(); }\n"
+                      "f(A()); f(B()); f(A());\n"
+                      "var a = A();\n"
+                      "f(a);\n"
+                      "print a.name == a.name;\n"
+                      "fun g() { return \"field\"; }\n"
+                      "a.name = g;\n"
+                      "f(a);\n"
+                      "f(B());\n",
+                      "A\nB\nA\nA\nfalse\nfield\nB\n");
+}
+
+TEST(VmTest, InlineCacheInvalidation)
+{
+    GcPtr<Class> klass = vm.AllocateObject<Class>(vm.InternString("A"));
+    GcPtr<Closure> first = vm.AllocateObject<Closure>(vm.InternString("first"), 0);
+    GcPtr<Closure> second = vm.AllocateObject<Closure>(vm.InternString("second"), 0);
+    
+    klass->AddMethod(vm.InternString("m"), first);
+    
+    InlineCache cache;
+    EXPECT_TRUE(cache.Lookup(klass).IsNullptr());
+    
+    cache.Update(klass, first);
+    EXPECT_EQ(cache.Lookup(klass).GetRawPointer(), first.GetRawPointer());
+    
+    klass->AddMethod(vm.InternString("m"), second);
+    EXPECT_TRUE(cache.Lookup(klass).IsNullptr());
+}
+
+TEST(VmTest, InlineCacheOfWrongConstant)
+{
+    for (Opcode opcode : {OpcodeGetProperty, OpcodeGetPropertyField})
+    {
+        // The unverified code turns off the fast path of the VM, so it has its own.
+        VirtualMachine malformedVm(conf);
+        
+        GcPtr<Closure> func = malformedVm.AllocateObject<Closure>(malformedVm.InternString("<script>"), 0);
+        Chunk& chunk = func->GetChunk();
+        
+        chunk.PushCode(OpcodeNil, 1);
+        chunk.PushCode(opcode, 1);
+        chunk.PushCode(200, 1);
+        chunk.PushCode(OpcodeReturn, 1);
+        chunk.PushConstant(Value(malformedVm.InternString("x")), 1);
+        
+        try
+        {
+            malformedVm.RunScript(func);
+            FAIL() << "the wrong constant is not reported";
+        }
+        catch (const Exceptions::RuntimeException& e)
+        {
+            EXPECT_STREQ(e.what(), "invalid constant index");
+        }
+    }
+}
+
+TEST(VmTest, GlobalSlots)
+{
+    GenericSourceTest("var a = 1;\n"
+                      "fun f() { return a; }\n"
+                      "var a = 2;\n"
+                      "print f();\n"
+                      "a = 3;\n"
+                      "print f();\n",
+                      "2\n3\n");
+}
+
+TEST(VmTest, UndefinedGlobal)
+{
+    EXPECT_THROW(GenericSourceTest("print notDefinedGlobal;", ""), Exceptions::UndefinedVariable);
+    EXPECT_THROW(GenericSourceTest("fun f() { return definedLater; }\nf();\nvar definedLater = 1;", ""),
+                 Exceptions::UndefinedVariable);
+    EXPECT_THROW(GenericSourceTest("notDefinedGlobal = 1;", ""), Exceptions::UndefinedVariable);
+}
+
+TEST(VmTest, FieldsShapes)
+{
+    GenericSourceTest("class P {}\n"
+                      "fun sum(p) { return p.x + p.y; }\n"
+                      "var a = P(); a.x = 1; a.y = 2;\n"
+                      "var b = P(); b.y = 20; b.x = 10;\n"
+                      "var c = P(); c.x = 100; c.y = 200; c.x = 300;\n"
+                      "print sum(a); print sum(b); print sum(c); print sum(a);\n",
+                      "3\n30\n500\n3\n");
+}
+
+TEST(VmTest, FieldsOverflow)
+{
+    // Fields are set in several functions, because a chunk has at most 256 constants.
+    std::string source = "class P {}\nvar p = P();\n";
+    std::string output;
+    
+    for (std::size_t i = 0; i < Configuration::MaxShapeSlots + 16; i += 16)
+    {
+        std::string group = std::to_string(i);
+        
+        source += "fun set" + group + "() {\n";
+        for (std::size_t j = i; j < i + 16; ++j)
+        {
+            source += "p.f" + std::to_string(j) + " = " + std::to_string(j) + ";\n";
+        }
+        source += "}\nset" + group + "();\n";
+        
+        source += "print p.f" + group + ";\n";
+        output += group + "\n";
+    }
+    
+    source += "p.f70 = nil;\nprint p.f70;\nprint p.f71;\n";
+    output += "nil\n71\n";
+    
+    GenericSourceTest(source, output);
+}
+
+TEST(VmTest, ShapeTransitions)
+{
+    GcPtr<String> x = vm.InternString("x");
+    GcPtr<String> y = vm.InternString("y");
+    
+    GcPtr<Shape> empty = vm.AllocateObject<Shape>();
+    GcPtr<Shape> withX = vm.AllocateObject<Shape>(empty, x);
+    empty->AddTransition(x, withX);
+    GcPtr<Shape> withXY = vm.AllocateObject<Shape>(withX, y);
+    
+    EXPECT_EQ(empty->GetTransition(x)->GetRawPointer(), withX.GetRawPointer());
+    EXPECT_FALSE(empty->GetTransition(y));
+    
+    EXPECT_EQ(withXY->GetSlotsCount(), 2);
+    EXPECT_EQ(withXY->FindSlot(x), 0);
+    EXPECT_EQ(withXY->FindSlot(y), 1);
+    EXPECT_FALSE(withX->FindSlot(y));
+}
+
 // TODO: Upvalue get/set test.
 
 void GenericComparison(Opcode opcode, Value a, Value b, bool isTrue)
@@ -515,3 +673,369 @@ void GenericFastValuePush(Opcode opcode, std::string_view result)
             result);
 }
 
+class TestErrorReporter final : public CompilerErrorReporter
+{
+public:
+    void Error(SourcePosition pos, std::string_view msg) override
+    {
+        ADD_FAILURE() << "Error [" << pos << "]: " << msg << ".";
+    }
+};
+
+TEST(VmTest, BuilderStrings)
+{
+    std::string base(64, 'a');
+    
+    // `c` is appended in place to the buffer of `b`, then `d` has to copy it.
+    GenericSourceTest("var b = \"" + base + "\" + \"b\";\n"
+                      "var c = b + \"c\";\n"
+                      "var d = b + \"d\";\n"
+                      "var e = c + c;\n"
+                      "print b; print c; print d; print e;\n",
+                      base + "b\n" + base + "bc\n" + base + "bd\n" + base + "bc" + base + "bc\n");
+}
+
+TEST(VmTest, ConcatenationEquality)
+{
+    std::string base(64, 'a');
+    
+    GenericSourceTest("var short = \"a\" + \"b\";\n"
+                      "var long = \"" + base + "\" + \"b\";\n"
+                      "print short == \"ab\";\n"
+                      "print \"ab\" == short;\n"
+                      "print short == \"ba\";\n"
+                      "print long == \"" + base + "b\";\n"
+                      "print long == \"" + base + "\" + \"b\";\n"
+                      "print long == short;\n"
+                      "print long == long + \"\";\n",
+                      "true\ntrue\nfalse\ntrue\ntrue\nfalse\ntrue\n");
+}
+
+TEST(VmTest, TraceExecution)
+{
+    std::stringstream trace;
+    
+    VirtualMachineConfiguration traceConf(testOutput, std::cin, trace);
+    traceConf.SetTraceExecution(true);
+    
+    GenericSourceTest(traceConf, "print 1 + 2;", "3\n");
+    
+    EXPECT_NE(trace.str().find("Add"), std::string::npos);
+    EXPECT_NE(trace.str().find("Print"), std::string::npos);
+}
+
+TEST(VmTest, WeakInternTable)
+{
+    std::stringstream output;
+    
+    VirtualMachineConfiguration weakConf(output, std::cin, std::cout);
+    weakConf.SetStressGC(true);
+    VirtualMachine weakVm(weakConf);
+    
+    TestErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(weakVm, errorReporter, "<test>",
+                                  "var kept = \"a\" + \"b\";"
+                                  "var str = \"\";"
+                                  "var i = 0;"
+                                  "while (i < 200) { str = str + \"x\"; i = i + 1; }"
+                                  "print kept == \"a\" + \"b\";");
+    ASSERT_FALSE(func.IsNullptr());
+    
+    weakVm.RunScript(func);
+    
+    EXPECT_EQ(output.str(), "true\n");
+    
+    // The intermediate strings are not kept alive by the intern table.
+    EXPECT_LT(weakVm.GetMemoryManager().GetObjectsCount(ObjectType::String), 50);
+}
+
+TEST(VmTest, IncrementalGC)
+{
+    std::stringstream output;
+    
+    VirtualMachineConfiguration incrementalConf(output, std::cin, std::cout);
+    incrementalConf.SetStressGC(true);
+    incrementalConf.SetIncrementalGCBudget(2);
+    VirtualMachine incrementalVm(incrementalConf);
+    
+    TestErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(incrementalVm, errorReporter, "<test>",
+                                  "class Node { init(value, next) { this.value = value; this.next = next; } }"
+                                  "var list = nil;"
+                                  "var i = 0;"
+                                  "while (i < 300) { list = Node(\"n\" + \"x\", list); list.tag = i; i = i + 1; }"
+                                  "var sum = 0;"
+                                  "while (list != nil) { sum = sum + list.tag; list = list.next; }"
+                                  "print sum;");
+    ASSERT_FALSE(func.IsNullptr());
+    
+    incrementalVm.RunScript(func);
+    
+    EXPECT_EQ(output.str(), "44850\n");
+    EXPECT_GT(incrementalVm.GetMemoryManager().GetMajorCollectionsCount(), 0);
+}
+
+TEST(VmTest, BuilderBuffersTriggerCollections)
+{
+    std::stringstream output;
+    
+    VirtualMachineConfiguration builderConf(output, std::cin, std::cout);
+    VirtualMachine builderVm(builderConf);
+    
+    TestErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(builderVm, errorReporter, "<test>",
+                                  "var base = \"a\";"
+                                  "var i = 0;"
+                                  "while (i < 17) { base = base + base; i = i + 1; }"
+                                  "var t;"
+                                  "var j = 0;"
+                                  "while (j < 3000) { t = base + \"x\"; j = j + 1; }"
+                                  "print j;");
+    ASSERT_FALSE(func.IsNullptr());
+    
+    builderVm.RunScript(func);
+    
+    EXPECT_EQ(output.str(), "3000\n");
+    
+    // Every concatenation makes a buffer of 256 KiB, so the dead ones do not pile up.
+    const MemoryManager& memory = builderVm.GetMemoryManager();
+    EXPECT_GT(memory.GetMinorCollectionsCount(), 1000);
+    EXPECT_LT(memory.GetObjectsCount(ObjectType::String), 100);
+    EXPECT_LT(memory.GetPeakBytesAllocated(), 8 * 1024 * 1024);
+}
+
+static bool HasOpcode(const Chunk& chunk, Opcode opcode)
+{
+    for (std::size_t offset = 0; offset < chunk.GetCodeSize(); offset += *ChunkChecker::GetInstructionSize(chunk, offset))
+    {
+        if (chunk.GetCode(offset) == opcode)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+TEST(VmTest, Quickening)
+{
+    std::stringstream output;
+    
+    VirtualMachineConfiguration quickConf(output, std::cin, std::cout);
+    VirtualMachine quickVm(quickConf);
+    
+    TestErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(quickVm, errorReporter, "<test>",
+                                  "class Point { init(x) { this.x = x; } }"
+                                  "fun add(a, b) { return a + b; }"
+                                  "fun getX(p) { return p.x; }"
+                                  "print add(1, 2);"
+                                  "print getX(Point(3));");
+    ASSERT_FALSE(func.IsNullptr());
+    
+    quickVm.RunScript(func);
+    EXPECT_EQ(output.str(), "3\n3\n");
+    
+    GcPtr<Closure> add;
+    GcPtr<Closure> getX;
+    
+    for (auto it = func->GetChunk().ConstantsBegin(); it != func->GetChunk().ConstantsEnd(); ++it)
+    {
+        if (it->IsObject(ObjectType::Closure))
+        {
+            GcPtr<Closure> closure = it->AsObject<Closure>();
+            
+            if (closure->GetName()->GetView() == "add")
+            {
+                add = closure;
+            }
+            else if (closure->GetName()->GetView() == "getX")
+            {
+                getX = closure;
+            }
+        }
+    }
+    
+    ASSERT_FALSE(add.IsNullptr());
+    ASSERT_FALSE(getX.IsNullptr());
+    
+    EXPECT_TRUE(HasOpcode(func->GetChunk(), OpcodeCallClosure));
+    EXPECT_TRUE(HasOpcode(add->GetChunk(), OpcodeAddDouble));
+    EXPECT_TRUE(HasOpcode(getX->GetChunk(), OpcodeGetPropertyField));
+    
+    // The guards fail, so the instructions go back to the generic ones.
+    output.str(std::string());
+    
+    GcPtr<Closure> strings = Compile(quickVm, errorReporter, "<test>",
+                                     "print add(\"a\", \"b\");"
+                                     "class Other { init() { this.y = 1; this.x = 2; } }"
+                                     "print getX(Other());");
+    ASSERT_FALSE(strings.IsNullptr());
+    
+    quickVm.RunScript(strings);
+    EXPECT_EQ(output.str(), "ab\n2\n");
+    
+    EXPECT_TRUE(HasOpcode(add->GetChunk(), OpcodeAdd));
+    EXPECT_FALSE(HasOpcode(add->GetChunk(), OpcodeAddDouble));
+    
+    // The other shape is cached, so the field load is quickened again.
+    EXPECT_TRUE(HasOpcode(getX->GetChunk(), OpcodeGetPropertyField));
+    EXPECT_TRUE(ChunkChecker(add->GetChunk(), 2, 0).Check());
+}
+
+TEST(VmTest, OpcodeProfiler)
+{
+    std::stringstream output;
+    
+    VirtualMachineConfiguration plainConf(output, std::cin, std::cout);
+    VirtualMachine plainVm(plainConf);
+    EXPECT_FALSE(plainVm.GetOpcodeProfiler());
+    
+    VirtualMachineConfiguration profileConf(output, std::cin, std::cout);
+    profileConf.SetProfileOpcodes(true);
+    VirtualMachine profileVm(profileConf);
+    
+    TestErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(profileVm, errorReporter, "<test>",
+                                  "var i = 0; while (i < 10) { i = i + 1; } print i;");
+    ASSERT_FALSE(func.IsNullptr());
+    
+    profileVm.RunScript(func);
+    EXPECT_EQ(output.str(), "10\n");
+    
+    const std::optional<OpcodeProfiler>& profiler = profileVm.GetOpcodeProfiler();
+    ASSERT_TRUE(profiler);
+    
+    EXPECT_EQ(profiler->GetTotalCount(), profileVm.GetExecutedInstructionsCount());
+    EXPECT_EQ(profiler->GetCount(OpcodePrint), 1);
+    
+    // The dispatched opcodes are counted, `Add` is quickened after the first run.
+    EXPECT_EQ(profiler->GetCount(OpcodeAdd), 1);
+    EXPECT_EQ(profiler->GetCount(OpcodeAddDouble), 9);
+    EXPECT_EQ(profiler->GetPairCount(OpcodeAdd, OpcodeSetGlobalSlot), 1);
+    EXPECT_EQ(profiler->GetPairCount(OpcodeAddDouble, OpcodeSetGlobalSlot), 9);
+    EXPECT_EQ(profiler->GetPairCount(OpcodePrint, OpcodeAdd), 0);
+    EXPECT_GT(profiler->GetTicks(OpcodeAddDouble), 0);
+    
+    // Every instruction but the last one starts a pair.
+    std::uint64_t pairs = 0;
+    for (std::size_t first = 0; first < OpcodesCount; ++first)
+    {
+        for (std::size_t second = 0; second < OpcodesCount; ++second)
+        {
+            pairs += profiler->GetPairCount(static_cast<Opcode>(first), static_cast<Opcode>(second));
+        }
+    }
+    
+    EXPECT_EQ(pairs, profiler->GetTotalCount() - 1);
+    
+    std::stringstream csv;
+    profiler->WriteCsv(csv);
+    EXPECT_EQ(csv.str().substr(0, csv.str().find('\n')), "kind,first,second,count,ticks");
+    EXPECT_NE(csv.str().find("pair,AddDouble,SetGlobalSlot,9,\n"), std::string::npos);
+    
+    std::stringstream json;
+    profiler->WriteJson(json);
+    EXPECT_NE(json.str().find("{ \"name\": \"AddDouble\", \"count\": 9,"), std::string::npos);
+}
+
+TEST(VmTest, SamplingProfiler)
+{
+    std::stringstream output;
+    
+    VirtualMachineConfiguration plainConf(output, std::cin, std::cout);
+    VirtualMachine plainVm(plainConf);
+    EXPECT_FALSE(plainVm.GetSamplingProfiler());
+    
+    std::string_view source = "fun hot(n) {\n"
+                              "    var s = 0; var i = 0;\n"
+                              "    while (i < n) { s = s + i; i = i + 1; }\n"
+                              "    return s;\n"
+                              "}\n"
+                              "print hot(100);\n";
+    
+    // Every instruction is sampled.
+    VirtualMachineConfiguration everyConf(output, std::cin, std::cout);
+    everyConf.SetSampleInterval(1);
+    VirtualMachine everyVm(everyConf);
+    
+    TestErrorReporter errorReporter;
+    GcPtr<Closure> func = Compile(everyVm, errorReporter, "<test>", source);
+    ASSERT_FALSE(func.IsNullptr());
+    
+    everyVm.RunScript(func);
+    EXPECT_EQ(output.str(), "4950\n");
+    
+    const std::optional<SamplingProfiler>& sampler = everyVm.GetSamplingProfiler();
+    ASSERT_TRUE(sampler);
+    
+    EXPECT_EQ(sampler->GetSamplesCount(), everyVm.GetExecutedInstructionsCount());
+    EXPECT_EQ(sampler->GetFunctionTotalCount("<script>"), sampler->GetSamplesCount());
+    EXPECT_EQ(sampler->GetFunctionSelfCount("<script>") + sampler->GetFunctionSelfCount("hot"),
+              sampler->GetSamplesCount());
+    EXPECT_GT(sampler->GetFunctionSelfCount("hot"), sampler->GetFunctionSelfCount("<script>"));
+    
+    // The loop is the hottest, the outer frame is at the call.
+    EXPECT_GT(sampler->GetStackCount("<script>:6;hot:3"), sampler->GetStackCount("<script>:6;hot:2"));
+    EXPECT_GT(sampler->GetStackCount("<script>:6;hot:2"), 0);
+    EXPECT_GT(sampler->GetStackCount("<script>:6"), 0);
+    EXPECT_EQ(sampler->GetStackCount("<script>:1;hot:3"), 0);
+    
+    // Every folded line ends with its count.
+    std::stringstream folded;
+    sampler->WriteFolded(folded);
+    
+    std::uint64_t samples = 0;
+    std::string line;
+    while (std::getline(folded, line))
+    {
+        samples += std::stoull(line.substr(line.rfind(' ') + 1));
+    }
+    
+    EXPECT_EQ(samples, sampler->GetSamplesCount());
+    EXPECT_NE(folded.str().find("<script>:6;hot:3 "), std::string::npos);
+    
+    VirtualMachineConfiguration sparseConf(output, std::cin, std::cout);
+    sparseConf.SetSampleInterval(7);
+    VirtualMachine sparseVm(sparseConf);
+    
+    func = Compile(sparseVm, errorReporter, "<test>", source);
+    ASSERT_FALSE(func.IsNullptr());
+    
+    sparseVm.RunScript(func);
+    EXPECT_EQ(sparseVm.GetSamplingProfiler()->GetSamplesCount(), sparseVm.GetExecutedInstructionsCount() / 7);
+}
+
+void GenericSourceTest(std::string_view source, std::string_view outputShould)
+{
+    TestErrorReporter errorReporter;
+    
+    GcPtr<Closure> func = Compile(vm, errorReporter, "<test>", source);
+    ASSERT_FALSE(func.IsNullptr());
+    
+    vm.RunScript(func);
+    
+    std::string output = testOutput.str();
+    testOutput.str(std::string());
+    testOutput.clear();
+    
+    EXPECT_EQ(output, outputShould);
+}
+
+void GenericSourceTest(const VirtualMachineConfiguration& runConf, std::string_view source,
+                       std::string_view outputShould)
+{
+    VirtualMachine runVm(runConf);
+    TestErrorReporter errorReporter;
+    
+    GcPtr<Closure> func = Compile(runVm, errorReporter, "<test>", source);
+    ASSERT_FALSE(func.IsNullptr());
+    
+    runVm.RunScript(func);
+    
+    std::string output = testOutput.str();
+    testOutput.str(std::string());
+    testOutput.clear();
+    
+    EXPECT_EQ(output, outputShould);
+}
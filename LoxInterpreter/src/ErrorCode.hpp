@@ -28,6 +28,8 @@ enum ErrorCode
     ErrorCodeUndefinedProperty,
     ErrorCodeGenericRuntimeError,
     
+    ErrorCodeWriteProfileError,
+    
     ErrorCodeOk = 0,
 }; // enum ErrorCode
 
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
 #include <memory>
 #include <string>
 #include <fstream>
@@ -13,6 +14,29 @@
 
 void PrintUsage();
 
+/// Where the opcodes profile and the stack samples are written at exit, see
+/// `Lox::OpcodeProfiler` and `Lox::SamplingProfiler`.
+struct ProfileOutput
+{
+    bool print = false;
+    std::string csvPath;
+    std::string jsonPath;
+    
+    bool printSamples = false;
+    std::string foldedPath;
+};
+
+/// Return the index of the first argument after the options, or -1 on an unknown option.
+int ParseDebugFlags(int argc, const char* argv[], Lox::VirtualMachineConfiguration& conf, ProfileOutput& profile);
+
+int RunCommand(Lox::VirtualMachine& vm, int argc, const char* argv[], int first);
+
+int WriteProfile(const Lox::VirtualMachine& vm, const ProfileOutput& profile);
+
+int WriteSamples(const Lox::VirtualMachine& vm, const ProfileOutput& profile);
+
+int WriteProfileFile(const std::string& path, const std::function<void(std::ostream&)>& write);
+
 int RunRepl(Lox::VirtualMachine& vm);
 
 int RunLoxFile(Lox::VirtualMachine& vm, const std::string& path);
@@ -40,48 +64,68 @@ void ErrorAndUsage(std::string_view msg);
 int main(int argc, const char* argv[])
 {
     Lox::VirtualMachineConfiguration conf(std::cout, std::cin, std::cout);
+    
+    ProfileOutput profile;
+    
+    int first = ParseDebugFlags(argc, argv, conf, profile);
+    if (first < 0)
+    {
+        ErrorAndUsage("unknown option");
+        return ErrorCodeUnknownCommand;
+    }
+    
     Lox::VirtualMachine vm(conf);
     Natives::AddNatives(vm);
     
-    if (argc < 2)
+    if (argc - first < 1)
     {
         ErrorAndUsage("not enough arguments");
         return ErrorCodeNotEnoughArguments;
     }
     
-    if (strcmp(argv[1], "repl") == 0)
+    int result = RunCommand(vm, argc, argv, first);
+    int profileResult = WriteProfile(vm, profile);
+    
+    return result != ErrorCodeOk ? result : profileResult;
+}
+
+int RunCommand(Lox::VirtualMachine& vm, int argc, const char* argv[], int first)
+{
+    const char* command = argv[first];
+    
+    if (strcmp(command, "repl") == 0)
     {
         return RunRepl(vm);
     }
-    else if (strcmp(argv[1], "run_file") == 0)
+    else if (strcmp(command, "run_file") == 0)
     {
-        if (argc < 3)
+        if (argc - first < 2)
         {
             ErrorAndUsage("not enough arguments");
             return ErrorCodeNoRunFile;
         }
         
-        return RunLoxFile(vm, argv[2]);
+        return RunLoxFile(vm, argv[first + 1]);
     }
-    else if (strcmp(argv[1], "run_bytecode") == 0)
+    else if (strcmp(command, "run_bytecode") == 0)
     {
-        if (argc < 3)
+        if (argc - first < 2)
         {
             ErrorAndUsage("not enough arguments");
             return ErrorCodeNoRunFile;
         }
         
-        return RunChunkFile(vm, argv[2]);
+        return RunChunkFile(vm, argv[first + 1]);
     }
-    else if (strcmp(argv[1], "compile") == 0)
+    else if (strcmp(command, "compile") == 0)
     {
-        if (argc < 4)
+        if (argc - first < 3)
         {
             ErrorAndUsage("not enough arguments");
             return ErrorCodeNoRunFile;
         }
         
-        return CompileFile(vm, argv[2], argv[3]);
+        return CompileFile(vm, argv[first + 1], argv[first + 2]);
     }
     else
     {
@@ -90,6 +134,181 @@ int main(int argc, const char* argv[])
     }
 }
 
+int ParseDebugFlags(int argc, const char* argv[], Lox::VirtualMachineConfiguration& conf, ProfileOutput& profile)
+{
+    int i = 1;
+    
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; ++i)
+    {
+        if (strcmp(argv[i], "--trace") == 0)
+        {
+            conf.SetTraceExecution(true);
+        }
+        else if (strcmp(argv[i], "--stress-gc") == 0)
+        {
+            conf.SetStressGC(true);
+        }
+        else if (strcmp(argv[i], "--incremental-gc") == 0 && i + 1 < argc)
+        {
+            int budget = std::atoi(argv[++i]);
+            if (budget <= 0)
+            {
+                return -1;
+            }
+            
+            conf.SetIncrementalGCBudget(budget);
+        }
+        else if (strcmp(argv[i], "--gc-threads") == 0 && i + 1 < argc)
+        {
+            int threads = std::atoi(argv[++i]);
+            if (threads <= 0)
+            {
+                return -1;
+            }
+            
+            conf.SetMarkingThreads(threads);
+        }
+        else if (strcmp(argv[i], "--background-sweep") == 0)
+        {
+            conf.SetBackgroundSweeping(true);
+        }
+        else if (strcmp(argv[i], "--log-gc") == 0)
+        {
+            conf.SetLogGC(true);
+        }
+        else if (strcmp(argv[i], "--dump") == 0)
+        {
+            conf.SetDumpChunkAfterCompile(true);
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            conf.SetProfileOpcodes(true);
+            profile.print = true;
+        }
+        else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc)
+        {
+            conf.SetProfileOpcodes(true);
+            profile.csvPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc)
+        {
+            conf.SetProfileOpcodes(true);
+            profile.jsonPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sample") == 0)
+        {
+            profile.printSamples = true;
+        }
+        else if (strcmp(argv[i], "--sample-folded") == 0 && i + 1 < argc)
+        {
+            profile.foldedPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sample-interval") == 0 && i + 1 < argc)
+        {
+            int interval = std::atoi(argv[++i]);
+            if (interval <= 0)
+            {
+                return -1;
+            }
+            
+            conf.SetSampleInterval(interval);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    
+    bool sample = profile.printSamples || !profile.foldedPath.empty();
+    if (sample && conf.GetSampleInterval() == 0)
+    {
+        conf.SetSampleInterval(Lox::SamplingProfiler::DefaultInterval);
+    }
+    
+    return i;
+}
+
+int WriteProfile(const Lox::VirtualMachine& vm, const ProfileOutput& profile)
+{
+    int samplesResult = WriteSamples(vm, profile);
+    
+    const std::optional<Lox::OpcodeProfiler>& profiler = vm.GetOpcodeProfiler();
+    if (!profiler)
+    {
+        return samplesResult;
+    }
+    
+    if (profile.print)
+    {
+        profiler->PrintReport(vm.GetConfiguration().GetDebugOutput());
+    }
+    
+    if (!profile.csvPath.empty())
+    {
+        int result = WriteProfileFile(profile.csvPath, [&profiler](std::ostream& out)
+        {
+            profiler->WriteCsv(out);
+        });
+        
+        if (result != ErrorCodeOk)
+        {
+            return result;
+        }
+    }
+    
+    if (!profile.jsonPath.empty())
+    {
+        int result = WriteProfileFile(profile.jsonPath, [&profiler](std::ostream& out)
+        {
+            profiler->WriteJson(out);
+        });
+        
+        if (result != ErrorCodeOk)
+        {
+            return result;
+        }
+    }
+    
+    return samplesResult;
+}
+
+int WriteSamples(const Lox::VirtualMachine& vm, const ProfileOutput& profile)
+{
+    const std::optional<Lox::SamplingProfiler>& sampler = vm.GetSamplingProfiler();
+    if (!sampler)
+    {
+        return ErrorCodeOk;
+    }
+    
+    if (profile.printSamples)
+    {
+        sampler->PrintReport(vm.GetConfiguration().GetDebugOutput());
+    }
+    
+    if (!profile.foldedPath.empty())
+    {
+        return WriteProfileFile(profile.foldedPath, [&sampler](std::ostream& out)
+        {
+            sampler->WriteFolded(out);
+        });
+    }
+    
+    return ErrorCodeOk;
+}
+
+int WriteProfileFile(const std::string& path, const std::function<void(std::ostream&)>& write)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "Error: could not write to file '" << path << "'" << std::endl;
+        return ErrorCodeWriteProfileError;
+    }
+    
+    write(file);
+    return ErrorCodeOk;
+}
+
 int RunRepl(Lox::VirtualMachine& vm)
 {
     std::cout << "Lox language bytecode interpreter written in C++." << std::endl;
@@ -235,6 +454,9 @@ void OptimizeFunc(Lox::VirtualMachine& vm, Lox::GcPtr<Lox::Closure> func)
     Lox::ChunkOptimizer optimizer(vm, func->GetChunk());
     optimizer.Optimize();
     
+    Lox::ChunkFuser fuser(func->GetChunk());
+    fuser.Fuse();
+    
     /*
     Lox::ChunkDumper dumper(func->GetChunk(), func->GetName()->GetCppString(),
                             std::cout);
@@ -360,8 +582,22 @@ int CatchLoxErrors(const std::function<void()>& fn)
 
 void PrintUsage()
 {
-    std::cerr << "Usage: lox command [file]" << std::endl;
+    std::cerr << "Usage: lox [options] command [file]" << std::endl;
     std::cerr << "Where:" << std::endl;
+    std::cerr << "  options - any of:" << std::endl;
+    std::cerr << "    --trace - print every executed instruction and the stack" << std::endl;
+    std::cerr << "    --stress-gc - collect garbage on every allocation" << std::endl;
+    std::cerr << "    --incremental-gc N - collect the whole heap in steps of N objects, not in one pause" << std::endl;
+    std::cerr << "    --gc-threads N - mark the whole heap with N threads" << std::endl;
+    std::cerr << "    --background-sweep - sweep the old objects on a thread, while the script runs" << std::endl;
+    std::cerr << "    --log-gc - print the garbage collector actions" << std::endl;
+    std::cerr << "    --dump - print the bytecode of every compiled function" << std::endl;
+    std::cerr << "    --profile - print the counts of the executed opcodes and opcode pairs at exit" << std::endl;
+    std::cerr << "    --profile-csv path - write the opcodes profile as CSV at exit" << std::endl;
+    std::cerr << "    --profile-json path - write the opcodes profile as JSON at exit" << std::endl;
+    std::cerr << "    --sample - print the hottest functions and lines of the stack samples at exit" << std::endl;
+    std::cerr << "    --sample-folded path - write the stack samples as folded stacks (for flame graphs) at exit" << std::endl;
+    std::cerr << "    --sample-interval N - sample the stack every N instructions (default: 1000)" << std::endl;
     std::cerr << "  command - one of { repl, run_file, run_bytecode, compile }" << std::endl;
     std::cerr << "  file - path to file" << std::endl;
     std::cerr << "When: command = compile:" << std::endl;
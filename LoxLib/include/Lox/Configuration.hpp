@@ -8,12 +8,34 @@ namespace Lox::Configuration
     constexpr std::size_t FramesCount = 64;
     constexpr std::size_t StackSize = FramesCount * 256;
     
+    /// The longest chain of shapes. An instance keeps other fields in a dictionary.
+    constexpr std::size_t MaxShapeSlots = 64;
+    
+    /// Pack every `Value` into 64 bits using NaN boxing. It relies on pointers that fit in
+    /// 48 bits, so it is turned on only for 64-bit targets.
+    constexpr bool NanBoxing = sizeof(void*) == 8;
+    
+    /// Shorter concatenations are copied, longer ones share a builder buffer, see `String`.
+    constexpr std::size_t MinBuilderStringLength = 64;
+    
     constexpr bool DebugMode = true;
-    constexpr bool DumpChunkAfterCompile = true;
-    constexpr bool TraceExecution = true;
     
-    constexpr bool StressGC = true;
-    constexpr bool LogGC = true;
+    // Tracing, GC logging and stress GC are chosen at runtime, see `VirtualMachineConfiguration`.
+    
+    /// The first major collection happens when the heap reaches this size.
+    constexpr std::size_t InitialNextGC = 1024 * 1024;
+    /// After a major collection, the next one happens when the live heap grows by this factor.
+    constexpr std::size_t HeapGrowFactor = 2;
+    /// A minor collection happens when the young generation reaches this size.
+    constexpr std::size_t YoungGenerationSize = 256 * 1024;
+    /// An incremental major collection makes a step every time this many bytes are allocated.
+    constexpr std::size_t IncrementalStepBytes = 64 * 1024;
+    /// After a major collection every allocation sweeps this many old objects.
+    constexpr std::size_t LazySweepObjects = 32;
+    
+    /// The stress GC collects the young generation on every allocation and the whole
+    /// heap on every `StressMajorGCInterval`-th one.
+    constexpr std::size_t StressMajorGCInterval = 16;
 }
 
 #endif // LOX_VM_CONFIGURATION_HPP
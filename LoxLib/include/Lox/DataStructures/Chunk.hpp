@@ -3,11 +3,13 @@
 
 #include <cstdint>
 #include <istream>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include "LinesArray.hpp"
+#include "InlineCache.hpp"
 
 #include "Lox/Runtime/Value.hpp"
 
@@ -27,6 +29,10 @@ namespace Lox
         uint8_t GetCode(std::size_t index) const;
         uint8_t& GetCode(std::size_t index);
 
+        /// Replace the opcode with one of the same operands and stack effect (quickening),
+        /// unlike the other changes it keeps the maximal stack size.
+        void QuickenCode(std::size_t index, uint8_t opcode);
+
         Value GetConstant(std::size_t index) const;
 
         std::size_t GetCodeLine(CodeIterator at) const;
@@ -53,12 +59,36 @@ namespace Lox
         void InsertCode(CodeIterator at, uint8_t byte, std::size_t line);
         void InsertCode(std::size_t index, uint8_t byte, std::size_t line);
         
+        /// Run-length encoded lines, for serialization.
+        const LinesArray& GetCodeLines() const;
+        const LinesArray& GetConstantsLines() const;
+        
+        /// Inline caches are indexed by the constant index of the property name
+        /// (every property access has its own name constant).
+        /// They are created lazily and are not serialized.
+        InlineCache& GetInlineCache(std::size_t constantIndex);
+        
+        std::vector<InlineCache>& GetInlineCaches();
+        
+        /// Bytes of the memory of the code, the constants, the lines and the caches.
+        std::size_t GetPayloadSize() const;
+        
+        /// The maximal height of the stack above the frame arguments. It is computed
+        /// by `ChunkChecker` before the first call and reset on every change of the code.
+        std::optional<std::size_t> GetMaxStackSize() const;
+        
+        void SetMaxStackSize(std::size_t size);
+        
     private:
         std::vector<uint8_t> code;
         LinesArray codeLines;
 
         std::vector<Value> constants;
         LinesArray constantsLines;
+        
+        std::vector<InlineCache> inlineCaches;
+        
+        std::optional<std::size_t> maxStackSize;
     }; // class Chunk
 }
 
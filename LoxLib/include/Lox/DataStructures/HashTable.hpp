@@ -0,0 +1,267 @@
+#ifndef LOX_VM_DATA_STRUCTURES_HASH_TABLE_HPP
+#define LOX_VM_DATA_STRUCTURES_HASH_TABLE_HPP
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Lox/Runtime/GcPtr.hpp"
+#include "Lox/Runtime/Objects/String.hpp"
+
+namespace Lox
+{
+    /// Open addressing hash table with linear probing, the keys are interned strings.
+    ///
+    /// Keys are compared by pointer and the hash of the key is stored in the entry, so
+    /// the probing reads only the entries array. `FindString` (the interning) compares
+    /// the hashes before the characters. Erased entries become tombstones, they are
+    /// reused by the insertions and dropped when the table is rehashed.
+    ///
+    /// A set is `HashTable<std::monostate>`.
+    template <typename T>
+    class HashTable
+    {
+    public:
+        struct Entry
+        {
+            GcPtr<String> key;
+            std::size_t hash = 0;
+            [[no_unique_address]] T value{};
+        }; // struct Entry
+        
+        HashTable()
+                : size(0), used(0)
+        {
+        
+        }
+        
+        /// Return nullptr if there is no such key.
+        T* Find(GcPtr<String> key)
+        {
+            if (size == 0)
+            {
+                return nullptr;
+            }
+            
+            Entry& entry = FindEntry(key);
+            return entry.key.IsNullptr() ? nullptr : &entry.value;
+        }
+        
+        const T* Find(GcPtr<String> key) const
+        {
+            return const_cast<HashTable*>(this)->Find(key);
+        }
+        
+        /// Lookup by the contents, `hash` is `String::ComputeHash(str)`.
+        GcPtr<String> FindString(std::string_view str, std::size_t hash) const
+        {
+            if (size == 0)
+            {
+                return GcPtr<String>();
+            }
+            
+            std::size_t mask = entries.size() - 1;
+            
+            for (std::size_t i = hash & mask; ; i = (i + 1) & mask)
+            {
+                const Entry& entry = entries[i];
+                
+                if (entry.key.IsNullptr())
+                {
+                    if (entry.hash != TombstoneHash)
+                    {
+                        return GcPtr<String>();
+                    }
+                }
+                else if (entry.hash == hash && entry.key->GetView() == str)
+                {
+                    return entry.key;
+                }
+            }
+        }
+        
+        /// Return true if the key is new, otherwise the value is replaced.
+        bool Insert(GcPtr<String> key, T value)
+        {
+            if ((used + 1) * MaxLoadDenominator > entries.size() * MaxLoadNumerator)
+            {
+                Grow();
+            }
+            
+            Entry& entry = FindEntry(key);
+            bool isNew = entry.key.IsNullptr();
+            
+            if (isNew)
+            {
+                size++;
+                
+                // Tombstones are already counted.
+                if (entry.hash != TombstoneHash)
+                {
+                    used++;
+                }
+                
+                entry.key = key;
+                entry.hash = key->GetHash();
+            }
+            
+            entry.value = std::move(value);
+            return isNew;
+        }
+        
+        /// Insert the entries of `other`, the existing keys keep their values.
+        void InsertAll(const HashTable& other)
+        {
+            for (const Entry& entry: other.entries)
+            {
+                if (!entry.key.IsNullptr() && !Find(entry.key))
+                {
+                    Insert(entry.key, entry.value);
+                }
+            }
+        }
+        
+        bool Erase(GcPtr<String> key)
+        {
+            if (size == 0)
+            {
+                return false;
+            }
+            
+            Entry& entry = FindEntry(key);
+            if (entry.key.IsNullptr())
+            {
+                return false;
+            }
+            
+            MakeTombstone(entry);
+            return true;
+        }
+        
+        /// Erase every entry for which `pred(key, value)` is true.
+        template <typename Predicate>
+        void EraseIf(Predicate pred)
+        {
+            for (Entry& entry: entries)
+            {
+                if (!entry.key.IsNullptr() && pred(entry.key, entry.value))
+                {
+                    MakeTombstone(entry);
+                }
+            }
+        }
+        
+        /// Call `fn(key, value)` for every entry.
+        template <typename Fn>
+        void ForEach(Fn fn)
+        {
+            for (Entry& entry: entries)
+            {
+                if (!entry.key.IsNullptr())
+                {
+                    fn(entry.key, entry.value);
+                }
+            }
+        }
+        
+        std::size_t GetSize() const
+        {
+            return size;
+        }
+        
+        std::size_t GetCapacity() const
+        {
+            return entries.size();
+        }
+    
+    private:
+        static constexpr std::size_t MinCapacity = 8;
+        
+        // The table grows when it is 3/4 full, tombstones included.
+        static constexpr std::size_t MaxLoadNumerator = 3;
+        static constexpr std::size_t MaxLoadDenominator = 4;
+        
+        /// The hash of an entry with no key, that is a tombstone. Empty entries have zero.
+        static constexpr std::size_t TombstoneHash = 1;
+        
+        std::vector<Entry> entries;
+        
+        /// Count of the keys.
+        std::size_t size;
+        
+        /// Count of the keys and tombstones. There is always an empty entry, so probing stops.
+        std::size_t used;
+        
+        /// Return the entry with the key, or the entry where the key should be inserted.
+        Entry& FindEntry(GcPtr<String> key)
+        {
+            std::size_t mask = entries.size() - 1;
+            Entry* tombstone = nullptr;
+            
+            for (std::size_t i = key->GetHash() & mask; ; i = (i + 1) & mask)
+            {
+                Entry& entry = entries[i];
+                
+                if (entry.key.IsNullptr())
+                {
+                    if (entry.hash != TombstoneHash)
+                    {
+                        return tombstone ? *tombstone : entry;
+                    }
+                    
+                    if (!tombstone)
+                    {
+                        tombstone = &entry;
+                    }
+                }
+                else if (entry.key == key)
+                {
+                    return entry;
+                }
+            }
+        }
+        
+        void MakeTombstone(Entry& entry)
+        {
+            entry.key = GcPtr<String>();
+            entry.hash = TombstoneHash;
+            entry.value = T{};
+            size--;
+        }
+        
+        void Grow()
+        {
+            // When the most of the used entries are tombstones, the same capacity is enough.
+            std::size_t capacity = entries.size();
+            if (capacity < MinCapacity)
+            {
+                capacity = MinCapacity;
+            }
+            else if (size * 2 >= used)
+            {
+                capacity *= 2;
+            }
+            
+            std::vector<Entry> oldEntries(capacity);
+            oldEntries.swap(entries);
+            
+            size = 0;
+            used = 0;
+            
+            for (Entry& entry: oldEntries)
+            {
+                if (!entry.key.IsNullptr())
+                {
+                    Entry& newEntry = FindEntry(entry.key);
+                    newEntry = std::move(entry);
+                    size++;
+                    used++;
+                }
+            }
+        }
+    }; // class HashTable
+}
+
+#endif // LOX_VM_DATA_STRUCTURES_HASH_TABLE_HPP
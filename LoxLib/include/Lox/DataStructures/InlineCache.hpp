@@ -0,0 +1,99 @@
+#ifndef LOX_VM_DATA_STRUCTURES_INLINE_CACHE_HPP
+#define LOX_VM_DATA_STRUCTURES_INLINE_CACHE_HPP
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <optional>
+
+#include "Lox/Runtime/GcPtr.hpp"
+
+namespace Lox
+{
+    class Class;
+    class Closure;
+    class Shape;
+    class MemoryManager;
+    
+    /// Cache of method and field lookups for one instruction (`GetProperty`, `Invoke`, ...).
+    ///
+    /// The first entry makes the cache monomorphic, then it becomes polymorphic up to
+    /// `EntriesCount` classes (or shapes). A method entry is valid while the class version
+    /// is the same, so `Class::AddMethod` and `Class::Inherit` invalidate it. Shapes never
+    /// change, so field entries are always valid.
+    class InlineCache
+    {
+    public:
+        static constexpr std::size_t EntriesCount = 4;
+        
+        /// The field is not in the shape, so the lookup goes to the methods.
+        static constexpr std::size_t MissingSlot = std::numeric_limits<std::size_t>::max();
+        
+        /// Where the field is for the instances of one shape. For a store of a new
+        /// field `transition` is the shape of the instance after the store.
+        struct FieldEntry
+        {
+            GcPtr<Shape> shape;
+            GcPtr<Shape> transition;
+            std::size_t slot = 0;
+        };
+        
+        /// Return nullptr on a miss.
+        GcPtr<Closure> Lookup(GcPtr<Class> klass) const;
+        
+        void Update(GcPtr<Class> klass, GcPtr<Closure> method);
+        
+        /// Return nullptr on a miss.
+        const FieldEntry* LookupField(GcPtr<Shape> shape) const;
+        
+        void UpdateField(GcPtr<Shape> shape, std::size_t slot, GcPtr<Shape> transition = GcPtr<Shape>());
+        
+        /// The slot of a field load from the instances of the shape, std::nullopt if it is
+        /// not cached or the field is not in the shape. Inline, it is the guard of
+        /// `Opcode::GetPropertyField`.
+        std::optional<std::size_t> LookupFieldSlot(GcPtr<Shape> shape) const
+        {
+            for (std::size_t i = 0; i < fieldCount; ++i)
+            {
+                const FieldEntry& entry = fieldEntries[i];
+                
+                if (entry.shape == shape)
+                {
+                    if (!entry.transition.IsNullptr() || entry.slot == MissingSlot)
+                    {
+                        return std::nullopt;
+                    }
+                    
+                    return entry.slot;
+                }
+            }
+            
+            return std::nullopt;
+        }
+        
+        std::size_t GetEntriesCount() const;
+        
+        std::size_t GetFieldEntriesCount() const;
+        
+        /// Entries are strong references.
+        void Mark(MemoryManager& memory);
+    
+    private:
+        struct Entry
+        {
+            GcPtr<Class> klass;
+            std::size_t version = 0;
+            GcPtr<Closure> method;
+        };
+        
+        std::array<Entry, EntriesCount> entries;
+        std::size_t count = 0;
+        std::size_t nextReplaced = 0;
+        
+        std::array<FieldEntry, EntriesCount> fieldEntries;
+        std::size_t fieldCount = 0;
+        std::size_t nextFieldReplaced = 0;
+    }; // class InlineCache
+}
+
+#endif // LOX_VM_DATA_STRUCTURES_INLINE_CACHE_HPP
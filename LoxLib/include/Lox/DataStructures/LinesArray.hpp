@@ -6,23 +6,49 @@
 
 namespace Lox
 {
+    /// Line of every element of a chunk, run-length encoded: consecutive
+    /// bytes of the code mostly come from the same line.
     class LinesArray
     {
     public:
+        /// Elements from `begin` up to the beginning of the next run have the same line.
+        struct Run
+        {
+            std::size_t begin;
+            std::size_t line;
+        }; // struct Run
+        
         LinesArray() = default;
 
         std::size_t PushLine(std::size_t line);
+        
+        /// Push `count` elements with the same line.
+        void PushLines(std::size_t line, std::size_t count);
 
+        /// Binary search of the run, O(log runs).
         std::size_t operator[](std::size_t index) const;
 
         void Erase(std::size_t index);
+        void Erase(std::size_t begin, std::size_t end);
 
         void Insert(std::size_t index, std::size_t line);
-        void Insert(std::size_t begin, std::size_t end, std::size_t line);
+        
+        std::size_t GetSize() const;
+        
+        const std::vector<Run>& GetRuns() const;
+        
+        std::size_t GetRunLength(std::size_t runIndex) const;
 
     private:
-        std::vector<std::size_t> array;
-    }; // class LinesArra
+        std::vector<Run> runs;
+        std::size_t size = 0;
+        
+        std::vector<Run>::iterator FindRun(std::size_t index);
+        std::vector<Run>::const_iterator FindRun(std::size_t index) const;
+        
+        /// Move the runs after `it` by `delta` elements.
+        void ShiftRuns(std::vector<Run>::iterator it, std::ptrdiff_t delta);
+    }; // class LinesArray
 }
 
 #endif // LOX_VM_DATA_STRUCTURES_LINES_ARRAY_HPP
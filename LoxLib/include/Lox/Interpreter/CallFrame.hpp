@@ -32,6 +32,8 @@ namespace Lox
         
         Chunk::CodeIterator GetIP() const;
         
+        void SetIP(Chunk::CodeIterator newIP);
+        
         uint8_t ReadByte();
         
         uint16_t ReadShort();
@@ -2,7 +2,9 @@
 #define LOX_VM_INTERPRETER_OPCODE_HPP
 
 #include <ostream>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 
 #include "OpcodeType.hpp"
 
@@ -38,16 +40,64 @@
     o(SetUpvalue, Byte, 0)                          \
     o(FillUpvalues, Closure, 0)                     \
     o(CloseUpvalue, Simple, -1)                     \
-    o(Class, Constant, 0)                           \
-    o(GetProperty, Constant, 1)                     \
+    o(Class, Constant, +1)                          \
+    o(GetProperty, Constant, 0)                     \
     o(SetProperty, Constant, -1)                    \
     o(Method, Constant, -1)                         \
     o(Invoke, Invoke, 0)                            \
     o(Inherit, Simple, -1)                          \
     o(GetSuper, Constant, -1)                       \
-    o(InvokeSuper, Invoke, 0)
+    o(InvokeSuper, Invoke, -1)                      \
+    o(DefineGlobalSlot, Short, -1)                  \
+    o(GetGlobalSlot, Short, 1)                      \
+    o(SetGlobalSlot, Short, 0)                      \
+    o(GetLocalProperty, Byte, +1)                   \
+    o(GetLocalLocal, Byte, +1)                      \
+    o(AddConstant, Constant, +1)                    \
+    o(LessConstant, Constant, +1)                   \
+    o(JumpIfFalsePop, Jump, 0)                      \
+    o(SetLocalPop, Byte, 0)                         \
+    o(SetGlobalSlotPop, Short, 0)                   \
+    o(LessJumpIfFalse, Simple, -1)                  \
+    o(EqualJumpIfFalse, Simple, -1)                 \
+    o(AddDouble, Simple, -1)                        \
+    o(SubstractDouble, Simple, -1)                  \
+    o(MultiplyDouble, Simple, -1)                   \
+    o(GreaterDouble, Simple, -1)                    \
+    o(LessDouble, Simple, -1)                       \
+    o(GetPropertyField, Constant, 0)                \
+    o(CallClosure, Byte, 0)
 
-// Well, the stack effect of OpcodeCall is not that simple.
+// Well, the stack effect of OpcodeCall is not that simple: `Call`, `Invoke` and `InvokeSuper`
+// also pop their arguments, the count is in the first operand (see `GetOpcodeStackEffect`).
+
+// Superinstructions and the instructions fused in them (see `ChunkFuser`). A superinstruction
+// replaces only the opcode of its first instruction, the others stay in the code after it.
+// So it has the operands, the type and the stack effect of the first instruction, and the code
+// can be decoded as if it was not fused. The first matching sequence is fused, longer go first.
+#define LOX_SUPERINSTRUCTIONS_LIST(o)                                           \
+    o(LessJumpIfFalse, OpcodeLess, OpcodeJumpIfFalse, OpcodePop)                \
+    o(EqualJumpIfFalse, OpcodeEqual, OpcodeJumpIfFalse, OpcodePop)              \
+    o(GetLocalProperty, OpcodeGetLocal, OpcodeGetProperty)                      \
+    o(GetLocalLocal, OpcodeGetLocal, OpcodeGetLocal)                            \
+    o(AddConstant, OpcodePushConstant, OpcodeAdd)                               \
+    o(LessConstant, OpcodePushConstant, OpcodeLess)                             \
+    o(JumpIfFalsePop, OpcodeJumpIfFalse, OpcodePop)                             \
+    o(SetLocalPop, OpcodeSetLocal, OpcodePop)                                   \
+    o(SetGlobalSlotPop, OpcodeSetGlobalSlot, OpcodePop)
+
+// Quickened instructions and their generic versions. The VM rewrites a generic instruction
+// in place to its quickened version, when the operands fit it, and back, when they do not
+// (see `VirtualMachine::Run`). A quickened instruction has the operands, the type and the
+// stack effect of the generic one.
+#define LOX_QUICKENED_OPCODES_LIST(o)                                           \
+    o(AddDouble, OpcodeAdd)                                                     \
+    o(SubstractDouble, OpcodeSubstract)                                         \
+    o(MultiplyDouble, OpcodeMultiply)                                           \
+    o(GreaterDouble, OpcodeGreater)                                             \
+    o(LessDouble, OpcodeLess)                                                   \
+    o(GetPropertyField, OpcodeGetProperty)                                      \
+    o(CallClosure, OpcodeCall)
 
 namespace Lox
 {
@@ -60,6 +110,12 @@ namespace Lox
         #undef LOX_OPCODES_ENUM
     }; // enum class Opcode
     
+    #define LOX_OPCODES_COUNT(name, _, __) + 1
+    
+    constexpr std::size_t OpcodesCount = 0 LOX_OPCODES_LIST(LOX_OPCODES_COUNT);
+    
+    #undef LOX_OPCODES_COUNT
+    
     std::ostream& operator<<(std::ostream& out, Opcode opcode);
     
     OpcodeType GetOpcodeType(Opcode opcode);
@@ -71,6 +127,19 @@ namespace Lox
     Value LiteralOpcodeToValue(Opcode opcode);
     
     int GetOpcodeStackEffect(Opcode opcode);
+    
+    /// The stack effect together with the popped arguments of calls.
+    int GetOpcodeStackEffect(Opcode opcode, uint8_t argCount);
+    
+    /// Count of the values the instruction reads from the top of the stack.
+    std::size_t GetOpcodeStackInputs(Opcode opcode, uint8_t argCount);
+    
+    /// The fused instructions of a superinstruction, empty for the other opcodes.
+    std::span<const Opcode> GetFusedOpcodes(Opcode opcode);
+    
+    /// The generic version of a quickened instruction, the first fused instruction of
+    /// a superinstruction, the opcode itself for the others.
+    Opcode GetBaseOpcode(Opcode opcode);
 }
 
 #endif // LOX_VM_INTERPRETER_OPCODE_HPP
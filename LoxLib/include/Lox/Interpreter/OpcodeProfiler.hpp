@@ -0,0 +1,113 @@
+#ifndef LOX_VM_INTERPRETER_OPCODE_PROFILER_HPP
+#define LOX_VM_INTERPRETER_OPCODE_PROFILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "Opcode.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define LOX_PROFILER_RDTSC 1
+#else
+    #include <chrono>
+    #define LOX_PROFILER_RDTSC 0
+#endif
+
+namespace Lox
+{
+    /// Counts of the executed opcodes and of the pairs of consecutive opcodes, and the time
+    /// spent in every opcode. It is fed by the profiling `VirtualMachine::Run` loop, see
+    /// `VirtualMachineConfiguration::SetProfileOpcodes`.
+    ///
+    /// The time of an instruction is the time until the next dispatch, so it includes the
+    /// called slow paths, the collections and the `Record` itself. The ticks are the TSC
+    /// cycles on x86, otherwise nanoseconds. The opcodes are the dispatched ones: a superinstruction is counted once,
+    /// and a quickened instruction is counted as itself, not as its generic version.
+    class OpcodeProfiler
+    {
+    public:
+        OpcodeProfiler();
+        
+        /// Called before the dispatch of every instruction.
+        void Record(Opcode opcode)
+        {
+            std::uint64_t now = ReadTicks();
+            
+            if (hasPrevious)
+            {
+                ticks[previous] += now - previousTicks;
+                pairs[previous * OpcodesCount + opcode]++;
+            }
+            
+            counts[opcode]++;
+            
+            hasPrevious = true;
+            previous = opcode;
+            previousTicks = now;
+        }
+        
+        /// `Run` has finished, the last instruction ends here. The next run does not continue
+        /// its pairs.
+        void Stop();
+        
+        std::uint64_t GetCount(Opcode opcode) const;
+        
+        std::uint64_t GetPairCount(Opcode first, Opcode second) const;
+        
+        std::uint64_t GetTicks(Opcode opcode) const;
+        
+        std::uint64_t GetTotalCount() const;
+        
+        /// "rdtsc" or "steady_clock", the unit of the ticks.
+        static std::string_view GetClockName();
+        
+        /// Human-readable tables: the opcodes by time, and the `topPairs` most frequent pairs.
+        void PrintReport(std::ostream& out, std::size_t topPairs = 20) const;
+        
+        /// Rows `opcode,<name>,,<count>,<ticks>` and `pair,<first>,<second>,<count>,`,
+        /// only the executed ones.
+        void WriteCsv(std::ostream& out) const;
+        
+        void WriteJson(std::ostream& out) const;
+    
+    private:
+        std::vector<std::uint64_t> counts;
+        std::vector<std::uint64_t> ticks;
+        
+        /// `OpcodesCount` x `OpcodesCount`, the first opcode is the row.
+        std::vector<std::uint64_t> pairs;
+        
+        bool hasPrevious;
+        Opcode previous;
+        std::uint64_t previousTicks;
+        
+        static std::uint64_t ReadTicks()
+        {
+            #if LOX_PROFILER_RDTSC
+                return __rdtsc();
+            #else
+                auto now = std::chrono::steady_clock::now().time_since_epoch();
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+            #endif
+        }
+        
+        struct Pair
+        {
+            Opcode first;
+            Opcode second;
+            std::uint64_t count;
+        }; // struct Pair
+        
+        /// The executed opcodes, sorted by time.
+        std::vector<Opcode> GetSortedOpcodes() const;
+        
+        /// The executed pairs, sorted by count.
+        std::vector<Pair> GetSortedPairs() const;
+    }; // class OpcodeProfiler
+}
+
+#endif // LOX_VM_INTERPRETER_OPCODE_PROFILER_HPP
@@ -8,7 +8,8 @@
     o(Jump)                      \
     o(Loop)                      \
     o(Closure)                   \
-    o(Invoke)
+    o(Invoke)                    \
+    o(Short)
 
 namespace Lox
 {
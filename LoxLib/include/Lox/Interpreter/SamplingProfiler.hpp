@@ -0,0 +1,87 @@
+#ifndef LOX_VM_INTERPRETER_SAMPLING_PROFILER_HPP
+#define LOX_VM_INTERPRETER_SAMPLING_PROFILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "CallFrame.hpp"
+
+namespace Lox
+{
+    /// Samples of the call stack, taken every `interval` instructions by the profiling
+    /// `VirtualMachine::Run` loop, see `VirtualMachineConfiguration::SetSampleInterval`.
+    ///
+    /// A frame of a sample is the function name and the line executed in it: the current
+    /// instruction of the innermost frame, the call of the outer ones. The samples are
+    /// aggregated by the whole stack (the folded stacks of the flame graph tools), and by
+    /// the function and the line of the innermost frame.
+    ///
+    /// The trigger is the count of instructions, not a timer: the stack is consistent only
+    /// between instructions, and the samples do not depend on the machine. So the time
+    /// spent in natives and in the collector is not seen.
+    class SamplingProfiler
+    {
+    public:
+        static constexpr std::size_t DefaultInterval = 1000;
+        
+        explicit SamplingProfiler(std::size_t interval);
+        
+        /// Called before the dispatch of every instruction, return true when the stack
+        /// should be sampled.
+        bool Tick()
+        {
+            if (--countdown != 0)
+            {
+                return false;
+            }
+            
+            countdown = interval;
+            return true;
+        }
+        
+        /// `frames` are from the outermost to the innermost, the IP of the innermost frame
+        /// is at the instruction to be executed.
+        void Sample(const CallFrame* frames, std::size_t count);
+        
+        std::size_t GetInterval() const;
+        
+        std::uint64_t GetSamplesCount() const;
+        
+        /// Count of the samples with the folded stack, like "<script>:12;fib:3".
+        std::uint64_t GetStackCount(const std::string& stack) const;
+        
+        /// Count of the samples, which are in the function.
+        std::uint64_t GetFunctionTotalCount(const std::string& function) const;
+        
+        /// Count of the samples, which are in the function itself, not in its callees.
+        std::uint64_t GetFunctionSelfCount(const std::string& function) const;
+        
+        /// Human-readable tables: the `top` functions by the total samples, and the `top`
+        /// lines by the self samples.
+        void PrintReport(std::ostream& out, std::size_t top = 20) const;
+        
+        /// A line `<frame>;<frame>... <count>` for every stack, the input of `flamegraph.pl`
+        /// and the similar tools.
+        void WriteFolded(std::ostream& out) const;
+    
+    private:
+        std::size_t interval;
+        std::size_t countdown;
+        
+        std::uint64_t samples;
+        
+        /// Keys are "<function>:<line>" frames joined by ';'.
+        std::map<std::string, std::uint64_t> stacks;
+        
+        std::map<std::string, std::uint64_t> functionsTotal;
+        std::map<std::string, std::uint64_t> functionsSelf;
+        
+        /// Keys are "<function>:<line>".
+        std::map<std::string, std::uint64_t> linesSelf;
+    }; // class SamplingProfiler
+}
+
+#endif // LOX_VM_INTERPRETER_SAMPLING_PROFILER_HPP
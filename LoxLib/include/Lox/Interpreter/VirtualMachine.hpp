@@ -2,12 +2,17 @@
 #define LOX_VM_INTERPRETER_VIRTUAL_MACHINE_HPP
 
 #include <array>
-#include <unordered_map>
+#include <cstdint>
+#include <optional>
+#include <variant>
+#include <vector>
 
 #include "Lox/Configuration.hpp"
 
 #include "VirtualMachineConfiguration.hpp"
 #include "CallFrame.hpp"
+#include "OpcodeProfiler.hpp"
+#include "SamplingProfiler.hpp"
 
 #include "Lox/Runtime/Value.hpp"
 #include "Lox/Runtime/MemoryManager.hpp"
@@ -17,10 +22,13 @@
 #include "Lox/Runtime/Objects/Closure.hpp"
 #include "Lox/Runtime/Objects/Class.hpp"
 #include "Lox/Runtime/Objects/BoundMethod.hpp"
+#include "Lox/Runtime/Objects/Shape.hpp"
 
 #include "Lox/Compiler/SourcePosition.hpp"
 
 #include "Lox/DataStructures/Chunk.hpp"
+#include "Lox/DataStructures/HashTable.hpp"
+#include "Lox/DataStructures/InlineCache.hpp"
 
 #include "Exceptions/RuntimeException.hpp"
 
@@ -40,12 +48,36 @@ namespace Lox
             return memory.AllocateObject<T>(std::forward<Args&&>(args)...);
         }
         
+        /// Call it after the payload of `obj` has changed, see `MemoryManager::AccountPayload`.
+        void AccountPayload(GcPtr<Object> obj);
+        
+        const MemoryManager& GetMemoryManager() const;
+        
+        const VirtualMachineConfiguration& GetConfiguration() const;
+        
+        /// Count of the instructions executed by all the scripts, for the benchmarks.
+        std::uint64_t GetExecutedInstructionsCount() const;
+        
+        /// The profile of all the scripts, empty unless `VirtualMachineConfiguration::GetProfileOpcodes`.
+        const std::optional<OpcodeProfiler>& GetOpcodeProfiler() const;
+        
+        /// The stack samples of all the scripts, empty unless `VirtualMachineConfiguration::GetSampleInterval`.
+        const std::optional<SamplingProfiler>& GetSamplingProfiler() const;
+        
         GcPtr<String> InternString(std::string_view str);
         
         GcPtr<String> InternStringTake(std::string&& str);
         
+        /// Return the interned string with the same contents. If there is none, `str`
+        /// itself is added to the intern table.
+        GcPtr<String> InternString(GcPtr<String> str);
+        
         void DefineNative(std::string_view name, std::size_t arity, NativeFn&& fn);
         
+        /// Return the index of the global in the globals array, the slot is created
+        /// (with an undefined value) on the first call with this name.
+        std::size_t GetGlobalSlot(GcPtr<String> name);
+        
         // This method is public in order to allow natives to throw a runtime error.
         template <typename T, typename... Args>
         void ThrowRuntimeException(Args&& ... args)
@@ -70,39 +102,47 @@ namespace Lox
         
         void MarkRoots() override;
         
-        std::unordered_map<std::string_view, GcPtr<String>> strings;
+        void SweepWeakReferences() override;
+        
+        /// The intern table is weak: it does not keep the strings alive, the dead ones
+        /// are removed by `SweepWeakReferences`.
+        HashTable<std::monostate> strings;
         
         GcPtr<String> initStr;
         
-        // Core.
+        /// The root of the shapes transition tree, every instance starts with it.
+        GcPtr<Shape> emptyShape;
         
-        bool running;
+        // Core.
         
+        /// The interpreter loop. Instructions are dispatched directly from `Run`
+        /// (see `LOX_OPCODES_LIST`), only slow paths are separate methods.
+        /// The `Verified` loop skips the checks, that `ChunkChecker::Check` has already done.
+        /// The `Debug` loop traces the execution, the production loops have no tracing code at all.
+        /// The `Profile` loop records every instruction in the `profiler`, and samples the
+        /// stack in the `sampler`. Either of them may be empty.
+        template <bool Verified, bool Debug, bool Profile>
         void Run();
         
-        std::unordered_map<GcPtr<String>, Value> globals;
-        
-        GcPtr<Upvalue> openUpvalues;
-        
-        // Opcodes.
+        /// Whether every script has passed `ChunkChecker::Check`. Functions of the earlier
+        /// scripts can be called from the later ones, so it never becomes true again.
+        bool verifiedOnly;
         
-        using OpcodeExecFn = void (VirtualMachine::*)();
-        std::array<OpcodeExecFn, UINT8_MAX> opcodesExecTable;
+        std::uint64_t executedInstructions;
         
-        void ExecuteOpcode(uint8_t opcode);
+        std::optional<OpcodeProfiler> profiler;
+        std::optional<SamplingProfiler> sampler;
         
-        void ExecuteUnknownOpcode();
+        // Globals are resolved to slots by the compiler.
         
-        #define LOX_OPCODE_EXEC_FUNC(name, type, _) \
-            void Execute##name();
+        std::vector<Value> globals;
+        std::vector<GcPtr<String>> globalNames;
+        HashTable<std::size_t> globalSlots;
         
-        LOX_OPCODES_LIST(LOX_OPCODE_EXEC_FUNC);
+        /// The value of a declared, but not yet defined global.
+        Value undefined;
         
-        #undef LOX_OPCODE_EXEC_FUNC
-        
-        void LiteralPush(Value val);
-        
-        GcPtr<String> ReadStringArgument();
+        GcPtr<Upvalue> openUpvalues;
         
         // Stack.
         
@@ -124,14 +164,7 @@ namespace Lox
         
         void StackPush(Value val);
         
-        Value StackPop();
-        
-        Value StackPeek(std::size_t offset = 0); // Throws StackUnderflow if the stack is empty.
-        StackIterator StackPeekIterator(std::size_t offset = 0);
-        
-        Value StackGet(std::size_t index);
-        
-        void StackSet(std::size_t index, Value newVal);
+        StackIterator StackPeekIterator(std::size_t offset = 0); // Throws StackUnderflow if the stack is empty.
         
         // Runtime operations.
         
@@ -139,17 +172,32 @@ namespace Lox
         
         void CallFunction(GcPtr<Closure> func, uint8_t argCount);
         
+        /// The stack size of the function is computed on the first call,
+        /// std::nullopt if the code is malformed.
+        std::optional<std::size_t> GetMaxStackSize(GcPtr<Closure> func);
+        
         void CallNative(GcPtr<Native> func, uint8_t argCount);
         
         void CallClass(GcPtr<Class> klass, uint8_t argCount);
         
         void CallBoundMethod(GcPtr<BoundMethod> method, uint8_t argCount);
         
-        void Invoke(GcPtr<Instance> obj, GcPtr<String> name, uint8_t argCount);
+        void Invoke(GcPtr<Instance> obj, GcPtr<String> name, uint8_t argCount, InlineCache& cache);
         
-        void InvokeFromClass(GcPtr<Class> obj, GcPtr<String> name, uint8_t argCount);
+        void InvokeFromClass(GcPtr<Class> obj, GcPtr<String> name, uint8_t argCount, InlineCache& cache);
         
-        GcPtr<BoundMethod> BindMethod(GcPtr<Class> klass, GcPtr<String> name, GcPtr<Instance> obj);
+        GcPtr<BoundMethod> BindMethod(GcPtr<Class> klass, GcPtr<String> name, GcPtr<Instance> obj,
+                                      InlineCache& cache);
+        
+        /// Field lookup through the inline cache of the current instruction.
+        std::optional<Value> GetField(GcPtr<Instance> obj, GcPtr<String> name, InlineCache& cache);
+        
+        void SetField(GcPtr<Instance> obj, GcPtr<String> name, Value val, InlineCache& cache);
+        
+        GcPtr<Shape> TransitionShape(GcPtr<Shape> shape, GcPtr<String> name);
+        
+        /// Method lookup through the inline cache of the current instruction.
+        std::optional<GcPtr<Closure>> FindMethod(GcPtr<Class> klass, GcPtr<String> name, InlineCache& cache);
         
         GcPtr<Upvalue> AddLocalUpvalue(StackIterator it);
         
@@ -161,13 +209,20 @@ namespace Lox
         template <typename T>
         GcPtr<T> ExtractObject(Value val);
         
+        /// Slow path of the arithmetic and comparison instructions: string
+        /// concatenation, type errors and division by zero.
         template <typename BinOp>
-        void BinaryOperation();
+        Value BinaryOperation(Value a, Value b);
         
         GcPtr<String> Concatenate(GcPtr<String> str1, GcPtr<String> str2);
         
+        /// Equality of the contents, the slow path of `Equal`.
+        bool StringsEqual(GcPtr<String> str1, GcPtr<String> str2);
+        
         // Debug.
         
+        void StopProfiler();
+        
         void TraceExecution(std::ostream& out) const;
         
         void PrintStack(std::ostream& out) const;
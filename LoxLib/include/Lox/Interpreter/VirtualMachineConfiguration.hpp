@@ -1,6 +1,7 @@
 #ifndef LOX_VM_INTERPRETER_VIRTUAL_MACHINE_CONFIGURATION_HPP
 #define LOX_VM_INTERPRETER_VIRTUAL_MACHINE_CONFIGURATION_HPP
 
+#include <cstddef>
 #include <iostream>
 
 namespace Lox
@@ -15,11 +16,64 @@ namespace Lox
         std::istream& GetUserInput() const;
         
         std::ostream& GetDebugOutput() const;
+        
+        // Debug features. They are off by default, the VM runs its lean loop then.
+        
+        /// Print the stack and the instruction before executing it.
+        bool GetTraceExecution() const;
+        void SetTraceExecution(bool value);
+        
+        /// Count the executed opcodes and their pairs, see `OpcodeProfiler`. The profiling
+        /// loop is the production loop with a `OpcodeProfiler::Record` before every dispatch.
+        /// The tracing loop does not profile.
+        bool GetProfileOpcodes() const;
+        void SetProfileOpcodes(bool value);
+        
+        /// Sample the call stack every `value` instructions, see `SamplingProfiler`. Zero
+        /// (the default) turns the sampling off. The sampling shares the profiling loop.
+        std::size_t GetSampleInterval() const;
+        void SetSampleInterval(std::size_t value);
+        
+        /// Collect the young generation on every allocation, see `MemoryManager`.
+        bool GetStressGC() const;
+        void SetStressGC(bool value);
+        
+        /// Make the marking of the major collections incremental, with at most `value` objects
+        /// marked in one pause, see `MemoryManager::SetIncrementalBudget`. Zero (the default)
+        /// marks the whole heap in one pause.
+        std::size_t GetIncrementalGCBudget() const;
+        void SetIncrementalGCBudget(std::size_t value);
+        
+        /// Count of the threads, which mark the heap in a stop-the-world major collection, see
+        /// `MemoryManager::SetMarkingThreads`. One (the default) marks on the VM thread only.
+        std::size_t GetMarkingThreads() const;
+        void SetMarkingThreads(std::size_t value);
+        
+        /// Sweep the old generation on a thread, while the script goes on, see
+        /// `MemoryManager::SetBackgroundSweeping`. Off by default.
+        bool GetBackgroundSweeping() const;
+        void SetBackgroundSweeping(bool value);
+        
+        bool GetLogGC() const;
+        void SetLogGC(bool value);
+        
+        bool GetDumpChunkAfterCompile() const;
+        void SetDumpChunkAfterCompile(bool value);
     
     private:
         std::ostream& userOutput;
         std::istream& userInput;
         std::ostream& debugOutput;
+        
+        bool traceExecution;
+        bool profileOpcodes;
+        std::size_t sampleInterval;
+        bool stressGC;
+        std::size_t incrementalGCBudget;
+        std::size_t markingThreads;
+        bool backgroundSweeping;
+        bool logGC;
+        bool dumpChunkAfterCompile;
     }; // class VirtualMachineConfiguration
 }
 
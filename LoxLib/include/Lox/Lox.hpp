@@ -5,6 +5,7 @@
 
 #include "DataStructures/LinesArray.hpp"
 #include "DataStructures/Chunk.hpp"
+#include "DataStructures/HashTable.hpp"
 
 #include "Lox/Compiler/SourcePosition.hpp"
 #include "Lox/Compiler/Compiler.hpp"
@@ -25,6 +26,8 @@
 
 #include "Interpreter/OpcodeType.hpp"
 #include "Interpreter/Opcode.hpp"
+#include "Interpreter/OpcodeProfiler.hpp"
+#include "Interpreter/SamplingProfiler.hpp"
 #include "Interpreter/VirtualMachineConfiguration.hpp"
 #include "Interpreter/VirtualMachine.hpp"
 
@@ -32,6 +35,7 @@
 
 #include "Stages/ChunkChecker.hpp"
 #include "Stages/ChunkOptimizer.hpp"
+#include "Stages/ChunkFuser.hpp"
 
 #include "Util/ChunkDumper.hpp"
 #include "Util/ChunkWriter.hpp"
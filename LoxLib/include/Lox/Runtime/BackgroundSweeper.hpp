@@ -0,0 +1,103 @@
+#ifndef LOX_VM_RUNTIME_BACKGROUND_SWEEPER_HPP
+#define LOX_VM_RUNTIME_BACKGROUND_SWEEPER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GcPtr.hpp"
+#include "Object.hpp"
+#include "ObjectType.hpp"
+
+namespace Lox
+{
+    /// A thread, which sweeps the old generation after the marking of a major collection,
+    /// while the script goes on, see `MemoryManager::SetBackgroundSweeping`.
+    ///
+    /// The swept list is the old generation at the end of the marking, the new objects and
+    /// the promoted ones are in the other lists, so they are never swept. The sweeper unmarks
+    /// the survivors and destroys the dead objects, but the `ObjectAllocator` is not shared:
+    /// the memory of the dead objects is given to the VM thread in batches, see
+    /// `TakeDeadObjects`, and it frees the memory.
+    class BackgroundSweeper
+    {
+    public:
+        static constexpr std::size_t BatchSize = 256;
+        
+        /// A destroyed object, which memory is not freed yet.
+        struct DeadObject
+        {
+            void* memory;
+            ObjectType type;
+            std::size_t payloadSize;
+        }; // struct DeadObject
+        
+        BackgroundSweeper();
+        
+        /// Waits for the current sweeping.
+        ~BackgroundSweeper();
+        
+        BackgroundSweeper(const BackgroundSweeper&) = delete;
+        BackgroundSweeper& operator=(const BackgroundSweeper&) = delete;
+        
+        /// Sweep the objects, which are linked by `Object::GetNext`. The previous sweeping
+        /// should be finished, and its survivors taken.
+        void Start(GcPtr<Object> objects);
+        
+        /// Whether all the objects of the last `Start` are swept. The dead objects are
+        /// given before it is true.
+        bool IsFinished() const
+        {
+            return finished.load(std::memory_order_acquire);
+        }
+        
+        bool HasDeadObjects() const
+        {
+            return hasDeadObjects.load(std::memory_order_acquire);
+        }
+        
+        /// Append the dead objects, given since the last call, to `result`.
+        void TakeDeadObjects(std::vector<DeadObject>& result);
+        
+        /// Prepend the survivors to `list`, after the sweeping is finished.
+        void MoveSurvivorsTo(GcPtr<Object>& list);
+        
+        void Wait();
+    
+    private:
+        std::mutex mutex;
+        
+        /// Signals new objects to sweep or the stop.
+        std::condition_variable workAvailable;
+        
+        /// Signals the end of a sweeping.
+        std::condition_variable sweepFinished;
+        
+        /// The objects of `Start`, which are not taken by the thread yet.
+        GcPtr<Object> objects;
+        
+        std::vector<DeadObject> deadObjects;
+        
+        GcPtr<Object> survivors;
+        GcPtr<Object> lastSurvivor;
+        
+        std::atomic<bool> finished;
+        std::atomic<bool> hasDeadObjects;
+        
+        bool stopping;
+        
+        /// Declared last, so it starts after all the other members.
+        std::thread thread;
+        
+        void Run();
+        
+        void Sweep(GcPtr<Object> list);
+        
+        void GiveDeadObjects(std::vector<DeadObject>& batch);
+    }; // class BackgroundSweeper
+}
+
+#endif // LOX_VM_RUNTIME_BACKGROUND_SWEEPER_HPP
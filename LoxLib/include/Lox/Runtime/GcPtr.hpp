@@ -33,6 +33,11 @@ namespace Lox
             return ptr == nullptr;
         }
         
+        T* GetRawPointer() const
+        {
+            return ptr;
+        }
+        
         T* operator->()
         {
             LOX_ASSERT(!IsNullptr(), "dereferencing nullptr Lox::GcPtr");
@@ -99,11 +104,6 @@ namespace Lox
             return !IsNullptr();
         }
         
-        void Delete() const
-        {
-            delete ptr;
-        }
-        
         std::ostream& PrintPointerValue(std::ostream& out) const
         {
             return out << ptr;
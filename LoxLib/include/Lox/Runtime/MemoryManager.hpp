@@ -1,17 +1,61 @@
 #ifndef LOX_VM_RUNTIME_MEMORY_MANAGER_HPP
 #define LOX_VM_RUNTIME_MEMORY_MANAGER_HPP
 
+#include <array>
+#include <chrono>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <ostream>
+#include <vector>
 
+#include "BackgroundSweeper.hpp"
 #include "GcPtr.hpp"
 #include "Object.hpp"
+#include "ObjectAllocator.hpp"
+#include "ObjectType.hpp"
+#include "ParallelMarker.hpp"
 #include "ValueType.hpp"
 #include "Value.hpp"
 #include "RootsSource.hpp"
 
 namespace Lox
 {
+    /// A generational mark-and-sweep collector.
+    ///
+    /// New objects are allocated in the young generation. A minor collection marks
+    /// only young objects (old objects are assumed alive), deletes the dead ones and
+    /// promotes the survivors to the old generation. A major collection marks and
+    /// sweeps the whole heap.
+    ///
+    /// Old objects that may point to young ones are kept in the remembered set, they
+    /// are the extra roots of a minor collection. Everyone who stores a reference into
+    /// an existing object should call `WriteBarrier`.
+    ///
+    /// The marking is tri-color without recursion: `MarkObject` marks a white object
+    /// and pushes it to the gray stack, `TraceReferences` pops the gray objects and marks
+    /// their children, until the stack is empty. So the depth of the object graph does
+    /// not touch the native stack.
+    ///
+    /// The old generation is swept lazily: a major collection only marks, and then every
+    /// allocation sweeps a few old objects (see `Configuration::LazySweepObjects`), until
+    /// all are swept. The memory of the dead objects goes to the free lists of `allocator`.
+    /// Or the old generation is swept by a thread, see `SetBackgroundSweeping`.
+    ///
+    /// With an incremental budget (see `SetIncrementalBudget`) the marking is done in
+    /// steps between allocations as well: every step marks at most `budget` old objects.
+    /// The young generation is not traced, it survives the collection as a whole, and the
+    /// minor collections go on as usual. The write barrier marks an old object, when it is
+    /// stored into a marked one, and the last pause of the marking marks the roots and the
+    /// children of the young objects once more. So the pauses are proportional to the
+    /// roots and the young generation, not to the whole heap.
+    ///
+    /// The marking of a stop-the-world major collection may be traced by several threads,
+    /// see `SetMarkingThreads` and `ParallelMarker`.
+    ///
+    /// The heap size, which triggers the collections, is the size of the object structures
+    /// and of their payloads (see `Object::GetPayloadSize`). A payload is counted, when the
+    /// object is allocated, and after it grows, see `AccountPayload`.
     class MemoryManager
     {
     public:
@@ -24,22 +68,112 @@ namespace Lox
         {
             CollectGarbageIfNeeded();
             
-            T* objRawPtr = new T(objects, std::forward<Args&&>(args)...);
+            void* memory = allocator.Allocate(sizeof(T));
+            
+            T* objRawPtr;
+            try
+            {
+                objRawPtr = new(memory) T(youngObjects, std::forward<Args&&>(args)...);
+            }
+            catch (...)
+            {
+                allocator.Free(memory);
+                throw;
+            }
+            
             GcPtr<T> obj(objRawPtr);
             LogObject("AllocateObject", obj);
             
-            objects = obj;
+            youngObjects = obj;
+            AccountAllocation(T::GetStaticType(), sizeof(T));
+            AccountPayload(obj);
             
             return obj;
         }
         
+        /// Call it after the payload of `obj` has changed. The difference from the size
+        /// accounted before is counted, the accounted size is given back by `FreeObject`.
+        void AccountPayload(GcPtr<Object> obj);
+        
         void CollectGarbageIfNeeded();
         
+        /// Major collection, the old generation is swept completely.
         void CollectGarbage();
         
-        static void LogObject(const char* str, GcPtr<Object> obj);
+        /// Minor collection.
+        void CollectYoungGeneration();
+        
+        /// Major collection step: start the incremental collection, or continue it.
+        void CollectGarbageStep();
+        
+        /// Whether a major collection is in progress: the incremental marking or the lazy sweeping.
+        bool IsCollecting() const;
+        
+        /// Call it after an unknown change of references inside `owner`.
+        void WriteBarrier(GcPtr<Object> owner)
+        {
+            Remember(owner);
+            
+            // The owner may be traced already, so it is traced once more.
+            if (phase == Phase::Marking && owner->IsMarked())
+            {
+                grayStack.push_back(owner);
+            }
+        }
+        
+        /// Call it after storing `val` into `owner`.
+        void WriteBarrier(GcPtr<Object> owner, Value val)
+        {
+            if (val.IsObject())
+            {
+                WriteBarrier(owner, val.AsObject());
+            }
+        }
+        
+        /// Call it after storing `obj` into `owner`.
+        void WriteBarrier(GcPtr<Object> owner, GcPtr<Object> obj)
+        {
+            if (obj.IsNullptr())
+            {
+                return;
+            }
+            
+            if (!obj->IsOld())
+            {
+                Remember(owner);
+            }
+            else if (phase == Phase::Marking && owner->IsMarked() && !obj->IsMarked())
+            {
+                // The owner may be traced already, and the object may be unreachable
+                // from anything else.
+                MarkObject(obj);
+            }
+        }
+        
+        void LogObject(const char* str, GcPtr<Object> obj) const
+        {
+            if (logGC)
+            {
+                LogObjectImpl(str, obj);
+            }
+        }
+        
+        void LogStages(const char* str) const;
         
-        static void LogStages(const char* str);
+        void SetStressGC(bool value);
+        
+        void SetLogGC(bool value);
+        
+        /// Count of the old objects marked in one step of a major collection. Zero (the
+        /// default) marks the whole heap in one pause.
+        void SetIncrementalBudget(std::size_t value);
+        
+        /// Count of the threads, which trace the stop-the-world marking of a major collection,
+        /// the calling thread included. One (the default) traces on the calling thread only.
+        void SetMarkingThreads(std::size_t value);
+        
+        /// Sweep the old generation on a `BackgroundSweeper` thread, not on the allocations.
+        void SetBackgroundSweeping(bool value);
         
         // NOTE: Actually the solution of using allow/disallow GC
         // doesn't work with threads. Probably.
@@ -48,21 +182,172 @@ namespace Lox
         
         void DisallowGC();
         
-        static void MarkObject(GcPtr<Object> obj);
+        /// Mark the object and push it to the gray stack, its children are marked later.
+        void MarkObject(GcPtr<Object> obj);
+        
+        void MarkValue(Value val);
+        
+        /// Whether the object survives the current collection. Valid only between the mark
+        /// and the sweep stages, i.e. in `RootsSource::SweepWeakReferences`.
+        bool IsReachable(GcPtr<Object> obj) const;
+        
+        // Statistics.
+        
+        std::size_t GetBytesAllocated() const;
+        
+        std::size_t GetBytesAllocated(ObjectType type) const;
+        
+        std::size_t GetObjectsCount(ObjectType type) const;
         
-        static void MarkValue(Value val);
+        std::size_t GetPeakBytesAllocated() const;
+        
+        std::size_t GetYoungBytesAllocated() const;
+        
+        std::size_t GetNextGC() const;
+        
+        std::size_t GetMinorCollectionsCount() const;
+        
+        std::size_t GetMajorCollectionsCount() const;
+        
+        /// Size of the free cells, which are kept for the next allocations.
+        std::size_t GetFreeBytes() const;
+        
+        /// Count of the pages of the `allocator`.
+        std::size_t GetPagesCount() const;
+        
+        /// The longest time spent in one collection or one step.
+        std::chrono::nanoseconds GetLongestPause() const;
     
     private:
         RootsSource& roots;
-        GcPtr<Object> objects;
+        ObjectAllocator allocator;
+        GcPtr<Object> youngObjects;
+        GcPtr<Object> oldObjects;
+        
+        std::vector<GcPtr<Object>> rememberedSet;
+        
+        /// Marked objects, whose children are not marked yet. Empty outside of `MarkStage`
+        /// and the incremental marking.
+        std::vector<GcPtr<Object>> grayStack;
+        
+        /// The gray objects of the incremental marking, while a minor collection runs.
+        std::vector<GcPtr<Object>> pausedGrayStack;
+        
+        enum class Phase
+        {
+            Idle,
+            Marking,
+            Sweeping
+        }; // enum class Phase
+        
+        /// The phase of the incremental major collection.
+        Phase phase;
+        std::size_t incrementalBudget;
+        
+        /// The next step happens when `bytesAllocated` reaches it.
+        std::size_t nextStep;
+        
+        /// The old objects, which are not swept yet. The survivors go back to `oldObjects`,
+        /// the dead ones to the `allocator`.
+        GcPtr<Object> sweepObjects;
         
         bool allowedGC;
+        bool collectingYoung;
+        
+        bool stressGC;
+        bool logGC;
+        
+        std::unique_ptr<ParallelMarker> parallelMarker;
+        
+        /// Whether `parallelMarker` traces, so `MarkObject` goes to it.
+        bool markingInParallel;
+        
+        std::unique_ptr<BackgroundSweeper> backgroundSweeper;
+        
+        /// The objects of `backgroundSweeper` to be freed, kept for the capacity.
+        std::vector<BackgroundSweeper::DeadObject> sweptObjects;
+        
+        // Heap accounting. The sizes are the sizes of the object structures and of their
+        // accounted payloads.
+        
+        std::array<std::size_t, ObjectTypesCount> bytesPerType;
+        std::array<std::size_t, ObjectTypesCount> objectsPerType;
+        
+        std::size_t bytesAllocated;
+        std::size_t youngBytesAllocated;
+        std::size_t peakBytesAllocated;
+        std::size_t nextGC;
+        
+        std::size_t minorCollections;
+        std::size_t majorCollections;
+        
+        std::chrono::nanoseconds longestPause;
+        
+        void RecordPause(std::chrono::steady_clock::time_point start);
+        
+        void Remember(GcPtr<Object> owner)
+        {
+            if (owner->IsOld() && !owner->IsRemembered())
+            {
+                owner->SetRemembered(true);
+                rememberedSet.push_back(owner);
+            }
+        }
+        
+        /// Start a major collection: mark the heap in one pause, or make the first step
+        /// of the incremental marking.
+        void StartMajorCollection();
+        
+        /// Mark the whole heap, the old generation is swept later.
+        void CollectGarbageLazily();
+        
+        /// The marking is done, the old generation is to be swept.
+        void StartSweeping();
+        
+        void BeginIncrementalCollection();
+        
+        /// The last pause of the incremental marking.
+        void FinishMarking();
+        
+        void FinishSweeping();
+        
+        /// Do the rest of the incremental collection at once.
+        void FinishIncrementalCollection();
+        
+        void AccountAllocation(ObjectType type, std::size_t size);
+        
+        void AccountBytes(ObjectType type, std::size_t size);
         
         void MarkStage();
         
-        void SweepStage();
+        void MarkRememberedSet();
+        
+        /// Mark the children of at most `budget` gray objects. Return true, if there are
+        /// no gray objects left.
+        bool TraceReferences(std::size_t budget = std::numeric_limits<std::size_t>::max());
+        
+        /// The young objects are not marked by an incremental collection, only their children.
+        void MarkYoungChildren();
+        
+        void SweepWeakReferences();
+        
+        void ClearRememberedSet();
+        
+        void SweepYoungGeneration();
+        
+        /// Sweep at most `budget` of the `sweepObjects`, or free the objects swept by the
+        /// `backgroundSweeper`. Return true, if all are swept.
+        bool SweepOldGenerationStep(std::size_t budget);
+        
+        void DeleteObject(GcPtr<Object> obj);
+        
+        /// Forget the destroyed object and free its memory. `payloadSize` is its accounted
+        /// payload size.
+        void FreeObject(void* memory, ObjectType type, std::size_t payloadSize);
+        
+        static std::size_t GetObjectSize(ObjectType type);
         
-        static void DeleteObject(GcPtr<Object> obj);
+        static void LogObjectImpl(const char* str, GcPtr<Object> obj);
         
         static std::ostream& Log(const char* str);
     };
@@ -0,0 +1,150 @@
+#ifndef LOX_VM_RUNTIME_NAN_BOXED_VALUE_STORAGE_HPP
+#define LOX_VM_RUNTIME_NAN_BOXED_VALUE_STORAGE_HPP
+
+#include <bit>
+#include <cstdint>
+
+#include "ValueType.hpp"
+
+namespace Lox
+{
+    /// The compact representation of `Value`: everything is packed into 64 bits.
+    ///
+    /// A double is stored as is, but every NaN becomes `CanonicalNan`, so a NaN from
+    /// the bytecode can not forge another value. Every other value lives inside a quiet NaN,
+    /// which the FPU never produces with the `QuietNan` bits set all together:
+    /// - nil, false and true are quiet NaNs with a small tag in the lowest bits,
+    /// - an object is a quiet NaN with the sign bit set and the pointer in the lower 48 bits.
+    class NanBoxedValueStorage
+    {
+    public:
+        explicit NanBoxedValueStorage(Nil)
+                : bits(NilBits)
+        {
+        
+        }
+        
+        explicit NanBoxedValueStorage(bool val)
+                : bits(val ? TrueBits : FalseBits)
+        {
+        
+        }
+        
+        explicit NanBoxedValueStorage(double val)
+                : bits(val != val ? CanonicalNan : std::bit_cast<uint64_t>(val))
+        {
+        
+        }
+        
+        explicit NanBoxedValueStorage(GcPtr<Object> obj)
+                : bits(SignBit | QuietNan | reinterpret_cast<uintptr_t>(obj.GetRawPointer()))
+        {
+        
+        }
+        
+        ValueType GetType() const
+        {
+            if (IsDouble())
+            {
+                return ValueType::Double;
+            }
+            else if (IsObject())
+            {
+                return ValueType::Object;
+            }
+            else if (IsNil())
+            {
+                return ValueType::Nil;
+            }
+            else
+            {
+                return ValueType::Bool;
+            }
+        }
+        
+        bool Is(ValueType otherType) const
+        {
+            switch (otherType)
+            {
+                #define LOX_NAN_BOXED_STORAGE_IS(name, repr) \
+                    case ValueType::name: return Is##name();
+            
+            LOX_VALUE_TYPE_LIST(LOX_NAN_BOXED_STORAGE_IS)
+                
+                #undef LOX_NAN_BOXED_STORAGE_IS
+            }
+            
+            return false;
+        }
+        
+        bool IsNil() const
+        {
+            return bits == NilBits;
+        }
+        
+        bool IsBool() const
+        {
+            // `FalseBits` and `TrueBits` differ only in the lowest bit.
+            return (bits | 1) == TrueBits;
+        }
+        
+        bool IsDouble() const
+        {
+            return (bits & QuietNan) != QuietNan;
+        }
+        
+        bool IsObject() const
+        {
+            return (bits & (SignBit | QuietNan)) == (SignBit | QuietNan);
+        }
+        
+        Nil GetNil() const
+        {
+            return Nil();
+        }
+        
+        bool GetBool() const
+        {
+            return bits == TrueBits;
+        }
+        
+        double GetDouble() const
+        {
+            return std::bit_cast<double>(bits);
+        }
+        
+        GcPtr<Object> GetObject() const
+        {
+            return GcPtr<Object>(reinterpret_cast<Object*>(static_cast<uintptr_t>(bits & ~(SignBit | QuietNan))));
+        }
+        
+        bool IsFalse() const
+        {
+            return bits == NilBits || bits == FalseBits;
+        }
+        
+        bool operator==(const NanBoxedValueStorage& other) const
+        {
+            // Doubles are compared as doubles, so that NaN != NaN and 0 == -0.
+            if (IsDouble() && other.IsDouble())
+            {
+                return GetDouble() == other.GetDouble();
+            }
+            
+            return bits == other.bits;
+        }
+    
+    private:
+        static constexpr uint64_t SignBit = 0x8000000000000000;
+        static constexpr uint64_t QuietNan = 0x7ffc000000000000;
+        static constexpr uint64_t CanonicalNan = 0x7ff8000000000000;
+        
+        static constexpr uint64_t NilBits = QuietNan | 1;
+        static constexpr uint64_t FalseBits = QuietNan | 2;
+        static constexpr uint64_t TrueBits = QuietNan | 3;
+        
+        uint64_t bits;
+    }; // class NanBoxedValueStorage
+}
+
+#endif // LOX_VM_RUNTIME_NAN_BOXED_VALUE_STORAGE_HPP
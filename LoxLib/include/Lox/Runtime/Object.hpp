@@ -1,6 +1,7 @@
 #ifndef LOX_VM_RUNTIME_OBJECT_HPP
 #define LOX_VM_RUNTIME_OBJECT_HPP
 
+#include <cstdint>
 #include <ostream>
 
 #include "ObjectType.hpp"
@@ -9,6 +10,8 @@
 
 namespace Lox
 {
+    class MemoryManager;
+    
     class Object
     {
     public:
@@ -27,9 +30,17 @@ namespace Lox
             return true;
         }
         
-        ObjectType GetType() const;
+        // Type checks are on the fast paths of the interpreter, so they are inline.
         
-        bool Is(ObjectType otherType) const;
+        ObjectType GetType() const
+        {
+            return type;
+        }
+        
+        bool Is(ObjectType otherType) const
+        {
+            return type == otherType;
+        }
         
         template <typename T>
         bool Is() const
@@ -68,19 +79,48 @@ namespace Lox
         
         void SetNext(GcPtr<Object> newNext);
         
+        // The mark bit is in the page of the object, see `ObjectAllocator`.
+        
         void SetMarked(); // Does not call `MarkChildren`.
         void Unmark();
         
         bool IsMarked() const;
         
-        virtual void MarkChildren() = 0;
+        /// An object is old when it has survived a garbage collection.
+        bool IsOld() const;
+        
+        void SetOld();
+        
+        /// An old object is remembered when it may point to young objects.
+        bool IsRemembered() const;
+        
+        void SetRemembered(bool newRemembered);
+        
+        /// Bytes of the memory, which the object owns outside of its structure: characters,
+        /// vectors and so on. See `MemoryManager::AccountPayload`.
+        virtual std::size_t GetPayloadSize() const;
+        
+        /// The payload size, which the heap accounting has counted for the object. It is
+        /// saturated at `MaxAccountedPayloadSize`.
+        std::size_t GetAccountedPayloadSize() const;
+        
+        void SetAccountedPayloadSize(std::size_t size);
+        
+        static constexpr std::size_t MaxAccountedPayloadSize = UINT32_MAX;
+        
+        virtual void MarkChildren(MemoryManager& memory) = 0;
     
     protected:
         Object(GcPtr<Object> next, ObjectType type);
     
     private:
-        bool marked;
+        bool old;
+        bool remembered;
         ObjectType type;
+        
+        /// It fits into the padding after the flags.
+        std::uint32_t accountedPayloadSize;
+        
         GcPtr<Object> next;
     };
     
@@ -0,0 +1,275 @@
+#ifndef LOX_VM_RUNTIME_OBJECT_ALLOCATOR_HPP
+#define LOX_VM_RUNTIME_OBJECT_ALLOCATOR_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(__SANITIZE_ADDRESS__)
+    #include <sanitizer/asan_interface.h>
+    #define LOX_POISON_CELL(ptr, size) ASAN_POISON_MEMORY_REGION((ptr), (size))
+    #define LOX_UNPOISON_CELL(ptr, size) ASAN_UNPOISON_MEMORY_REGION((ptr), (size))
+#else
+    #define LOX_POISON_CELL(ptr, size) ((void) (ptr), (void) (size))
+    #define LOX_UNPOISON_CELL(ptr, size) ((void) (ptr), (void) (size))
+#endif
+
+namespace Lox
+{
+    /// Memory of the GC objects.
+    ///
+    /// The sizes are rounded up to the size classes of `Granularity` bytes, so every object
+    /// type has its own class. The objects of a class are carved from pages of `PageSize`
+    /// bytes: an allocation pops the free list of a page, or bumps the pointer to its unused
+    /// tail. The pages are aligned to their size, so the page of an object is found by
+    /// masking its address. An object larger than `MaxCellSize` gets a page of its own.
+    ///
+    /// The mark bits of the objects are in the bitmaps of the pages, a bit per granule, see
+    /// `IsMarked`. The free cells and the unused tails are poisoned for the address
+    /// sanitizer, so a use after free is still reported.
+    class ObjectAllocator
+    {
+    public:
+        static constexpr std::size_t Granularity = 16;
+        static constexpr std::size_t MaxCellSize = 256;
+        static constexpr std::size_t PageSize = 64 * 1024;
+        
+        ObjectAllocator();
+        
+        /// All the objects should be freed before.
+        ~ObjectAllocator();
+        
+        ObjectAllocator(const ObjectAllocator&) = delete;
+        ObjectAllocator& operator=(const ObjectAllocator&) = delete;
+        
+        void* Allocate(std::size_t size)
+        {
+            if (size > MaxCellSize)
+            {
+                return AllocateLarge(size);
+            }
+            
+            std::size_t sizeClass = GetSizeClass(size);
+            Page* page = availablePages[sizeClass];
+            
+            if (page == nullptr)
+            {
+                page = AllocatePage(sizeClass);
+            }
+            
+            void* cell;
+            if (page->freeCells != nullptr)
+            {
+                FreeCell* freeCell = page->freeCells;
+                LOX_UNPOISON_CELL(freeCell, page->cellSize);
+                
+                page->freeCells = freeCell->next;
+                freeBytes -= page->cellSize;
+                cell = freeCell;
+            }
+            else
+            {
+                LOX_UNPOISON_CELL(page->bump, page->cellSize);
+                
+                cell = page->bump;
+                page->bump += page->cellSize;
+            }
+            
+            page->liveCells++;
+            
+            if (page->IsFull())
+            {
+                RemoveAvailablePage(page);
+            }
+            
+            return cell;
+        }
+        
+        /// The object should be unmarked.
+        void Free(void* ptr)
+        {
+            Page* page = GetPage(ptr);
+            
+            if (page->sizeClass == LargeSizeClass)
+            {
+                FreeLarge(page);
+                return;
+            }
+            
+            // The dead objects are unmarked, so the next object in the cell is unmarked too.
+            FreeCell* cell = ::new(ptr) FreeCell{page->freeCells};
+            page->freeCells = cell;
+            page->liveCells--;
+            freeBytes += page->cellSize;
+            
+            LOX_POISON_CELL(cell, page->cellSize);
+            
+            if (!page->available)
+            {
+                AddAvailablePage(page);
+            }
+        }
+        
+        /// Give the empty pages back to the global heap, until at most `limit` bytes of the
+        /// free cells are left.
+        void Trim(std::size_t limit);
+        
+        /// Size of the cells in the free lists, without the unused tails of the pages.
+        std::size_t GetFreeBytes() const;
+        
+        /// Count of the pages, the pages of the large objects included.
+        std::size_t GetPagesCount() const;
+        
+        // The neighbours share a word of the bitmap, and the parallel marking and the
+        // background sweeping change it from other threads, so the words are atomic.
+        
+        static bool IsMarked(const void* ptr)
+        {
+            return GetMarkWord(ptr).load(std::memory_order_relaxed) & GetMarkBit(ptr);
+        }
+        
+        static void SetMarked(const void* ptr)
+        {
+            GetMarkWord(ptr).fetch_or(GetMarkBit(ptr), std::memory_order_relaxed);
+        }
+        
+        static void Unmark(const void* ptr)
+        {
+            GetMarkWord(ptr).fetch_and(~GetMarkBit(ptr), std::memory_order_relaxed);
+        }
+        
+        /// Set the mark bit, return false when it is already set.
+        static bool TrySetMarked(const void* ptr)
+        {
+            std::atomic_ref<std::uint64_t> word = GetMarkWord(ptr);
+            std::uint64_t bit = GetMarkBit(ptr);
+            
+            if (word.load(std::memory_order_relaxed) & bit)
+            {
+                return false;
+            }
+            
+            return (word.fetch_or(bit, std::memory_order_relaxed) & bit) == 0;
+        }
+    
+    private:
+        struct FreeCell
+        {
+            FreeCell* next;
+        }; // struct FreeCell
+        
+        static constexpr std::size_t SizeClassesCount = MaxCellSize / Granularity;
+        static constexpr std::size_t LargeSizeClass = SizeClassesCount;
+        
+        /// The header at the start of a page, the cells follow it.
+        struct Page
+        {
+            /// Neighbours in the list of the pages with free cells.
+            Page* prev;
+            Page* next;
+            
+            FreeCell* freeCells;
+            
+            /// Start of the unused tail.
+            std::byte* bump;
+            
+            std::size_t sizeClass;
+            std::size_t cellSize;
+            std::size_t liveCells;
+            
+            /// Whether the page is in the list of the pages with free cells.
+            bool available;
+            
+            std::array<std::uint64_t, PageSize / Granularity / 64> marks;
+            
+            bool IsFull() const
+            {
+                std::size_t used = bump - reinterpret_cast<const std::byte*>(this);
+                return freeCells == nullptr && used + cellSize > PageSize;
+            }
+        }; // struct Page
+        
+        static constexpr std::size_t FirstCellOffset = (sizeof(Page) + Granularity - 1) / Granularity * Granularity;
+        
+        /// The pages with free cells, by the size class. The last freed are first.
+        std::array<Page*, SizeClassesCount> availablePages;
+        
+        std::size_t freeBytes;
+        std::size_t pagesCount;
+        
+        Page* AllocatePage(std::size_t sizeClass);
+        
+        void FreePage(Page* page);
+        
+        void* AllocateLarge(std::size_t size);
+        
+        void FreeLarge(Page* page);
+        
+        void AddAvailablePage(Page* page)
+        {
+            page->prev = nullptr;
+            page->next = availablePages[page->sizeClass];
+            
+            if (page->next != nullptr)
+            {
+                page->next->prev = page;
+            }
+            
+            availablePages[page->sizeClass] = page;
+            page->available = true;
+        }
+        
+        void RemoveAvailablePage(Page* page)
+        {
+            if (page->prev != nullptr)
+            {
+                page->prev->next = page->next;
+            }
+            else
+            {
+                availablePages[page->sizeClass] = page->next;
+            }
+            
+            if (page->next != nullptr)
+            {
+                page->next->prev = page->prev;
+            }
+            
+            page->available = false;
+        }
+        
+        static Page* GetPage(const void* ptr)
+        {
+            return reinterpret_cast<Page*>(reinterpret_cast<std::uintptr_t>(ptr) & ~(PageSize - 1));
+        }
+        
+        static std::size_t GetGranule(const void* ptr)
+        {
+            return (reinterpret_cast<std::uintptr_t>(ptr) & (PageSize - 1)) / Granularity;
+        }
+        
+        static std::atomic_ref<std::uint64_t> GetMarkWord(const void* ptr)
+        {
+            return std::atomic_ref<std::uint64_t>(GetPage(ptr)->marks[GetGranule(ptr) / 64]);
+        }
+        
+        static std::uint64_t GetMarkBit(const void* ptr)
+        {
+            return std::uint64_t(1) << (GetGranule(ptr) % 64);
+        }
+        
+        static std::size_t GetSizeClass(std::size_t size)
+        {
+            return (size - 1) / Granularity;
+        }
+        
+        static std::size_t GetCellSize(std::size_t sizeClass)
+        {
+            return (sizeClass + 1) * Granularity;
+        }
+    }; // class ObjectAllocator
+}
+
+#endif // LOX_VM_RUNTIME_OBJECT_ALLOCATOR_HPP
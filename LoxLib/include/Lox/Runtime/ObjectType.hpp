@@ -1,6 +1,8 @@
 #ifndef LOX_VM_RUNTIME_OBJECT_TYPE_HPP
 #define LOX_VM_RUNTIME_OBJECT_TYPE_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
 
 #define LOX_OBJECT_TYPE_LIST(o) \
@@ -10,11 +12,13 @@
     o(Upvalue)                  \
     o(Class)                    \
     o(Instance)                 \
-    o(BoundMethod)
+    o(BoundMethod)              \
+    o(Shape)
 
 namespace Lox
 {
-    enum class ObjectType
+    // One byte, so `Object` has room for its accounted payload size.
+    enum class ObjectType : std::uint8_t
     {
         #define LOX_OBJECT_TYPE_ENUM(name) name,
         
@@ -23,6 +27,12 @@ namespace Lox
         #undef LOX_OBJECT_TYPE_ENUM
     };
     
+    #define LOX_OBJECT_TYPE_COUNT(name) + 1
+    
+    constexpr std::size_t ObjectTypesCount = 0 LOX_OBJECT_TYPE_LIST(LOX_OBJECT_TYPE_COUNT);
+    
+    #undef LOX_OBJECT_TYPE_COUNT
+    
     std::ostream& operator<<(std::ostream& out, ObjectType type);
 }
 
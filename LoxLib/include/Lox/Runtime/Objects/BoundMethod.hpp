@@ -27,7 +27,7 @@ namespace Lox
         GcPtr<Instance> reciever;
         GcPtr<Closure> method;
         
-        void MarkChildren() override;
+        void MarkChildren(MemoryManager& memory) override;
     };
 }
 
@@ -5,6 +5,8 @@
 
 #include "../Object.hpp"
 
+#include "Lox/DataStructures/HashTable.hpp"
+
 #include "String.hpp"
 #include "Closure.hpp"
 
@@ -25,15 +27,19 @@ namespace Lox
         
         void Inherit(GcPtr<Class> other);
         
+        /// Changes every time the methods change, see `InlineCache`.
+        std::size_t GetVersion() const;
+        
         std::ostream& Print(std::ostream& out, PrintFlags flags) const override;
         
         static ObjectType GetStaticType();
     
     private:
         GcPtr<String> name;
-        std::unordered_map<GcPtr<String>, GcPtr<Closure>> methods;
+        HashTable<GcPtr<Closure>> methods;
+        std::size_t version;
         
-        void MarkChildren() override;
+        void MarkChildren(MemoryManager& memory) override;
     };
 }
 
@@ -41,6 +41,8 @@ namespace Lox
         
         bool HasUpvalue(std::size_t index) const;
         
+        std::size_t GetPayloadSize() const override;
+        
         std::ostream& Print(std::ostream& out, PrintFlags flags) const override;
         
         static ObjectType GetStaticType();
@@ -51,7 +53,7 @@ namespace Lox
         Chunk chunk;
         std::vector<GcPtr<Upvalue>> upvalues;
         
-        void MarkChildren() override;
+        void MarkChildren(MemoryManager& memory) override;
     };
 }
 
@@ -1,27 +1,47 @@
 #ifndef LOX_VM_RUNTIME_OBJECTS_INSTANCE_HPP
 #define LOX_VM_RUNTIME_OBJECTS_INSTANCE_HPP
 
+#include <memory>
 #include <optional>
+#include <vector>
 
 #include "Lox/Runtime/Object.hpp"
 #include "Lox/Runtime/Value.hpp"
 
 #include "Class.hpp"
+#include "Shape.hpp"
 
 namespace Lox
 {
+    /// Fields are stored in slots, described by the shape of the instance. When the
+    /// shape is full (see `Configuration::MaxShapeSlots`) new fields go to the overflow
+    /// dictionary.
     class Instance : public Object
     {
     public:
-        Instance(GcPtr<Object> next, GcPtr<Class> klass);
+        Instance(GcPtr<Object> next, GcPtr<Class> klass, GcPtr<Shape> shape);
         
         GcPtr<const Class> GetClass() const;
         
         GcPtr<Class> GetClass();
         
+        GcPtr<Shape> GetShape();
+        
         std::optional<Value> GetField(GcPtr<String> str);
         
-        void SetField(GcPtr<String> str, Value newVal);
+        /// Return false if there is no such field.
+        bool SetExistingField(GcPtr<String> str, Value newVal);
+        
+        Value GetSlot(std::size_t slot) const;
+        
+        void SetSlot(std::size_t slot, Value newVal);
+        
+        /// `newShape` should be the transition of the current shape.
+        void AddSlot(GcPtr<Shape> newShape, Value val);
+        
+        void AddOverflowField(GcPtr<String> str, Value val);
+        
+        std::size_t GetPayloadSize() const override;
         
         std::ostream& Print(std::ostream& out, PrintFlags flags) const override;
         
@@ -29,9 +49,11 @@ namespace Lox
     
     private:
         GcPtr<Class> klass;
-        std::unordered_map<GcPtr<String>, Value> fields;
+        GcPtr<Shape> shape;
+        std::vector<Value> slots;
+        std::unique_ptr<std::unordered_map<GcPtr<String>, Value>> overflow;
         
-        void MarkChildren() override;
+        void MarkChildren(MemoryManager& memory) override;
     };
 }
 
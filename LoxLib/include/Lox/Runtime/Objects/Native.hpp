@@ -40,7 +40,7 @@ namespace Lox
         std::size_t arity;
         NativeFn fn;
         
-        void MarkChildren() override;
+        void MarkChildren(MemoryManager& memory) override;
     };
 }
 
@@ -0,0 +1,52 @@
+#ifndef LOX_VM_RUNTIME_OBJECTS_SHAPE_HPP
+#define LOX_VM_RUNTIME_OBJECTS_SHAPE_HPP
+
+#include <optional>
+#include <vector>
+#include <unordered_map>
+
+#include "../Object.hpp"
+
+#include "String.hpp"
+
+namespace Lox
+{
+    /// Hidden class of an `Instance`: the names of its fields in the insertion order.
+    ///
+    /// Shapes form a transition tree that starts from the empty shape of the VM, so
+    /// instances, which got the same fields in the same order, share one shape. The
+    /// field values are kept in the instance at the slot of the field name.
+    class Shape final : public Object
+    {
+    public:
+        /// The empty shape.
+        explicit Shape(GcPtr<Object> next);
+        
+        /// The shape of `parent` with one more field.
+        Shape(GcPtr<Object> next, GcPtr<Shape> parent, GcPtr<String> key);
+        
+        std::optional<std::size_t> FindSlot(GcPtr<String> key) const;
+        
+        std::size_t GetSlotsCount() const;
+        
+        const std::vector<GcPtr<String>>& GetKeys() const;
+        
+        std::optional<GcPtr<Shape>> GetTransition(GcPtr<String> key);
+        
+        void AddTransition(GcPtr<String> key, GcPtr<Shape> shape);
+        
+        std::size_t GetPayloadSize() const override;
+        
+        std::ostream& Print(std::ostream& out, PrintFlags flags) const override;
+        
+        static ObjectType GetStaticType();
+    
+    private:
+        std::vector<GcPtr<String>> keys;
+        std::unordered_map<GcPtr<String>, GcPtr<Shape>> transitions;
+        
+        void MarkChildren(MemoryManager& memory) override;
+    };
+}
+
+#endif // LOX_VM_RUNTIME_OBJECTS_SHAPE_HPP
@@ -1,22 +1,89 @@
 #ifndef LOX_VM_RUNTIME_OBJECTS_STRING_HPP
 #define LOX_VM_RUNTIME_OBJECTS_STRING_HPP
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <functional>
 
 #include "Lox/Runtime/Object.hpp"
 
 namespace Lox
 {
+    /// A string is either flat, or a prefix of a shared builder buffer.
+    ///
+    /// Builder strings are made by `Concatenate`: when the left operand ends where its
+    /// buffer ends, the right one is appended to the buffer in place, so building a string
+    /// with `+` in a loop is linear. The buffer is not a GC object, it is shared by the
+    /// strings, which are its prefixes. The hash of a builder string is computed on demand,
+    /// and `GetCppString` flattens it. The payload of a builder string is the memory, by
+    /// which the buffer grew, when the string was made.
+    ///
+    /// Strings made by `VirtualMachine::InternString` are interned at once. The runtime
+    /// strings (concatenations) are interned on demand, when they are compared: they keep
+    /// the interned string with the same contents, so the next comparisons are by pointer.
     class String final : public Object
     {
     public:
         // Reevaluation of the hash.
         String(GcPtr<Object> next, std::string&& movedStr);
         
+        /// `hash` is `ComputeHash(movedStr)`, already known by the interning.
+        String(GcPtr<Object> next, std::string&& movedStr, std::size_t hash);
+        
+        /// The first `length` characters of `buffer`, which grew by `bufferGrowth` bytes
+        /// to hold them.
+        String(GcPtr<Object> next, std::shared_ptr<std::string> buffer, std::size_t length,
+               std::size_t bufferGrowth);
+        
+        /// Flattens a builder string.
         const std::string& GetCppString() const;
         
-        std::size_t GetHash() const;
+        /// Valid until the next concatenation.
+        std::string_view GetView() const;
+        
+        std::size_t GetLength() const;
+        
+        std::size_t GetHash() const
+        {
+            if (!hashComputed)
+            {
+                ComputeLazyHash();
+            }
+            
+            return hash;
+        }
+        
+        /// The string from the intern table with the same contents, it is this string itself
+        /// if it is in the table. Nullptr if it has not been interned yet.
+        GcPtr<String> GetInterned() const
+        {
+            return interned;
+        }
+        
+        void SetInterned(GcPtr<String> str);
+        
+        /// Concatenation of `a` and `b` as a builder string. It reuses the buffer of `a`
+        /// if nothing was appended after `a` yet. `growth` is set to the bytes, which the
+        /// buffer has allocated for it.
+        static std::shared_ptr<std::string> Append(const String& a, const String& b, std::size_t& growth);
+        
+        /// FNV-1a over the bytes of the string.
+        static std::size_t ComputeHash(std::string_view str)
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            
+            for (char ch: str)
+            {
+                hash ^= static_cast<unsigned char>(ch);
+                hash *= 1099511628211ull;
+            }
+            
+            return static_cast<std::size_t>(hash);
+        }
+        
+        std::size_t GetPayloadSize() const override;
         
         std::ostream& Print(std::ostream& out, PrintFlags flags) const override;
         // bool FullEqualTo(const Object& other) const override;
@@ -24,10 +91,19 @@ namespace Lox
         static ObjectType GetStaticType();
     
     private:
-        std::string str;
-        std::size_t hash;
+        mutable std::string str;
+        mutable std::shared_ptr<std::string> buffer;
+        std::size_t length;
+        std::size_t bufferGrowth;
+        
+        mutable std::size_t hash;
+        mutable bool hashComputed;
+        
+        GcPtr<String> interned;
+        
+        void ComputeLazyHash() const;
         
-        void MarkChildren() override;
+        void MarkChildren(MemoryManager& memory) override;
     };
 }
 
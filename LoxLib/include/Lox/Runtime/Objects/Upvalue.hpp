@@ -38,7 +38,7 @@ namespace Lox
         
         bool IsClosed() const;
         
-        void MarkChildren() override;
+        void MarkChildren(MemoryManager& memory) override;
     };
 }
 
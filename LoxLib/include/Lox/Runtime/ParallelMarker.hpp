@@ -0,0 +1,92 @@
+#ifndef LOX_VM_RUNTIME_PARALLEL_MARKER_HPP
+#define LOX_VM_RUNTIME_PARALLEL_MARKER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GcPtr.hpp"
+#include "Object.hpp"
+
+namespace Lox
+{
+    class MemoryManager;
+    
+    /// Tracing of the heap by several threads, for the stop-the-world marking of the major
+    /// collections, see `MemoryManager::SetMarkingThreads`.
+    ///
+    /// Every thread traces from its own gray stack. The work is shared through a pool of
+    /// packets of gray objects: the roots are split into packets, a thread with a long stack
+    /// gives a packet from its bottom to the pool when the pool is empty, and a thread
+    /// with an empty stack takes a packet. The marking ends when the pool is empty and all
+    /// the threads wait for it. The mark bits are set atomically, so an object is traced once.
+    ///
+    /// The calling thread traces too, so `threadsCount - 1` workers are started. They live
+    /// as long as the marker and sleep between the collections.
+    class ParallelMarker
+    {
+    public:
+        static constexpr std::size_t PacketSize = 128;
+        
+        ParallelMarker(MemoryManager& memory, std::size_t threadsCount);
+        
+        ~ParallelMarker();
+        
+        ParallelMarker(const ParallelMarker&) = delete;
+        ParallelMarker& operator=(const ParallelMarker&) = delete;
+        
+        /// Trace the gray objects and everything reachable from them, `grayStack` is left empty.
+        void Trace(std::vector<GcPtr<Object>>& grayStack);
+        
+        /// Mark the object and push it to the gray stack of the current thread, called by
+        /// `MemoryManager::MarkObject` while `Trace` runs.
+        void MarkObject(GcPtr<Object> obj);
+        
+        std::size_t GetThreadsCount() const;
+    
+    private:
+        using Packet = std::vector<GcPtr<Object>>;
+        
+        MemoryManager& memory;
+        std::vector<std::thread> workers;
+        
+        /// The gray stack of the calling thread.
+        Packet callerStack;
+        
+        std::mutex mutex;
+        
+        /// Signals a new `Trace`, a new packet, the end of the marking or the stop.
+        std::condition_variable workAvailable;
+        
+        /// Signals that a worker has finished its part of `Trace`.
+        std::condition_variable workerFinished;
+        
+        std::vector<Packet> packets;
+        
+        /// Read without the lock, to give packets only when they are needed.
+        std::atomic<std::size_t> packetsCount;
+        
+        /// Count of the threads, which are not waiting for a packet.
+        std::size_t busyThreads;
+        
+        std::size_t finishedWorkers;
+        
+        /// Incremented by every `Trace`, so the workers know that there is a new one.
+        std::uint64_t traceIndex;
+        
+        bool stopping;
+        
+        void RunWorker();
+        
+        /// Trace until all the threads are out of work.
+        void Work(Packet& stack);
+        
+        void GivePacket(Packet& stack);
+    }; // class ParallelMarker
+}
+
+#endif // LOX_VM_RUNTIME_PARALLEL_MARKER_HPP
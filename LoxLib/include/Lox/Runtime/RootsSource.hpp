@@ -12,6 +12,13 @@ namespace Lox
     {
     public:
         virtual void MarkRoots() = 0;
+        
+        /// Called after the mark stage, before the sweep. Remove every reference to the objects
+        /// that are going to be deleted (see `MemoryManager::IsReachable`) from the weak tables.
+        virtual void SweepWeakReferences()
+        {
+        
+        }
     };
 }
 
@@ -0,0 +1,96 @@
+#ifndef LOX_VM_RUNTIME_TAGGED_VALUE_STORAGE_HPP
+#define LOX_VM_RUNTIME_TAGGED_VALUE_STORAGE_HPP
+
+#include "ValueType.hpp"
+
+namespace Lox
+{
+    /// The portable representation of `Value`: a `ValueType` tag next to a union of
+    /// all possible payloads. With padding it takes 16 bytes.
+    class TaggedValueStorage
+    {
+    public:
+        #define LOX_TAGGED_STORAGE_CONSTRUCTOR(name, repr)         \
+            explicit TaggedValueStorage(repr val)                  \
+                    : type(ValueType::name), as(val)               \
+            {                                                      \
+                                                                   \
+            }
+        
+        LOX_VALUE_TYPE_LIST(LOX_TAGGED_STORAGE_CONSTRUCTOR)
+        
+        #undef LOX_TAGGED_STORAGE_CONSTRUCTOR
+        
+        ValueType GetType() const
+        {
+            return type;
+        }
+        
+        bool Is(ValueType otherType) const
+        {
+            return type == otherType;
+        }
+        
+        #define LOX_TAGGED_STORAGE_ACCESS(name, repr)              \
+            bool Is##name() const                                  \
+            {                                                      \
+                return type == ValueType::name;                    \
+            }                                                      \
+                                                                   \
+            repr Get##name() const                                 \
+            {                                                      \
+                return as.field_##name;                            \
+            }
+        
+        LOX_VALUE_TYPE_LIST(LOX_TAGGED_STORAGE_ACCESS)
+        
+        #undef LOX_TAGGED_STORAGE_ACCESS
+        
+        bool IsFalse() const
+        {
+            return IsNil() || (IsBool() && !GetBool());
+        }
+        
+        bool operator==(const TaggedValueStorage& other) const
+        {
+            if (type != other.type)
+            {
+                return false;
+            }
+            
+            switch (type)
+            {
+                #define LOX_TAGGED_STORAGE_EQ(name, repr) \
+                    case ValueType::name: return as.field_##name == other.as.field_##name;
+            
+            LOX_VALUE_TYPE_LIST(LOX_TAGGED_STORAGE_EQ)
+                
+                #undef LOX_TAGGED_STORAGE_EQ
+            }
+            
+            return false;
+        }
+    
+    private:
+        ValueType type;
+        
+        union As
+        {
+            #define LOX_TAGGED_STORAGE_UNION_AS(name, repr) \
+                explicit As(repr val) : field_##name(val) {}
+            
+            LOX_VALUE_TYPE_LIST(LOX_TAGGED_STORAGE_UNION_AS)
+            
+            #undef LOX_TAGGED_STORAGE_UNION_AS
+            
+            #define LOX_TAGGED_STORAGE_UNION_FIELD(name, repr) \
+                repr field_##name;
+            
+            LOX_VALUE_TYPE_LIST(LOX_TAGGED_STORAGE_UNION_FIELD)
+            
+            #undef LOX_TAGGED_STORAGE_UNION_FIELD
+        } as;
+    }; // class TaggedValueStorage
+}
+
+#endif // LOX_VM_RUNTIME_TAGGED_VALUE_STORAGE_HPP
@@ -1,12 +1,18 @@
 #ifndef LOX_VM_RUNTIME_VALUE_HPP
 #define LOX_VM_RUNTIME_VALUE_HPP
 
+#include <cstdint>
 #include <ostream>
+#include <type_traits>
+
+#include "Lox/Configuration.hpp"
 
 #include "../Util/Assert.hpp"
 #include "../Util/OverloadedVisitor.hpp"
 
 #include "ValueType.hpp"
+#include "TaggedValueStorage.hpp"
+#include "NanBoxedValueStorage.hpp"
 
 namespace Lox
 {
@@ -24,14 +30,14 @@ namespace Lox
     public:
         template <typename T>
         explicit Value(T value)
-                : type(TypeToValueType<T>()), as(value)
+                : storage(value)
         {
         
         }
         
         template <typename T>
         explicit Value(GcPtr<T> object)
-                : type(ValueType::Object), as(object)
+                : storage(static_cast<GcPtr<Object>>(object))
         {
         
         }
@@ -50,21 +56,34 @@ namespace Lox
         T As() const
         {
             LOX_ASSERT(Is<T>(), "Lox::Value bad cast");
-            return as.Get<T>();
+            
+            #define LOX_VALUE_TYPE_GET(name, type)                  \
+                if constexpr (std::is_same_v<T, type>)              \
+                {                                                   \
+                    return storage.Get##name();                     \
+                }                                                   \
+                else
+            
+            LOX_VALUE_TYPE_LIST(LOX_VALUE_TYPE_GET)
+            {
+                static_assert(sizeof(T) == 0, "wrong Value::As get");
+            }
+            
+            #undef LOX_VALUE_TYPE_GET
         }
         
         /// Don't use this method in interpreter's code.
         template <typename T>
         bool Is() const
         {
-            return type == TypeToValueType<T>();
+            return Is(TypeToValueType<T>());
         }
         
         #define LOX_VALUE_TYPE_CAST(name, type)                 \
             type As##name() const                               \
             {                                                   \
                 LOX_ASSERT(Is##name(), "Lox::Value bad cast");  \
-                return as.field_##name;                         \
+                return storage.Get##name();                     \
             }
         
         LOX_VALUE_TYPE_LIST(LOX_VALUE_TYPE_CAST);
@@ -80,13 +99,13 @@ namespace Lox
         
         bool Is(ValueType otherType) const
         {
-            return this->type == otherType;
+            return storage.Is(otherType);
         }
         
         #define LOX_VALUE_TYPE_IS(name, type) \
             bool Is##name() const             \
             {                                 \
-                return Is(ValueType::name);   \
+                return storage.Is##name();    \
             }
         
         LOX_VALUE_TYPE_LIST(LOX_VALUE_TYPE_IS);
@@ -107,10 +126,10 @@ namespace Lox
         template <class Visitor>
         void Visit(Visitor&& visitor) const
         {
-            switch (type)
+            switch (GetType())
             {
                 #define LOX_VALUE_TYPE_VISIT(name, type) \
-                    case ValueType::name: visitor(as.field_##name); break;
+                    case ValueType::name: visitor(storage.Get##name()); break;
             
             LOX_VALUE_TYPE_LIST(LOX_VALUE_TYPE_VISIT);
                 
@@ -118,59 +137,41 @@ namespace Lox
             }
         }
         
-        ValueType GetType() const;
+        ValueType GetType() const
+        {
+            return storage.GetType();
+        }
         
-        bool operator==(const Value& value) const;
+        bool operator==(const Value& other) const
+        {
+            return storage == other.storage;
+        }
         
-        bool operator!=(const Value& value) const;
+        bool operator!=(const Value& other) const
+        {
+            return !operator==(other);
+        }
         
-        bool IsTrue() const;
+        bool IsTrue() const
+        {
+            return !IsFalse();
+        }
         
-        bool IsFalse() const;
+        bool IsFalse() const
+        {
+            return storage.IsFalse();
+        }
     
     private:
-        ValueType type;
+        // The representation is chosen at compile time, see `Configuration::NanBoxing`.
+        using Storage = std::conditional_t<Configuration::NanBoxing, NanBoxedValueStorage, TaggedValueStorage>;
         
-        union As
-        {
-            #define LOX_VALUE_TYPE_UNION_AS(name, type) \
-                As(type val) : field_##name(val) {}
-            
-            template <typename T>
-            As(GcPtr<T> obj) : field_Object(obj)
-            {
-            }
-            
-            LOX_VALUE_TYPE_LIST(LOX_VALUE_TYPE_UNION_AS)
-            
-            #undef LOX_VALUE_TYPE_UNION_AS
-            
-            #define LOX_VALUE_TYPE_UNION_FIELD(name, type) \
-                type field_##name;
-            
-            LOX_VALUE_TYPE_LIST(LOX_VALUE_TYPE_UNION_FIELD)
-            
-            #undef LOX_VALUE_TYPE_UNION_FIELD
-            
-            template <typename T>
-            T Get() const
-            {
-                LOX_FAIL("wrong Value::As get");
-            }
-            
-            #define LOX_VALUE_TYPE_UNION_GET(name, type)      \
-                template <>                                   \
-                type Get<type>() const                        \
-                {                                             \
-                    return field_##name;                      \
-                }
-            
-            LOX_VALUE_TYPE_LIST(LOX_VALUE_TYPE_UNION_GET)
-            
-            #undef LOX_VALUE_TYPE_UNION_GET
-        } as;
+        Storage storage;
     }; // class Value
     
+    static_assert(!Configuration::NanBoxing || sizeof(Value) == sizeof(uint64_t),
+                  "NaN-boxed Lox::Value should fit in 64 bits");
+    
     extern Value NIL;
     
     std::ostream& operator<<(std::ostream& out, const Value& value);
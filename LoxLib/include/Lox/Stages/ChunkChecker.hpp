@@ -1,6 +1,9 @@
 #ifndef LOX_VM_STAGES_CHUNK_CHECKER_HPP
 #define LOX_VM_STAGES_CHUNK_CHECKER_HPP
 
+#include <optional>
+#include <vector>
+
 #include "Lox/DataStructures/Chunk.hpp"
 
 namespace Lox
@@ -8,14 +11,46 @@ namespace Lox
     class ChunkChecker
     {
     public:
+        /// Checker of a script: no arguments and no upvalues.
         ChunkChecker(const Chunk& chunk);
-            
-        bool Check();
+        
+        ChunkChecker(const Chunk& chunk, std::size_t arity, std::size_t upvaluesCount);
+        
+        /// Verify the code, so it can run without the runtime checks of the bytecode
+        /// (see `VirtualMachine::Run`): every path of the control flow graph ends with
+        /// `Opcode::Return`, jumps land on instructions, operands are in bounds, names are
+        /// strings, the stack never goes below the frame, and it has the same height
+        /// wherever the paths merge, superinstructions are followed by their fused
+        /// instructions. Functions in the constants are verified too.
+        bool Check() const;
+        
+        /// Walk the control flow graph and find the maximal stack height above the
+        /// frame arguments. Return std::nullopt if the code is malformed: an unknown
+        /// opcode, an operand or a jump out of the chunk, or a stack, that is higher
+        /// than `Configuration::StackSize` (or lower than the frame on every path).
+        std::optional<std::size_t> ComputeMaxStackSize() const;
+        
+        /// Size of the instruction with its operands, std::nullopt if the opcode is
+        /// unknown or the instruction does not fit in the chunk.
+        static std::optional<std::size_t> GetInstructionSize(const Chunk& chunk, std::size_t offset);
 
     private:
         const Chunk& chunk;
+        std::size_t arity;
+        std::size_t upvaluesCount;
+        std::size_t depth;
+        
+        ChunkChecker(const Chunk& chunk, std::size_t arity, std::size_t upvaluesCount, std::size_t depth);
+        
+        /// Check the operands of the instruction, when the stack has `height` values above the frame arguments.
+        bool CheckOperands(std::size_t offset, std::size_t height) const;
+        
+        /// Check that a superinstruction is followed by its fused instructions, `instructions`
+        /// are the decoded offsets.
+        bool CheckFused(std::size_t offset, const std::vector<bool>& instructions) const;
         
-        int stackSize;
+        /// Verify the function pushed by the instruction at `offset`.
+        bool CheckFunction(std::size_t offset) const;
     }; // class ChunkChecker
 }
 
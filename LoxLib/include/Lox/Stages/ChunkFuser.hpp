@@ -0,0 +1,38 @@
+#ifndef LOX_VM_STAGES_CHUNK_FUSER_HPP
+#define LOX_VM_STAGES_CHUNK_FUSER_HPP
+
+#include <cstddef>
+#include <span>
+
+#include "Lox/DataStructures/Chunk.hpp"
+
+#include "Lox/Interpreter/Opcode.hpp"
+
+namespace Lox
+{
+    /// Replaces the frequent sequences of instructions with superinstructions
+    /// (see `LOX_SUPERINSTRUCTIONS_LIST`), in the chunk and in the functions of its constants.
+    ///
+    /// Only the first opcode of a sequence is changed, so the jumps, the lines and the
+    /// inline caches stay where they were. A jump into the sequence runs the rest of
+    /// it unfused. It should run after `ChunkOptimizer`, which does not fold the fused code.
+    class ChunkFuser
+    {
+    public:
+        ChunkFuser(Chunk& chunk);
+        
+        /// Return the count of the new superinstructions.
+        std::size_t Fuse();
+    
+    private:
+        Chunk& chunk;
+        
+        /// Return the size of the sequence at `offset`, or zero if it does not match.
+        std::size_t Match(std::size_t offset, std::span<const Opcode> parts) const;
+        
+        /// Size of the instruction, a superinstruction together with its fused instructions.
+        std::size_t GetFullSize(std::size_t offset) const;
+    }; // class ChunkFuser
+}
+
+#endif // LOX_VM_STAGES_CHUNK_FUSER_HPP
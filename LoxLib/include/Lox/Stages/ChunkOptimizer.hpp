@@ -1,6 +1,9 @@
 #ifndef LOX_VM_STAGES_OPTIMIZER_HPP
 #define LOX_VM_STAGES_OPTIMIZER_HPP
 
+#include <cstddef>
+#include <vector>
+
 #include "Lox/Configuration.hpp"
 
 #include "Lox/DataStructures/Chunk.hpp"
@@ -41,20 +44,32 @@ namespace Lox
         
         std::vector<std::size_t> constantsStack;
         
+        /// Offsets, where the jumps land. They are updated on every change of the code.
+        std::vector<bool> jumpTargets;
+        
         void StackPush(std::size_t element);
         std::size_t StackPop();
         std::size_t StackPeek();
 
-        Value PopValue(std::size_t index);
-        void PushValue(Value val, std::size_t line, std::size_t index);
+        /// Return the size of the inserted code.
+        std::size_t PushValue(Value val, std::size_t line, std::size_t index);
         Value PeekValue(std::size_t index);
         
+        /// Replace the instruction at `ip` and its `valuesCount` operands from the
+        /// constants stack with `val`. The ip is left on the new value.
+        void Fold(std::size_t valuesCount, Value val);
+        
         void RemoveInstruction(std::size_t at);
         
+        /// Patch the jumps after `delta` bytes were inserted (or removed, when `delta` is
+        /// negative) at `at`, and find the jump targets again.
+        void UpdateJumps(std::size_t at, std::ptrdiff_t delta);
+        
         GcPtr<String> ReadString();
         
+        /// Return whether the operation was folded.
         template <typename Op>
-        void BinaryOperation();
+        bool BinaryOperation();
         
         Value NegateValue(Value val);
 
@@ -3,8 +3,9 @@
 
 #include <string_view>
 
+// The check is inline, only a failure calls the function: asserts are on every fast path.
 #define LOX_ASSERT(expr, errorMsg) \
-    Lox::Assert((expr), (#expr), (errorMsg), __LINE__, __FILE__)
+    ((expr) ? static_cast<void>(0) : Lox::Assert(false, (#expr), (errorMsg), __LINE__, __FILE__))
 
 #define LOX_UNREACHABLE(errorMsg) \
     Lox::Assert(false, "false", "Unreachable: " errorMsg, __LINE__, __FILE__)
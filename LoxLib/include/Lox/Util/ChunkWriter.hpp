@@ -25,6 +25,9 @@ namespace Lox
 
         void WriteCode();
         void WriteConstants();
+        
+        /// Lines are written as runs: the count of elements and their line.
+        void WriteLines(const LinesArray& lines);
 
         void WriteSize(std::size_t size);
         void WriteValue(Value val);
@@ -50,11 +50,15 @@ namespace Lox
     {
         EmitReturn();
         
-        if constexpr (Configuration::DumpChunkAfterCompile)
+        // The chunk has grown since the function was allocated.
+        vm.AccountPayload(function);
+        
+        if (vm.GetConfiguration().GetDumpChunkAfterCompile())
         {
             if (!parser.HadError())
             {
-                ChunkDumper dumper(function->GetChunk(), function->GetName()->GetCppString(), std::cout);
+                ChunkDumper dumper(function->GetChunk(), function->GetName()->GetCppString(),
+                                   vm.GetConfiguration().GetDebugOutput());
                 dumper.Dump();
             }
         }
@@ -863,8 +867,8 @@ namespace Lox
     void Compiler::DefineGlobalVariable(Token name)
     {
         SourcePosition pos = name.GetPos();
-        EmitOpcode(OpcodeDefineGlobal, pos);
-        EmitByte(VariableName(name), pos);
+        EmitOpcode(OpcodeDefineGlobalSlot, pos);
+        EmitShort(GlobalSlot(name), pos);
     }
     
     void Compiler::DefineLocalVariable(Token name)
@@ -892,6 +896,18 @@ namespace Lox
         return AddConstant(nameValue, name.GetPos());
     }
     
+    uint16_t Compiler::GlobalSlot(Token name)
+    {
+        std::size_t slot = vm.GetGlobalSlot(vm.InternString(name.GetStr()));
+        
+        if (slot > UINT16_MAX)
+        {
+            parser.ErrorAtCurrent("too many global variables");
+        }
+        
+        return slot;
+    }
+    
     void Compiler::NamedVariable(Token name, bool canAssign)
     {
         Opcode getOp;
@@ -911,11 +927,13 @@ namespace Lox
         }
         else
         {
-            arg = VariableName(name.GetStr());
-            getOp = OpcodeGetGlobal;
-            setOp = OpcodeSetGlobal;
+            arg = GlobalSlot(name);
+            getOp = OpcodeGetGlobalSlot;
+            setOp = OpcodeSetGlobalSlot;
         }
         
+        Opcode op = getOp;
+        
         if (parser.Match(TokenType::Equal))
         {
             if (!canAssign)
@@ -924,12 +942,17 @@ namespace Lox
             }
             
             Expression();
-            EmitOpcode(setOp);
-            EmitByte(arg);
+            op = setOp;
+        }
+        
+        EmitOpcode(op);
+        
+        if (GetOpcodeType(op) == OpcodeType::Short)
+        {
+            EmitShort(arg);
         }
         else
         {
-            EmitOpcode(getOp);
             EmitByte(arg);
         }
     }
@@ -1061,6 +1084,17 @@ namespace Lox
         EmitByte(byte, parser.GetCurrent().GetPos());
     }
     
+    void Compiler::EmitShort(uint16_t value, SourcePosition pos)
+    {
+        EmitByte((value >> 8) & 0xff, pos);
+        EmitByte(value & 0xff, pos);
+    }
+    
+    void Compiler::EmitShort(uint16_t value)
+    {
+        EmitShort(value, parser.GetCurrent().GetPos());
+    }
+    
     void Compiler::EmitOpcode(Opcode opcode, SourcePosition pos)
     {
         EmitByte(opcode, pos);
@@ -160,6 +160,9 @@ namespace Lox
         
         uint8_t VariableName(Token name);
         
+        /// Slot of the global in the VM, see `VirtualMachine::GetGlobalSlot`.
+        uint16_t GlobalSlot(Token name);
+        
         void NamedVariable(Token name, bool canAssign);
         
         // Upvalues.
@@ -211,6 +214,11 @@ namespace Lox
         
         void EmitByte(uint8_t byte);
         
+        /// Big-endian, as jump offsets.
+        void EmitShort(uint16_t value, SourcePosition pos);
+        
+        void EmitShort(uint16_t value);
+        
         void EmitOpcode(Opcode opcode, SourcePosition pos);
         
         void EmitOpcode(Opcode opcode);
@@ -1,11 +1,14 @@
 #include "Lox/DataStructures/Chunk.hpp"
 
+#include "Lox/Util/Assert.hpp"
+
 namespace Lox
 {
     std::size_t Chunk::PushCode(uint8_t byte, std::size_t line)
     {
         code.push_back(byte);
         codeLines.PushLine(line);
+        maxStackSize.reset();
         return code.size() - 1;
     }
 
@@ -36,9 +39,16 @@ namespace Lox
     
     uint8_t& Chunk::GetCode(std::size_t index)
     {
+        // The code may be patched through the reference.
+        maxStackSize.reset();
         return code[index];
     }
 
+    void Chunk::QuickenCode(std::size_t index, uint8_t opcode)
+    {
+        code[index] = opcode;
+    }
+
     Value Chunk::GetConstant(std::size_t index) const
     {
         return constants[index];
@@ -101,30 +111,78 @@ namespace Lox
 
     void Chunk::EraseCode(CodeIterator begin, CodeIterator end)
     {
+        std::size_t index = begin - code.cbegin();
+        
+        codeLines.Erase(index, end - code.cbegin());
         code.erase(begin, end);
+        maxStackSize.reset();
     }
 
     void Chunk::EraseCode(CodeIterator at)
     {
-        code.erase(at);
-        codeLines.Erase(at - code.begin());
+        EraseCode(at - code.cbegin());
     }
 
     void Chunk::EraseCode(std::size_t index)
     {
         code.erase(code.begin() + index);
         codeLines.Erase(index);
+        maxStackSize.reset();
     }
 
     void Chunk::InsertCode(CodeIterator at, uint8_t byte, std::size_t line)
     {
-        code.insert(at, byte);
-        codeLines.Insert(at - code.begin(), line);
+        InsertCode(at - code.cbegin(), byte, line);
     }
 
     void Chunk::InsertCode(std::size_t index, uint8_t byte, std::size_t line)
     {
         code.insert(code.begin() + index, byte);
         codeLines.Insert(index, line);
+        maxStackSize.reset();
+    }
+    
+    const LinesArray& Chunk::GetCodeLines() const
+    {
+        return codeLines;
+    }
+    
+    const LinesArray& Chunk::GetConstantsLines() const
+    {
+        return constantsLines;
+    }
+
+    InlineCache& Chunk::GetInlineCache(std::size_t constantIndex)
+    {
+        LOX_ASSERT(HasConstant(constantIndex), "Lox::Chunk inline cache of wrong constant");
+        
+        if (constantIndex >= inlineCaches.size())
+        {
+            inlineCaches.resize(constants.size());
+        }
+        
+        return inlineCaches[constantIndex];
+    }
+    
+    std::vector<InlineCache>& Chunk::GetInlineCaches()
+    {
+        return inlineCaches;
+    }
+    
+    std::size_t Chunk::GetPayloadSize() const
+    {
+        return code.capacity() + constants.capacity() * sizeof(Value)
+               + (codeLines.GetRuns().capacity() + constantsLines.GetRuns().capacity()) * sizeof(LinesArray::Run)
+               + inlineCaches.capacity() * sizeof(InlineCache);
+    }
+    
+    std::optional<std::size_t> Chunk::GetMaxStackSize() const
+    {
+        return maxStackSize;
+    }
+    
+    void Chunk::SetMaxStackSize(std::size_t size)
+    {
+        maxStackSize = size;
     }
 }
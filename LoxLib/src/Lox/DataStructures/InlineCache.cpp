@@ -0,0 +1,111 @@
+#include "Lox/DataStructures/InlineCache.hpp"
+
+#include "Lox/Runtime/MemoryManager.hpp"
+
+#include "Lox/Runtime/Objects/Class.hpp"
+#include "Lox/Runtime/Objects/Closure.hpp"
+#include "Lox/Runtime/Objects/Shape.hpp"
+
+namespace Lox
+{
+    GcPtr<Closure> InlineCache::Lookup(GcPtr<Class> klass) const
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const Entry& entry = entries[i];
+            
+            if (entry.klass == klass && entry.version == klass->GetVersion())
+            {
+                return entry.method;
+            }
+        }
+        
+        return GcPtr<Closure>();
+    }
+    
+    void InlineCache::Update(GcPtr<Class> klass, GcPtr<Closure> method)
+    {
+        Entry newEntry{klass, klass->GetVersion(), method};
+        
+        // A stale entry of the same class is reused.
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (entries[i].klass == klass)
+            {
+                entries[i] = newEntry;
+                return;
+            }
+        }
+        
+        if (count < EntriesCount)
+        {
+            entries[count++] = newEntry;
+            return;
+        }
+        
+        // Megamorphic site, entries are replaced in turn.
+        entries[nextReplaced] = newEntry;
+        nextReplaced = (nextReplaced + 1) % EntriesCount;
+    }
+    
+    const InlineCache::FieldEntry* InlineCache::LookupField(GcPtr<Shape> shape) const
+    {
+        for (std::size_t i = 0; i < fieldCount; ++i)
+        {
+            if (fieldEntries[i].shape == shape)
+            {
+                return &fieldEntries[i];
+            }
+        }
+        
+        return nullptr;
+    }
+    
+    void InlineCache::UpdateField(GcPtr<Shape> shape, std::size_t slot, GcPtr<Shape> transition)
+    {
+        FieldEntry newEntry{shape, transition, slot};
+        
+        for (std::size_t i = 0; i < fieldCount; ++i)
+        {
+            if (fieldEntries[i].shape == shape)
+            {
+                fieldEntries[i] = newEntry;
+                return;
+            }
+        }
+        
+        if (fieldCount < EntriesCount)
+        {
+            fieldEntries[fieldCount++] = newEntry;
+            return;
+        }
+        
+        fieldEntries[nextFieldReplaced] = newEntry;
+        nextFieldReplaced = (nextFieldReplaced + 1) % EntriesCount;
+    }
+    
+    std::size_t InlineCache::GetEntriesCount() const
+    {
+        return count;
+    }
+    
+    std::size_t InlineCache::GetFieldEntriesCount() const
+    {
+        return fieldCount;
+    }
+    
+    void InlineCache::Mark(MemoryManager& memory)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            memory.MarkObject(entries[i].klass);
+            memory.MarkObject(entries[i].method);
+        }
+        
+        for (std::size_t i = 0; i < fieldCount; ++i)
+        {
+            memory.MarkObject(fieldEntries[i].shape);
+            memory.MarkObject(fieldEntries[i].transition);
+        }
+    }
+}
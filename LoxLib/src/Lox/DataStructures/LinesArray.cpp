@@ -1,25 +1,145 @@
 #include "Lox/DataStructures/LinesArray.hpp"
 
+#include <algorithm>
+
+#include "Lox/Util/Assert.hpp"
+
 namespace Lox
 {
     std::size_t LinesArray::PushLine(std::size_t line)
     {
-        array.push_back(line);
-        return array.size() - 1;
+        PushLines(line, 1);
+        return size - 1;
+    }
+    
+    void LinesArray::PushLines(std::size_t line, std::size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        
+        if (runs.empty() || runs.back().line != line)
+        {
+            runs.push_back({ size, line });
+        }
+        
+        size += count;
     }
 
     std::size_t LinesArray::operator[](std::size_t index) const
     {
-        return array[index];
+        return FindRun(index)->line;
     }
 
     void LinesArray::Erase(std::size_t index)
     {
-        array.erase(array.begin() + index);
+        auto it = FindRun(index);
+        
+        ShiftRuns(it, -1);
+        --size;
+        
+        std::size_t runEnd = std::next(it) != runs.end() ? std::next(it)->begin : size;
+        
+        if (it->begin == runEnd)
+        {
+            // The run is empty now, its neighbours may have the same line.
+            it = runs.erase(it);
+            
+            if (it != runs.begin() && it != runs.end() && std::prev(it)->line == it->line)
+            {
+                runs.erase(it);
+            }
+        }
+    }
+    
+    void LinesArray::Erase(std::size_t begin, std::size_t end)
+    {
+        LOX_ASSERT(begin <= end && end <= size, "Lox::LinesArray wrong range");
+        
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            Erase(begin);
+        }
     }
 
     void LinesArray::Insert(std::size_t index, std::size_t line)
     {
-        array.insert(array.begin() + index, line);
+        LOX_ASSERT(index <= size, "Lox::LinesArray inserting out of range");
+        
+        if (index == size)
+        {
+            PushLine(line);
+            return;
+        }
+        
+        auto it = FindRun(index);
+        ++size;
+        
+        if (it->line == line)
+        {
+            ShiftRuns(it, 1);
+        }
+        else if (index == it->begin && it != runs.begin() && std::prev(it)->line == line)
+        {
+            // The end of the previous run.
+            ShiftRuns(std::prev(it), 1);
+        }
+        else if (index == it->begin)
+        {
+            ShiftRuns(it, 1);
+            ++it->begin;
+            runs.insert(it, { index, line });
+        }
+        else
+        {
+            // Split the run.
+            ShiftRuns(it, 1);
+            std::size_t oldLine = it->line;
+            it = runs.insert(std::next(it), { index, line });
+            runs.insert(std::next(it), { index + 1, oldLine });
+        }
+    }
+    
+    std::size_t LinesArray::GetSize() const
+    {
+        return size;
+    }
+    
+    const std::vector<LinesArray::Run>& LinesArray::GetRuns() const
+    {
+        return runs;
+    }
+    
+    std::size_t LinesArray::GetRunLength(std::size_t runIndex) const
+    {
+        std::size_t end = runIndex + 1 < runs.size() ? runs[runIndex + 1].begin : size;
+        return end - runs[runIndex].begin;
+    }
+    
+    std::vector<LinesArray::Run>::iterator LinesArray::FindRun(std::size_t index)
+    {
+        LOX_ASSERT(index < size, "Lox::LinesArray index out of range");
+        
+        auto it = std::upper_bound(runs.begin(), runs.end(), index,
+                                   [](std::size_t i, const Run& run) { return i < run.begin; });
+        return std::prev(it);
+    }
+    
+    std::vector<LinesArray::Run>::const_iterator LinesArray::FindRun(std::size_t index) const
+    {
+        LOX_ASSERT(index < size, "Lox::LinesArray index out of range");
+        
+        auto it = std::upper_bound(runs.begin(), runs.end(), index,
+                                   [](std::size_t i, const Run& run) { return i < run.begin; });
+        return std::prev(it);
+    }
+    
+    void LinesArray::ShiftRuns(std::vector<Run>::iterator it, std::ptrdiff_t delta)
+    {
+        for (++it; it != runs.end(); ++it)
+        {
+            it->begin += delta;
+        }
     }
 }
@@ -39,6 +39,11 @@ namespace Lox
         return ip;
     }
     
+    void CallFrame::SetIP(Chunk::CodeIterator newIP)
+    {
+        ip = newIP;
+    }
+    
     uint8_t CallFrame::ReadByte()
     {
         // TODO: Is that a correct check?
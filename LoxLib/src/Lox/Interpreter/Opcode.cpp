@@ -78,4 +78,100 @@ namespace Lox
         
         #undef LOX_OPCODE_STACK_EFFECT
     }
+    
+    int GetOpcodeStackEffect(Opcode opcode, uint8_t argCount)
+    {
+        switch (GetBaseOpcode(opcode))
+        {
+        case OpcodeCall:
+        case OpcodeInvoke:
+        case OpcodeInvokeSuper:
+            return GetOpcodeStackEffect(opcode) - argCount;
+        default:
+            return GetOpcodeStackEffect(opcode);
+        }
+    }
+    
+    std::size_t GetOpcodeStackInputs(Opcode opcode, uint8_t argCount)
+    {
+        switch (GetBaseOpcode(opcode))
+        {
+        case OpcodePrint:
+        case OpcodeReturn:
+        case OpcodeNot:
+        case OpcodeNegate:
+        case OpcodePop:
+        case OpcodeDefineGlobal:
+        case OpcodeSetGlobal:
+        case OpcodeDefineGlobalSlot:
+        case OpcodeSetGlobalSlot:
+        case OpcodeSetLocal:
+        case OpcodeJumpIfFalse:
+        case OpcodeSetUpvalue:
+        case OpcodeFillUpvalues:
+        case OpcodeCloseUpvalue:
+        case OpcodeGetProperty:
+            return 1;
+        
+        case OpcodeAdd:
+        case OpcodeSubstract:
+        case OpcodeMultiply:
+        case OpcodeDivide:
+        case OpcodeGreater:
+        case OpcodeLess:
+        case OpcodeEqual:
+        case OpcodeSetProperty:
+        case OpcodeMethod:
+        case OpcodeInherit:
+        case OpcodeGetSuper:
+            return 2;
+        
+        case OpcodeCall:
+        case OpcodeInvoke:
+            return argCount + 1;
+        
+        case OpcodeInvokeSuper:
+            return argCount + 2;
+        
+        default:
+            return 0;
+        }
+    }
+    
+    std::span<const Opcode> GetFusedOpcodes(Opcode opcode)
+    {
+        #define LOX_SUPERINSTRUCTIONS_PARTS(name, ...)                  \
+            case Opcode##name:                                          \
+            {                                                           \
+                static constexpr Opcode parts[] = { __VA_ARGS__ };      \
+                return parts;                                           \
+            }
+        
+        switch (opcode)
+        {
+            LOX_SUPERINSTRUCTIONS_LIST(LOX_SUPERINSTRUCTIONS_PARTS);
+        default:
+            return {};
+        }
+        
+        #undef LOX_SUPERINSTRUCTIONS_PARTS
+    }
+    
+    Opcode GetBaseOpcode(Opcode opcode)
+    {
+        #define LOX_QUICKENED_OPCODES_BASE(name, generic) \
+            case Opcode##name: return generic;
+        
+        switch (opcode)
+        {
+            LOX_QUICKENED_OPCODES_LIST(LOX_QUICKENED_OPCODES_BASE);
+        default:
+            break;
+        }
+        
+        #undef LOX_QUICKENED_OPCODES_BASE
+        
+        std::span<const Opcode> parts = GetFusedOpcodes(opcode);
+        return parts.empty() ? opcode : parts.front();
+    }
 }
@@ -0,0 +1,214 @@
+#include "Lox/Interpreter/OpcodeProfiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace Lox
+{
+    OpcodeProfiler::OpcodeProfiler()
+            : counts(OpcodesCount), ticks(OpcodesCount), pairs(OpcodesCount * OpcodesCount),
+              hasPrevious(false), previous(OpcodeReturn), previousTicks(0)
+    {
+    
+    }
+    
+    void OpcodeProfiler::Stop()
+    {
+        if (hasPrevious)
+        {
+            ticks[previous] += ReadTicks() - previousTicks;
+            hasPrevious = false;
+        }
+    }
+    
+    std::uint64_t OpcodeProfiler::GetCount(Opcode opcode) const
+    {
+        return counts[opcode];
+    }
+    
+    std::uint64_t OpcodeProfiler::GetPairCount(Opcode first, Opcode second) const
+    {
+        return pairs[first * OpcodesCount + second];
+    }
+    
+    std::uint64_t OpcodeProfiler::GetTicks(Opcode opcode) const
+    {
+        return ticks[opcode];
+    }
+    
+    std::uint64_t OpcodeProfiler::GetTotalCount() const
+    {
+        std::uint64_t total = 0;
+        
+        for (std::uint64_t count: counts)
+        {
+            total += count;
+        }
+        
+        return total;
+    }
+    
+    std::string_view OpcodeProfiler::GetClockName()
+    {
+        return LOX_PROFILER_RDTSC ? "rdtsc" : "steady_clock";
+    }
+    
+    // The names are printed by `operator<<`, they are needed as strings for the alignment.
+    static std::string OpcodeName(Opcode opcode)
+    {
+        std::ostringstream ss;
+        ss << opcode;
+        return ss.str();
+    }
+    
+    static double Percent(std::uint64_t part, std::uint64_t total)
+    {
+        return total == 0 ? 0 : 100.0 * part / total;
+    }
+    
+    void OpcodeProfiler::PrintReport(std::ostream& out, std::size_t topPairs) const
+    {
+        std::uint64_t totalCount = GetTotalCount();
+        
+        std::uint64_t totalTicks = 0;
+        for (std::uint64_t opcodeTicks: ticks)
+        {
+            totalTicks += opcodeTicks;
+        }
+        
+        out << "Opcodes profile, " << totalCount << " instructions, ticks are " << GetClockName() << std::endl;
+        out << std::left << std::setw(20) << "OPCODE" << std::right
+            << std::setw(14) << "COUNT" << std::setw(9) << "COUNT%"
+            << std::setw(16) << "TICKS" << std::setw(9) << "TICKS%"
+            << std::setw(12) << "TICKS/OP" << std::endl;
+        
+        out << std::fixed;
+        
+        for (Opcode opcode: GetSortedOpcodes())
+        {
+            out << std::left << std::setw(20) << OpcodeName(opcode) << std::right
+                << std::setw(14) << counts[opcode]
+                << std::setw(8) << std::setprecision(2) << Percent(counts[opcode], totalCount) << '%'
+                << std::setw(16) << ticks[opcode]
+                << std::setw(8) << std::setprecision(2) << Percent(ticks[opcode], totalTicks) << '%'
+                << std::setw(12) << std::setprecision(1) << static_cast<double>(ticks[opcode]) / counts[opcode]
+                << std::endl;
+        }
+        
+        std::vector<Pair> sortedPairs = GetSortedPairs();
+        if (sortedPairs.size() > topPairs)
+        {
+            sortedPairs.resize(topPairs);
+        }
+        
+        out << std::endl;
+        out << "Top " << sortedPairs.size() << " opcode pairs" << std::endl;
+        out << std::left << std::setw(20) << "FIRST" << std::setw(20) << "SECOND" << std::right
+            << std::setw(14) << "COUNT" << std::setw(9) << "COUNT%" << std::endl;
+        
+        for (const Pair& pair: sortedPairs)
+        {
+            out << std::left << std::setw(20) << OpcodeName(pair.first)
+                << std::setw(20) << OpcodeName(pair.second) << std::right
+                << std::setw(14) << pair.count
+                << std::setw(8) << std::setprecision(2) << Percent(pair.count, totalCount) << '%'
+                << std::endl;
+        }
+        
+        out << std::defaultfloat;
+    }
+    
+    void OpcodeProfiler::WriteCsv(std::ostream& out) const
+    {
+        out << "kind,first,second,count,ticks\n";
+        
+        for (Opcode opcode: GetSortedOpcodes())
+        {
+            out << "opcode," << opcode << ",," << counts[opcode] << ',' << ticks[opcode] << '\n';
+        }
+        
+        for (const Pair& pair: GetSortedPairs())
+        {
+            out << "pair," << pair.first << ',' << pair.second << ',' << pair.count << ",\n";
+        }
+        
+        out.flush();
+    }
+    
+    void OpcodeProfiler::WriteJson(std::ostream& out) const
+    {
+        out << "{\n";
+        out << "  \"clock\": \"" << GetClockName() << "\",\n";
+        out << "  \"instructions\": " << GetTotalCount() << ",\n";
+        out << "  \"opcodes\": [";
+        
+        std::vector<Opcode> sortedOpcodes = GetSortedOpcodes();
+        for (std::size_t i = 0; i < sortedOpcodes.size(); ++i)
+        {
+            Opcode opcode = sortedOpcodes[i];
+            
+            out << (i == 0 ? "\n" : ",\n");
+            out << "    { \"name\": \"" << opcode << "\", \"count\": " << counts[opcode]
+                << ", \"ticks\": " << ticks[opcode] << " }";
+        }
+        
+        out << "\n  ],\n";
+        out << "  \"pairs\": [";
+        
+        std::vector<Pair> sortedPairs = GetSortedPairs();
+        for (std::size_t i = 0; i < sortedPairs.size(); ++i)
+        {
+            const Pair& pair = sortedPairs[i];
+            
+            out << (i == 0 ? "\n" : ",\n");
+            out << "    { \"first\": \"" << pair.first << "\", \"second\": \"" << pair.second
+                << "\", \"count\": " << pair.count << " }";
+        }
+        
+        out << "\n  ]\n";
+        out << "}" << std::endl;
+    }
+    
+    std::vector<Opcode> OpcodeProfiler::GetSortedOpcodes() const
+    {
+        std::vector<Opcode> result;
+        
+        for (std::size_t i = 0; i < OpcodesCount; ++i)
+        {
+            if (counts[i] != 0)
+            {
+                result.push_back(static_cast<Opcode>(i));
+            }
+        }
+        
+        std::stable_sort(result.begin(), result.end(), [this](Opcode a, Opcode b)
+        {
+            return ticks[a] > ticks[b];
+        });
+        
+        return result;
+    }
+    
+    std::vector<OpcodeProfiler::Pair> OpcodeProfiler::GetSortedPairs() const
+    {
+        std::vector<Pair> result;
+        
+        for (std::size_t i = 0; i < pairs.size(); ++i)
+        {
+            if (pairs[i] != 0)
+            {
+                result.push_back(Pair{static_cast<Opcode>(i / OpcodesCount), static_cast<Opcode>(i % OpcodesCount),
+                                      pairs[i]});
+            }
+        }
+        
+        std::stable_sort(result.begin(), result.end(), [](const Pair& a, const Pair& b)
+        {
+            return a.count > b.count;
+        });
+        
+        return result;
+    }
+}
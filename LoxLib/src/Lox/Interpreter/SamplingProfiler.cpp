@@ -0,0 +1,170 @@
+#include "Lox/Interpreter/SamplingProfiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <utility>
+#include <vector>
+
+#include "Lox/Util/Assert.hpp"
+
+namespace Lox
+{
+    SamplingProfiler::SamplingProfiler(std::size_t interval)
+            : interval(interval), countdown(interval), samples(0)
+    {
+        LOX_ASSERT(interval != 0, "Lox::SamplingProfiler zero interval");
+    }
+    
+    static std::string FunctionName(const CallFrame& frame)
+    {
+        GcPtr<const String> name = frame.GetFunction()->GetName();
+        return name.IsNullptr() ? "<script>" : name->GetCppString();
+    }
+    
+    void SamplingProfiler::Sample(const CallFrame* frames, std::size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        
+        std::string stack;
+        std::vector<std::string> seen;
+        
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const CallFrame& frame = frames[i];
+            const Chunk& chunk = frame.GetFunction()->GetChunk();
+            
+            // The outer frames are after their call instruction.
+            bool innermost = i + 1 == count;
+            std::size_t line = chunk.GetCodeLine(innermost ? frame.GetIP() : frame.GetIP() - 1);
+            
+            std::string function = FunctionName(frame);
+            
+            // A recursive function is counted once per sample.
+            if (std::find(seen.begin(), seen.end(), function) == seen.end())
+            {
+                functionsTotal[function]++;
+                seen.push_back(function);
+            }
+            
+            if (innermost)
+            {
+                functionsSelf[function]++;
+            }
+            
+            if (i != 0)
+            {
+                stack += ';';
+            }
+            
+            stack += function;
+            stack += ':';
+            stack += std::to_string(line);
+        }
+        
+        stacks[stack]++;
+        linesSelf[stack.substr(stack.rfind(';') + 1)]++;
+        samples++;
+    }
+    
+    std::size_t SamplingProfiler::GetInterval() const
+    {
+        return interval;
+    }
+    
+    std::uint64_t SamplingProfiler::GetSamplesCount() const
+    {
+        return samples;
+    }
+    
+    static std::uint64_t FindCount(const std::map<std::string, std::uint64_t>& counts, const std::string& key)
+    {
+        auto it = counts.find(key);
+        return it == counts.end() ? 0 : it->second;
+    }
+    
+    std::uint64_t SamplingProfiler::GetStackCount(const std::string& stack) const
+    {
+        return FindCount(stacks, stack);
+    }
+    
+    std::uint64_t SamplingProfiler::GetFunctionTotalCount(const std::string& function) const
+    {
+        return FindCount(functionsTotal, function);
+    }
+    
+    std::uint64_t SamplingProfiler::GetFunctionSelfCount(const std::string& function) const
+    {
+        return FindCount(functionsSelf, function);
+    }
+    
+    static double Percent(std::uint64_t part, std::uint64_t total)
+    {
+        return total == 0 ? 0 : 100.0 * part / total;
+    }
+    
+    /// The `top` entries with the greatest counts, the equal ones are in the order of the keys.
+    static std::vector<std::pair<std::string, std::uint64_t>> GetTop(const std::map<std::string, std::uint64_t>& counts,
+                                                                     std::size_t top)
+    {
+        std::vector<std::pair<std::string, std::uint64_t>> result(counts.begin(), counts.end());
+        
+        std::stable_sort(result.begin(), result.end(), [](const auto& a, const auto& b)
+        {
+            return a.second > b.second;
+        });
+        
+        if (result.size() > top)
+        {
+            result.resize(top);
+        }
+        
+        return result;
+    }
+    
+    void SamplingProfiler::PrintReport(std::ostream& out, std::size_t top) const
+    {
+        out << "Sampling profile, " << samples << " samples every " << interval << " instructions" << std::endl;
+        out << std::left << std::setw(32) << "FUNCTION" << std::right
+            << std::setw(12) << "TOTAL" << std::setw(9) << "TOTAL%"
+            << std::setw(12) << "SELF" << std::setw(9) << "SELF%" << std::endl;
+        
+        out << std::fixed << std::setprecision(2);
+        
+        for (const auto& [function, total]: GetTop(functionsTotal, top))
+        {
+            std::uint64_t self = FindCount(functionsSelf, function);
+            
+            out << std::left << std::setw(32) << function << std::right
+                << std::setw(12) << total
+                << std::setw(8) << Percent(total, samples) << '%'
+                << std::setw(12) << self
+                << std::setw(8) << Percent(self, samples) << '%' << std::endl;
+        }
+        
+        out << std::endl;
+        out << std::left << std::setw(32) << "LINE" << std::right
+            << std::setw(12) << "SELF" << std::setw(9) << "SELF%" << std::endl;
+        
+        for (const auto& [line, self]: GetTop(linesSelf, top))
+        {
+            out << std::left << std::setw(32) << line << std::right
+                << std::setw(12) << self
+                << std::setw(8) << Percent(self, samples) << '%' << std::endl;
+        }
+        
+        out << std::defaultfloat;
+    }
+    
+    void SamplingProfiler::WriteFolded(std::ostream& out) const
+    {
+        for (const auto& [stack, count]: stacks)
+        {
+            out << stack << ' ' << count << '\n';
+        }
+        
+        out.flush();
+    }
+}
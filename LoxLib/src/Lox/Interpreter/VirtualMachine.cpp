@@ -1,6 +1,8 @@
 #include "Lox/Interpreter/VirtualMachine.hpp"
 
+#include <cstddef>
 #include <functional>
+#include <type_traits>
 
 #include "Lox/Configuration.hpp"
 
@@ -9,487 +11,1164 @@
 #include "Lox/Util/Assert.hpp"
 #include "Lox/Util/ChunkDumper.hpp"
 
+#include "Lox/Stages/ChunkChecker.hpp"
+
 #include "Lox/Runtime/Objects/Class.hpp"
 #include "Lox/Runtime/Objects/Instance.hpp"
 #include "Lox/Runtime/Objects/BoundMethod.hpp"
 
+// Threaded dispatch needs labels as values, which is a GNU extension.
+// Other compilers get a plain `switch` loop.
+#ifndef LOX_COMPUTED_GOTO
+    #if defined(__GNUC__) || defined(__clang__)
+        #define LOX_COMPUTED_GOTO 1
+    #else
+        #define LOX_COMPUTED_GOTO 0
+    #endif
+#endif
+
 namespace Lox
 {
     // Public.
     
     VirtualMachine::VirtualMachine(const VirtualMachineConfiguration& conf)
             : conf(conf), memory(*this), initStr(InternString("init")),
-              running(false), openUpvalues(GcPtr<Upvalue>(nullptr)), framesCount(0),
-              stackTop(stack.begin()), opcodesExecTable{}
-    {
-        std::fill(opcodesExecTable.begin(),
-                  opcodesExecTable.end(),
-                  &VirtualMachine::ExecuteUnknownOpcode);
-        
-        #define LOX_OPCODES_FILL_TABLE(name, type, _)   \
-            opcodesExecTable[Opcode##name] = &VirtualMachine::Execute##name;
-        
-        LOX_OPCODES_LIST(LOX_OPCODES_FILL_TABLE);
+              emptyShape(AllocateObject<Shape>()), verifiedOnly(true), executedInstructions(0),
+              undefined(AllocateObject<String>("<undefined>")),
+              openUpvalues(GcPtr<Upvalue>(nullptr)), framesCount(0),
+              stackTop(stack.begin())
+    {
+        memory.SetStressGC(conf.GetStressGC());
+        memory.SetLogGC(conf.GetLogGC());
+        memory.SetIncrementalBudget(conf.GetIncrementalGCBudget());
+        memory.SetMarkingThreads(conf.GetMarkingThreads());
+        memory.SetBackgroundSweeping(conf.GetBackgroundSweeping());
+        
+        if (conf.GetProfileOpcodes())
+        {
+            profiler.emplace();
+        }
         
-        #undef LOX_OPCODES_FILL_TABLE
+        if (conf.GetSampleInterval() != 0)
+        {
+            sampler.emplace(conf.GetSampleInterval());
+        }
     }
     
     void VirtualMachine::RunScript(GcPtr<Closure> func)
     {
-        StackPush(Value(func));
-        CallFramePush(CallFrame(func, StackPeekIterator()));
-        
-        memory.AllowGC();
-        
-        running = true;
-        Run();
-        
-        memory.DisallowGC();
-    }
-    
-    GcPtr<String> VirtualMachine::InternString(std::string_view str)
-    {
-        auto it = strings.find(str);
-        
-        if (it != strings.end())
+        // There is no frame yet, so the errors have no stack trace.
+        std::optional<std::size_t> stackSize = GetMaxStackSize(func);
+        if (!stackSize)
         {
-            return it->second;
+            throw Exceptions::RuntimeException(SourcePosition(0), {}, "malformed bytecode");
         }
         
-        auto obj = AllocateObject<String>(std::string(str));
-        strings[obj->GetCppString()] = obj;
-        return obj;
-    }
-    
-    GcPtr<String> VirtualMachine::InternStringTake(std::string&& str)
-    {
-        auto it = strings.find(str);
-        
-        if (it != strings.end())
+        if (static_cast<std::size_t>(stack.end() - stackTop) <= *stackSize)
         {
-            return it->second;
+            throw Exceptions::StackOverflow(SourcePosition(0), {});
         }
         
-        auto obj = AllocateObject<String>(std::move(str));
-        strings[obj->GetCppString()] = obj;
-        return obj;
-    }
-    
-    void VirtualMachine::DefineNative(std::string_view name, std::size_t arity, NativeFn&& fn)
-    {
-        GcPtr<String> str = InternString(name);
-        globals.emplace(str, AllocateObject<Native>(str, arity, fn));
-    }
-    
-    // Core.
-    
-    void VirtualMachine::Run()
-    {
-        while (running)
+        verifiedOnly = verifiedOnly && ChunkChecker(func->GetChunk()).Check();
+        
+        StackPush(Value(func));
+        CallFramePush(CallFrame(func, StackPeekIterator()));
+        
+        memory.AllowGC();
+        
+        try
         {
-            CallFrame& frame = CallFramePeek();
-            
-            if constexpr (Configuration::TraceExecution)
+            if (conf.GetTraceExecution())
             {
-                TraceExecution(conf.GetDebugOutput());
+                Run<false, true, false>();
             }
-            
-            if (frame.IsAtEnd())
+            else if ((profiler || sampler) && verifiedOnly)
             {
-                // TODO: Maybe error?
-                running = false;
-                break;
+                Run<true, false, true>();
+            }
+            else if (profiler || sampler)
+            {
+                Run<false, false, true>();
+            }
+            else if (verifiedOnly)
+            {
+                Run<true, false, false>();
+            }
+            else
+            {
+                Run<false, false, false>();
             }
-            
-            uint8_t opcode = frame.ReadByte();
-            ExecuteOpcode(opcode);
-        }
-    }
-    
-    // Opcodes.
-    
-    void VirtualMachine::ExecuteOpcode(uint8_t opcode)
-    {
-        OpcodeExecFn fn = opcodesExecTable[opcode];
-        (this->*fn)();
-    }
-    
-    GcPtr<String> VirtualMachine::ReadStringArgument()
-    {
-        return ExtractObject<String>(CallFramePeek().ReadConstant());
-    }
-    
-    void VirtualMachine::ExecuteUnknownOpcode()
-    {
-        uint8_t byte = CallFramePeek().GetPreviousByte();
-        ThrowRuntimeException<Exceptions::UnknownInstruction>(byte);
-    }
-    
-    void VirtualMachine::ExecuteReturn()
-    {
-        Value result = StackPop();
-        
-        // There are some tricks with `CallFramePop`.
-        // The thing is, there could be a problem with the final
-        // stack pop call. We need to save the information of the
-        // script function. So we pop the final call frame after
-        // the stack pop.
-        
-        if (framesCount == 1)
-        {
-            CallFramePop();
-            // Ignoring the result of the script function.
-            running = false;
         }
-        else
+        catch (...)
         {
-            CloseUpvalues(CallFrameTop().GetValues());
-            CallFramePop();
-            StackPush(result);
+            // The compiler allocates objects which are not reachable from the roots.
+            memory.DisallowGC();
+            StopProfiler();
+            throw;
         }
+        
+        memory.DisallowGC();
+        StopProfiler();
     }
     
-    void VirtualMachine::ExecutePushConstant()
-    {
-        Value constant = CallFramePeek().ReadConstant();
-        StackPush(constant);
-    }
-    
-    void VirtualMachine::ExecutePrint()
-    {
-        Value val = StackPop();
-        val.Print(conf.GetUserOutput(), PrintFlags::Pretty) << std::endl;
-    }
-    
-    void VirtualMachine::ExecuteNil()
-    {
-        LiteralPush(NIL);
-    }
-    
-    void VirtualMachine::ExecuteTrue()
-    {
-        LiteralPush(Value(true));
-    }
-    
-    void VirtualMachine::ExecuteFalse()
+    void VirtualMachine::AccountPayload(GcPtr<Object> obj)
     {
-        LiteralPush(Value(false));
+        memory.AccountPayload(obj);
     }
     
-    void VirtualMachine::LiteralPush(Lox::Value val)
+    const MemoryManager& VirtualMachine::GetMemoryManager() const
     {
-        StackPush(val);
+        return memory;
     }
     
-    void VirtualMachine::ExecuteAdd()
+    const VirtualMachineConfiguration& VirtualMachine::GetConfiguration() const
     {
-        BinaryOperation<std::plus<DoubleRepr>>();
+        return conf;
     }
     
-    void VirtualMachine::ExecuteSubstract()
+    std::uint64_t VirtualMachine::GetExecutedInstructionsCount() const
     {
-        BinaryOperation<std::minus<DoubleRepr>>();
+        return executedInstructions;
     }
     
-    void VirtualMachine::ExecuteMultiply()
+    const std::optional<OpcodeProfiler>& VirtualMachine::GetOpcodeProfiler() const
     {
-        BinaryOperation<std::multiplies<DoubleRepr>>();
+        return profiler;
     }
     
-    void VirtualMachine::ExecuteDivide()
+    const std::optional<SamplingProfiler>& VirtualMachine::GetSamplingProfiler() const
     {
-        BinaryOperation<std::divides<DoubleRepr>>();
+        return sampler;
     }
     
-    void VirtualMachine::ExecuteNot()
+    GcPtr<String> VirtualMachine::InternString(std::string_view str)
     {
-        Value val = StackPop();
-        StackPush(Value(val.IsFalse()));
+        std::size_t hash = String::ComputeHash(str);
+        
+        GcPtr<String> interned = strings.FindString(str, hash);
+        if (!interned.IsNullptr())
+        {
+            return interned;
+        }
+        
+        auto obj = AllocateObject<String>(std::string(str), hash);
+        strings.Insert(obj, std::monostate());
+        obj->SetInterned(obj);
+        return obj;
     }
     
-    void VirtualMachine::ExecuteNegate()
+    GcPtr<String> VirtualMachine::InternStringTake(std::string&& str)
     {
-        auto val = ExtractValue<DoubleRepr>(StackPop());
+        std::size_t hash = String::ComputeHash(str);
         
-        Value newVal(-val);
+        GcPtr<String> interned = strings.FindString(str, hash);
+        if (!interned.IsNullptr())
+        {
+            return interned;
+        }
         
-        StackPush(newVal);
+        auto obj = AllocateObject<String>(std::move(str), hash);
+        strings.Insert(obj, std::monostate());
+        obj->SetInterned(obj);
+        return obj;
     }
     
-    void VirtualMachine::ExecuteEqual()
+    GcPtr<String> VirtualMachine::InternString(GcPtr<String> str)
     {
-        Value b = StackPop();
-        Value a = StackPop();
+        GcPtr<String> interned = str->GetInterned();
+        if (!interned.IsNullptr())
+        {
+            return interned;
+        }
+        
+        interned = strings.FindString(str->GetView(), str->GetHash());
+        if (interned.IsNullptr())
+        {
+            interned = str;
+            strings.Insert(str, std::monostate());
+        }
+        
+        str->SetInterned(interned);
+        memory.WriteBarrier(str, interned);
         
-        StackPush(Value(a == b));
+        return interned;
     }
     
-    void VirtualMachine::ExecuteGreater()
+    void VirtualMachine::DefineNative(std::string_view name, std::size_t arity, NativeFn&& fn)
     {
-        BinaryOperation<std::greater<DoubleRepr>>();
+        GcPtr<String> str = InternString(name);
+        std::size_t slot = GetGlobalSlot(str);
+        globals[slot] = Value(AllocateObject<Native>(str, arity, fn));
     }
     
-    void VirtualMachine::ExecuteLess()
+    std::size_t VirtualMachine::GetGlobalSlot(GcPtr<String> name)
     {
-        BinaryOperation<std::less<DoubleRepr>>();
+        if (std::size_t* slot = globalSlots.Find(name))
+        {
+            return *slot;
+        }
+        
+        std::size_t slot = globals.size();
+        
+        globals.push_back(undefined);
+        globalNames.push_back(name);
+        globalSlots.Insert(name, slot);
+        
+        return slot;
     }
     
-    void VirtualMachine::ExecutePop()
-    {
-        StackPop();
-    }
+    // Core.
     
-    void VirtualMachine::ExecuteDefineGlobal()
+    template <bool Verified, bool Debug, bool Profile>
+    void VirtualMachine::Run()
     {
-        // We can pop the value from the stack, because resizing the unordered map does not trigger the GC.
-        Value val = StackPop();
-        GcPtr<String> str = ReadStringArgument();
+        // The hot state of the interpreter lives in locals for the whole loop, so the compiler
+        // can keep it in registers. It is written back to the `CallFrame` and `stackTop` only
+        // before the code that can observe it: calls, allocations (GC) and runtime exceptions.
+        
+        CallFrame* frame;
+        Chunk* chunk;
+        Chunk::CodeIterator ip;
+        StackIterator slots;
+        StackIterator sp;
+        std::uint64_t instructions = executedInstructions;
+        
+        #define LOX_SAVE_STATE()                                                                \
+            (frame->SetIP(ip), stackTop = sp, executedInstructions = instructions)
+        
+        #define LOX_LOAD_STATE()                                                                \
+            do                                                                                  \
+            {                                                                                   \
+                frame = &CallFramePeek();                                                       \
+                chunk = &frame->GetFunction()->GetChunk();                                      \
+                ip = frame->GetIP();                                                            \
+                slots = frame->GetValues();                                                     \
+                sp = stackTop;                                                                  \
+            } while (false)
+        
+        #define LOX_READ_BYTE()                                                                 \
+            (*ip++)
+        
+        #define LOX_READ_SHORT()                                                                \
+            (ip += 2, static_cast<uint16_t>((ip[-2] << 8) | ip[-1]))
+        
+        // The constant indices of verified code are in bounds, otherwise they are checked.
+        #define LOX_READ_CONSTANT()                                                             \
+            ((Verified || chunk->HasConstant(*ip))                                              \
+                 ? static_cast<void>(0)                                                         \
+                 : (LOX_SAVE_STATE(),                                                           \
+                    ThrowRuntimeException<Exceptions::RuntimeException>(                        \
+                        "invalid constant index")),                                             \
+             chunk->GetConstant(LOX_READ_BYTE()))
+        
+        // Names of verified code are strings. The state is saved anyway: the instructions
+        // with names allocate, and the GC needs the current `stackTop`.
+        #define LOX_READ_STRING()                                                               \
+            (LOX_SAVE_STATE(), Verified ? LOX_READ_CONSTANT().template AsObject<String>()       \
+                                        : ExtractObject<String>(LOX_READ_CONSTANT()))
+        
+        // The cache of the instruction, whose name constant is read last (and so checked).
+        #define LOX_INLINE_CACHE()                                                              \
+            (chunk->GetInlineCache(ip[-1]))
+        
+        // The stack space of the frame is checked once in `CallFunction`
+        // (see `Chunk::GetMaxStackSize`), so pushes are unchecked. The value is evaluated
+        // before `sp` moves, as it can save the state.
+        #define LOX_PUSH(val)                                                                   \
+            do                                                                                  \
+            {                                                                                   \
+                LOX_ASSERT(sp < stack.end(), "Lox::VirtualMachine stack overflow");             \
+                Value pushedValue = (val);                                                      \
+                *sp++ = pushedValue;                                                            \
+            } while (false)
+        
+        #define LOX_POP()                                                                       \
+            (*--sp)
+        
+        #define LOX_PEEK(offset)                                                                \
+            (sp[-1 - (offset)])
+        
+        // `LOX_POP` and `LOX_PEEK` are unchecked, so an instruction that consumes values
+        // from the stack checks that they are there before touching them. The stack of
+        // verified code never goes below the frame, as well as locals and upvalues are in bounds.
+        #define LOX_REQUIRE_STACK(count)                                                        \
+            do                                                                                  \
+            {                                                                                   \
+                if (!Verified && sp - stack.begin() < static_cast<std::ptrdiff_t>(count))       \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    ThrowRuntimeException<Exceptions::StackUnderflow>();                        \
+                }                                                                               \
+            } while (false)
+        
+        #define LOX_CHECK_SLOT(index)                                                           \
+            do                                                                                  \
+            {                                                                                   \
+                if (!Verified && slots + (index) >= stack.end())                                \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    ThrowRuntimeException<Exceptions::InvalidStackAccess>();                    \
+                }                                                                               \
+            } while (false)
+        
+        #define LOX_CHECK_GLOBAL(slot)                                                          \
+            do                                                                                  \
+            {                                                                                   \
+                if ((slot) >= globals.size())                                                   \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    ThrowRuntimeException<Exceptions::RuntimeException>("invalid global slot"); \
+                }                                                                               \
+            } while (false)
+        
+        // The slot of an undefined variable holds the `undefined` sentinel.
+        #define LOX_CHECK_GLOBAL_DEFINED(slot)                                                  \
+            do                                                                                  \
+            {                                                                                   \
+                if (globals[slot] == undefined)                                                 \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    ThrowRuntimeException<Exceptions::UndefinedVariable>(globalNames[slot]);    \
+                }                                                                               \
+            } while (false)
+        
+        #define LOX_CHECK_UPVALUE(func, index)                                                  \
+            do                                                                                  \
+            {                                                                                   \
+                if (!Verified && !(func)->HasUpvalue(index))                                    \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    ThrowRuntimeException<Exceptions::RuntimeException>("invalid upvalue index"); \
+                }                                                                               \
+            } while (false)
+        
+        // `onDoubles` runs when both operands are numbers, it is the quickening.
+        #define LOX_BINARY_OPERATION(BinOp, onDoubles)                                          \
+            do                                                                                  \
+            {                                                                                   \
+                LOX_REQUIRE_STACK(2);                                                           \
+                Value b = LOX_PEEK(0);                                                          \
+                Value a = LOX_PEEK(1);                                                          \
+                if (a.IsDouble() && b.IsDouble()                                                \
+                    && (!std::is_same_v<BinOp, std::divides<DoubleRepr>> || b.AsDouble() != 0)) \
+                {                                                                               \
+                    onDoubles;                                                                  \
+                    LOX_PEEK(1) = Value(BinOp{}(a.AsDouble(), b.AsDouble()));                   \
+                }                                                                               \
+                else                                                                            \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    LOX_PEEK(1) = BinaryOperation<BinOp>(a, b);                                 \
+                }                                                                               \
+                --sp;                                                                           \
+            } while (false)
+        
+        // Different pointers can still be equal strings, unless both are interned.
+        #define LOX_EQUAL()                                                                     \
+            do                                                                                  \
+            {                                                                                   \
+                LOX_REQUIRE_STACK(2);                                                           \
+                Value b = LOX_POP();                                                            \
+                Value a = LOX_PEEK(0);                                                          \
+                bool equal = a == b;                                                            \
+                if (!equal && a.IsObject<String>() && b.IsObject<String>())                     \
+                {                                                                               \
+                    GcPtr<String> str1 = a.AsObject<String>();                                  \
+                    GcPtr<String> str2 = b.AsObject<String>();                                  \
+                    if (str1->GetInterned() != str1 || str2->GetInterned() != str2)             \
+                    {                                                                           \
+                        equal = StringsEqual(str1, str2);                                       \
+                    }                                                                           \
+                }                                                                               \
+                LOX_PEEK(0) = Value(equal);                                                     \
+            } while (false)
+        
+        // A superinstruction does the work of its fused instructions (see `ChunkFuser`)
+        // with one dispatch: it runs the first one and jumps to the code of the next one
+        // (to the quickened code, which falls back by itself), or does them all in place.
+        // The opcodes of the fused instructions are skipped, verified code has them (maybe
+        // quickened), otherwise they are checked.
+        #define LOX_SKIP_FUSED(opcode)                                                          \
+            do                                                                                  \
+            {                                                                                   \
+                if (!Verified && (ip == chunk->CodeEnd()                                        \
+                    || GetBaseOpcode(static_cast<Opcode>(*ip)) != (opcode)                      \
+                    || !ChunkChecker::GetInstructionSize(*chunk, ip - chunk->CodeBegin())))     \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    ThrowRuntimeException<Exceptions::RuntimeException>("malformed superinstruction"); \
+                }                                                                               \
+                ++ip;                                                                           \
+            } while (false)
+        
+        // Quickening: rewrite the opcode of the current instruction, after `read` bytes of its
+        // operands were read. A quickened instruction checks its guard before reading the
+        // operands, and when it fails, it goes back to the generic instruction (and code).
+        #define LOX_QUICKEN(opcode, read)                                                       \
+            chunk->QuickenCode(ip - chunk->CodeBegin() - 1 - (read), (opcode))
+        
+        #define LOX_DOUBLE_BINARY_OPERATION(BinOp, generic)                                     \
+            do                                                                                  \
+            {                                                                                   \
+                LOX_REQUIRE_STACK(2);                                                           \
+                Value b = LOX_PEEK(0);                                                          \
+                Value a = LOX_PEEK(1);                                                          \
+                if (!a.IsDouble() || !b.IsDouble())                                             \
+                {                                                                               \
+                    LOX_QUICKEN(generic, 0);                                                    \
+                    goto generic##Label;                                                        \
+                }                                                                               \
+                LOX_PEEK(1) = Value(BinOp{}(a.AsDouble(), b.AsDouble()));                       \
+                --sp;                                                                           \
+            } while (false)
+        
+        // Every instruction ends with `LOX_DISPATCH`, which fetches and jumps to the next one.
+        // With labels as values each instruction has its own indirect jump, so the branch
+        // predictor sees every opcode transition separately.
+        
+        #define LOX_DISPATCH_PROLOGUE()                                                         \
+            do                                                                                  \
+            {                                                                                   \
+                ++instructions;                                                                 \
+                                                                                                \
+                if constexpr (Configuration::DebugMode && !Verified)                            \
+                {                                                                               \
+                    LOX_ASSERT(ip != chunk->CodeEnd(), "Lox::VirtualMachine reading past the chunk"); \
+                }                                                                               \
+                                                                                                \
+                if constexpr (Debug)                                                            \
+                {                                                                               \
+                    LOX_SAVE_STATE();                                                           \
+                    TraceExecution(conf.GetDebugOutput());                                      \
+                }                                                                               \
+                                                                                                \
+                if constexpr (Profile)                                                          \
+                {                                                                               \
+                    if (profiler && (Verified || *ip < OpcodesCount))                           \
+                    {                                                                           \
+                        profiler->Record(static_cast<Opcode>(*ip));                             \
+                    }                                                                           \
+                                                                                                \
+                    if (sampler && sampler->Tick())                                             \
+                    {                                                                           \
+                        LOX_SAVE_STATE();                                                       \
+                        sampler->Sample(frames.data(), framesCount);                            \
+                    }                                                                           \
+                }                                                                               \
+            } while (false)
+        
+        #if LOX_COMPUTED_GOTO
+            #define LOX_DISPATCH()                                                              \
+                do                                                                              \
+                {                                                                               \
+                    LOX_DISPATCH_PROLOGUE();                                                    \
+                    goto *dispatchTable[LOX_READ_BYTE()];                                       \
+                } while (false)
+            
+            #define LOX_OPCODE(name)                                                            \
+                Opcode##name##Label:
+            
+            #define LOX_UNKNOWN_OPCODE()                                                        \
+                UnknownOpcodeLabel:
+            
+            // The table is filled on each entry to `Run`, because label addresses
+            // are only available inside the function.
+            std::array<void*, UINT8_MAX + 1> dispatchTable;
+            dispatchTable.fill(&&UnknownOpcodeLabel);
+            
+            #define LOX_DISPATCH_TABLE_FILL(name, type, _)                                      \
+                dispatchTable[Opcode##name] = &&Opcode##name##Label;
+            
+            LOX_OPCODES_LIST(LOX_DISPATCH_TABLE_FILL);
+            
+            #undef LOX_DISPATCH_TABLE_FILL
+        #else
+            #define LOX_DISPATCH()                                                              \
+                continue
+            
+            // The labels are the targets of superinstructions and quickened instructions.
+            #define LOX_OPCODE(name)                                                            \
+                case Opcode##name: [[maybe_unused]] Opcode##name##Label:
+            
+            #define LOX_UNKNOWN_OPCODE()                                                        \
+                default:
+        #endif
         
-        globals.emplace(str, val);
-    }
-    
-    void VirtualMachine::ExecuteGetGlobal()
-    {
-        GcPtr<String> str = ReadStringArgument();
+        LOX_LOAD_STATE();
+        
+        #if LOX_COMPUTED_GOTO
+            LOX_DISPATCH();
+        #else
+        while (true)
+        {
+            LOX_DISPATCH_PROLOGUE();
+            
+            switch (LOX_READ_BYTE())
+            {
+        #endif
         
-        auto it = globals.find(str);
-        if (it != globals.end())
+        LOX_OPCODE(PushConstant)
         {
-            Value val = it->second;
-            StackPush(val);
+            LOX_PUSH(LOX_READ_CONSTANT());
+            LOX_DISPATCH();
         }
-        else
+        
+        LOX_OPCODE(Print)
         {
-            ThrowRuntimeException<Exceptions::UndefinedVariable>(str);
+            LOX_REQUIRE_STACK(1);
+            LOX_POP().Print(conf.GetUserOutput(), PrintFlags::Pretty) << std::endl;
+            LOX_DISPATCH();
         }
-    }
-    
-    void VirtualMachine::ExecuteSetGlobal()
-    {
-        GcPtr<String> str = ReadStringArgument();
         
-        Value val = StackPeek();
+        LOX_OPCODE(Add)
+        {
+            LOX_BINARY_OPERATION(std::plus<DoubleRepr>, LOX_QUICKEN(OpcodeAddDouble, 0));
+            LOX_DISPATCH();
+        }
         
-        auto it = globals.find(str);
-        if (it != globals.end())
+        LOX_OPCODE(Substract)
         {
-            it->second = val;
+            LOX_BINARY_OPERATION(std::minus<DoubleRepr>, LOX_QUICKEN(OpcodeSubstractDouble, 0));
+            LOX_DISPATCH();
         }
-        else
+        
+        LOX_OPCODE(Multiply)
         {
-            ThrowRuntimeException<Exceptions::UndefinedVariable>(str);
+            LOX_BINARY_OPERATION(std::multiplies<DoubleRepr>, LOX_QUICKEN(OpcodeMultiplyDouble, 0));
+            LOX_DISPATCH();
         }
-    }
-    
-    void VirtualMachine::ExecuteGetLocal()
-    {
-        uint8_t offset = CallFramePeek().ReadByte();
         
-        StackPush(StackGet(offset));
-    }
-    
-    void VirtualMachine::ExecuteSetLocal()
-    {
-        uint8_t offset = CallFramePeek().ReadByte();
+        LOX_OPCODE(Divide)
+        {
+            LOX_BINARY_OPERATION(std::divides<DoubleRepr>, );
+            LOX_DISPATCH();
+        }
         
-        StackSet(offset, StackPeek());
-    }
-    
-    void VirtualMachine::ExecuteJump()
-    {
-        uint16_t jump = CallFramePeek().ReadShort();
+        LOX_OPCODE(Return)
+        {
+            LOX_REQUIRE_STACK(1);
+            Value result = LOX_POP();
+            
+            LOX_SAVE_STATE();
+            
+            // There are some tricks with `CallFramePop`.
+            // The thing is, there could be a problem with the final
+            // stack pop call. We need to save the information of the
+            // script function. So we pop the final call frame after
+            // the stack pop.
+            
+            if (framesCount == 1)
+            {
+                CallFramePop();
+                // Ignoring the result of the script function.
+                return;
+            }
+            
+            CloseUpvalues(slots);
+            CallFramePop();
+            
+            LOX_LOAD_STATE();
+            LOX_PUSH(result);
+            LOX_DISPATCH();
+        }
         
-        CallFramePeek().Jump(jump);
-    }
-    
-    void VirtualMachine::ExecuteJumpIfFalse()
-    {
-        uint16_t jump = CallFramePeek().ReadShort();
+        LOX_OPCODE(Nil)
+        {
+            LOX_PUSH(NIL);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(True)
+        {
+            LOX_PUSH(Value(true));
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(False)
+        {
+            LOX_PUSH(Value(false));
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Greater)
+        {
+            LOX_BINARY_OPERATION(std::greater<DoubleRepr>, LOX_QUICKEN(OpcodeGreaterDouble, 0));
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Less)
+        {
+            LOX_BINARY_OPERATION(std::less<DoubleRepr>, LOX_QUICKEN(OpcodeLessDouble, 0));
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Not)
+        {
+            LOX_REQUIRE_STACK(1);
+            LOX_PEEK(0) = Value(LOX_PEEK(0).IsFalse());
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Negate)
+        {
+            LOX_REQUIRE_STACK(1);
+            
+            if (!LOX_PEEK(0).IsDouble())
+            {
+                LOX_SAVE_STATE();
+                ExtractValue<DoubleRepr>(LOX_PEEK(0));
+            }
+            
+            LOX_PEEK(0) = Value(-LOX_PEEK(0).AsDouble());
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Equal)
+        {
+            LOX_EQUAL();
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Pop)
+        {
+            LOX_REQUIRE_STACK(1);
+            --sp;
+            LOX_DISPATCH();
+        }
+        
+        // The compiler emits `*GlobalSlot` opcodes, these ones resolve the name at runtime.
+        
+        LOX_OPCODE(DefineGlobal)
+        {
+            LOX_REQUIRE_STACK(1);
+            std::size_t slot = GetGlobalSlot(LOX_READ_STRING());
+            
+            globals[slot] = LOX_POP();
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(GetGlobal)
+        {
+            std::size_t slot = GetGlobalSlot(LOX_READ_STRING());
+            LOX_CHECK_GLOBAL_DEFINED(slot);
+            
+            LOX_PUSH(globals[slot]);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(SetGlobal)
+        {
+            LOX_REQUIRE_STACK(1);
+            std::size_t slot = GetGlobalSlot(LOX_READ_STRING());
+            LOX_CHECK_GLOBAL_DEFINED(slot);
+            
+            globals[slot] = LOX_PEEK(0);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(DefineGlobalSlot)
+        {
+            LOX_REQUIRE_STACK(1);
+            uint16_t slot = LOX_READ_SHORT();
+            LOX_CHECK_GLOBAL(slot);
+            
+            globals[slot] = LOX_POP();
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(GetGlobalSlot)
+        {
+            uint16_t slot = LOX_READ_SHORT();
+            LOX_CHECK_GLOBAL(slot);
+            LOX_CHECK_GLOBAL_DEFINED(slot);
+            
+            LOX_PUSH(globals[slot]);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(SetGlobalSlot)
+        {
+            LOX_REQUIRE_STACK(1);
+            uint16_t slot = LOX_READ_SHORT();
+            LOX_CHECK_GLOBAL(slot);
+            LOX_CHECK_GLOBAL_DEFINED(slot);
+            
+            globals[slot] = LOX_PEEK(0);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(GetLocal)
+        {
+            uint8_t index = LOX_READ_BYTE();
+            LOX_CHECK_SLOT(index);
+            LOX_PUSH(slots[index]);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(SetLocal)
+        {
+            uint8_t index = LOX_READ_BYTE();
+            LOX_CHECK_SLOT(index);
+            LOX_REQUIRE_STACK(1);
+            slots[index] = LOX_PEEK(0);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Jump)
+        {
+            uint16_t offset = LOX_READ_SHORT();
+            ip += offset;
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(JumpIfFalse)
+        {
+            uint16_t offset = LOX_READ_SHORT();
+            LOX_REQUIRE_STACK(1);
+            
+            if (LOX_PEEK(0).IsFalse())
+            {
+                ip += offset;
+            }
+            
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Loop)
+        {
+            uint16_t offset = LOX_READ_SHORT();
+            ip -= offset;
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Call)
+        {
+            uint8_t argCount = LOX_READ_BYTE();
+            LOX_REQUIRE_STACK(argCount + 1);
+            
+            if (LOX_PEEK(argCount).IsObject<Closure>())
+            {
+                LOX_QUICKEN(OpcodeCallClosure, 1);
+            }
+            
+            LOX_SAVE_STATE();
+            CallValue(LOX_PEEK(argCount), argCount);
+            LOX_LOAD_STATE();
+            
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(GetUpvalue)
+        {
+            uint8_t index = LOX_READ_BYTE();
+            GcPtr<Closure> func = frame->GetFunction();
+            
+            LOX_CHECK_UPVALUE(func, index);
+            
+            LOX_PUSH(func->GetUpvalue(index)->GetValue());
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(SetUpvalue)
+        {
+            uint8_t index = LOX_READ_BYTE();
+            GcPtr<Closure> func = frame->GetFunction();
+            
+            LOX_CHECK_UPVALUE(func, index);
+            LOX_REQUIRE_STACK(1);
+            
+            GcPtr<Upvalue> upvalue = func->GetUpvalue(index);
+            upvalue->SetUpvalue(LOX_PEEK(0));
+            memory.WriteBarrier(upvalue, LOX_PEEK(0));
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(FillUpvalues)
+        {
+            LOX_REQUIRE_STACK(1);
+            LOX_SAVE_STATE();
+            
+            GcPtr<Closure> func = ExtractObject<Closure>(LOX_PEEK(0));
+            GcPtr<Closure> enclosing = frame->GetFunction();
+            
+            uint8_t count = LOX_READ_BYTE();
+            
+            for (int i = 0; i < count; ++i)
+            {
+                uint8_t isLocal = LOX_READ_BYTE();
+                uint8_t index = LOX_READ_BYTE();
+                
+                if (isLocal)
+                {
+                    // `AddLocalUpvalue` allocates, the closure is safe on the stack.
+                    GcPtr<Upvalue> upvalue = AddLocalUpvalue(slots + index);
+                    func->AddUpValue(upvalue);
+                    memory.WriteBarrier(func, upvalue);
+                }
+                else
+                {
+                    LOX_CHECK_UPVALUE(enclosing, index);
+                    GcPtr<Upvalue> upvalue = enclosing->GetUpvalue(index);
+                    func->AddUpValue(upvalue);
+                    memory.WriteBarrier(func, upvalue);
+                }
+            }
+            
+            memory.AccountPayload(func);
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(CloseUpvalue)
+        {
+            LOX_REQUIRE_STACK(1);
+            CloseUpvalues(sp - 1);
+            --sp;
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Class)
+        {
+            GcPtr<String> name = LOX_READ_STRING();
+            
+            auto klass = AllocateObject<Class>(name);
+            
+            LOX_PUSH(Value(klass));
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(GetProperty)
+        {
+            GcPtr<String> name = LOX_READ_STRING();
+            InlineCache& cache = LOX_INLINE_CACHE();
+            LOX_REQUIRE_STACK(1);
+            
+            auto obj = ExtractObject<Instance>(LOX_PEEK(0));
+            
+            std::optional<Value> field = GetField(obj, name, cache);
+            
+            if (field)
+            {
+                // Fields of the overflow dictionary are not cached.
+                if (cache.LookupFieldSlot(obj->GetShape()))
+                {
+                    LOX_QUICKEN(OpcodeGetPropertyField, 1);
+                }
+                
+                LOX_PEEK(0) = *field;
+            }
+            else
+            {
+                // The instance stays on the stack while the bound method is allocated.
+                LOX_PEEK(0) = Value(BindMethod(obj->GetClass(), name, obj, cache));
+            }
+            
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(SetProperty)
+        {
+            GcPtr<String> name = LOX_READ_STRING();
+            InlineCache& cache = LOX_INLINE_CACHE();
+            LOX_REQUIRE_STACK(2);
+            
+            auto obj = ExtractObject<Instance>(LOX_PEEK(1));
+            
+            // A new field may allocate a shape, both operands stay on the stack.
+            SetField(obj, name, LOX_PEEK(0), cache);
+            memory.WriteBarrier(obj, LOX_PEEK(0));
+            
+            Value val = LOX_POP();
+            LOX_PEEK(0) = val;
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Method)
+        {
+            GcPtr<String> name = LOX_READ_STRING();
+            LOX_REQUIRE_STACK(2);
+            
+            auto method = ExtractObject<Closure>(LOX_PEEK(0));
+            auto klass = ExtractObject<Class>(LOX_PEEK(1));
+            
+            klass->AddMethod(name, method);
+            memory.WriteBarrier(klass, name);
+            memory.WriteBarrier(klass, method);
+            
+            --sp;
+            LOX_DISPATCH();
+        }
+        
+        LOX_OPCODE(Invoke)
+        {
+            uint8_t argCount = LOX_READ_BYTE();
+            GcPtr<String> name = LOX_READ_STRING();
+            InlineCache& cache = LOX_INLINE_CACHE();
+            LOX_REQUIRE_STACK(argCount + 1);
+            
+            auto obj = ExtractObject<Instance>(LOX_PEEK(argCount));
+            
+            LOX_SAVE_STATE();
+            Invoke(obj, name, argCount, cache);
+            LOX_LOAD_STATE();
+            
+            LOX_DISPATCH();
+        }
         
-        if (StackPeek().IsFalse())
+        LOX_OPCODE(Inherit)
         {
-            CallFramePeek().Jump(jump);
+            LOX_REQUIRE_STACK(2);
+            LOX_SAVE_STATE();
+            
+            auto to = ExtractObject<Class>(LOX_PEEK(0));
+            auto from = ExtractObject<Class>(LOX_PEEK(1));
+            
+            to->Inherit(from);
+            memory.WriteBarrier(to);
+            
+            --sp;
+            LOX_DISPATCH();
         }
-    }
-    
-    void VirtualMachine::ExecuteLoop()
-    {
-        uint16_t jump = CallFramePeek().ReadShort();
-        
-        CallFramePeek().Jump(-jump);
-    }
-    
-    void VirtualMachine::ExecuteCall()
-    {
-        uint8_t argCount = CallFramePeek().ReadByte();
-        
-        CallValue(StackPeek(argCount), argCount);
-    }
-    
-    void VirtualMachine::ExecuteGetUpvalue()
-    {
-        CallFrame& frame = CallFramePeek();
-        GcPtr<Closure> func = frame.GetFunction();
         
-        uint8_t index = frame.ReadByte();
-        
-        if (!func->HasUpvalue(index))
+        LOX_OPCODE(GetSuper)
         {
-            ThrowRuntimeException<Exceptions::RuntimeException>("invalid upvalue index");
+            GcPtr<String> name = LOX_READ_STRING();
+            InlineCache& cache = LOX_INLINE_CACHE();
+            LOX_REQUIRE_STACK(2);
+            
+            auto thisObj = ExtractObject<Instance>(LOX_PEEK(1));
+            auto superObj = ExtractObject<Class>(LOX_PEEK(0));
+            
+            // Both objects stay on the stack while the bound method is allocated.
+            GcPtr<BoundMethod> bound = BindMethod(superObj, name, thisObj, cache);
+            
+            --sp;
+            LOX_PEEK(0) = Value(bound);
+            LOX_DISPATCH();
         }
         
-        StackPush(frame.GetFunction()->GetUpvalue(index)->GetValue());
-    }
-    
-    void VirtualMachine::ExecuteSetUpvalue()
-    {
-        CallFrame& frame = CallFramePeek();
-        GcPtr<Closure> func = frame.GetFunction();
+        LOX_OPCODE(InvokeSuper)
+        {
+            uint8_t argCount = LOX_READ_BYTE();
+            GcPtr<String> name = LOX_READ_STRING();
+            InlineCache& cache = LOX_INLINE_CACHE();
+            LOX_REQUIRE_STACK(argCount + 2);
+            
+            GcPtr<Class> super = ExtractObject<Class>(LOX_POP());
+            
+            LOX_SAVE_STATE();
+            InvokeFromClass(super, name, argCount, cache);
+            LOX_LOAD_STATE();
+            
+            LOX_DISPATCH();
+        }
         
-        uint8_t index = frame.ReadByte();
+        // Superinstructions.
         
-        if (!func->HasUpvalue(index))
+        LOX_OPCODE(GetLocalProperty)
         {
-            ThrowRuntimeException<Exceptions::RuntimeException>("invalid upvalue index");
+            uint8_t index = LOX_READ_BYTE();
+            LOX_CHECK_SLOT(index);
+            LOX_PUSH(slots[index]);
+            
+            LOX_SKIP_FUSED(OpcodeGetProperty);
+            goto OpcodeGetPropertyFieldLabel;
         }
         
-        func->GetUpvalue(index)->SetUpvalue(StackPeek());
-    }
-    
-    void VirtualMachine::ExecuteFillUpvalues()
-    {
-        CallFrame& frame = CallFramePeek();
+        LOX_OPCODE(GetLocalLocal)
+        {
+            uint8_t index = LOX_READ_BYTE();
+            LOX_CHECK_SLOT(index);
+            LOX_PUSH(slots[index]);
+            
+            LOX_SKIP_FUSED(OpcodeGetLocal);
+            goto OpcodeGetLocalLabel;
+        }
         
-        GcPtr<Closure> func = ExtractObject<Closure>(StackPeek());
+        LOX_OPCODE(AddConstant)
+        {
+            LOX_PUSH(LOX_READ_CONSTANT());
+            LOX_SKIP_FUSED(OpcodeAdd);
+            goto OpcodeAddDoubleLabel;
+        }
         
-        uint8_t count = frame.ReadByte();
+        LOX_OPCODE(LessConstant)
+        {
+            LOX_PUSH(LOX_READ_CONSTANT());
+            LOX_SKIP_FUSED(OpcodeLess);
+            goto OpcodeLessDoubleLabel;
+        }
         
-        for (int i = 0; i < count; ++i)
+        // The `Opcode::Pop` runs only when it does not jump.
+        LOX_OPCODE(JumpIfFalsePop)
         {
-            uint8_t isLocal = frame.ReadByte();
-            uint8_t index = frame.ReadByte();
+            uint16_t offset = LOX_READ_SHORT();
+            LOX_REQUIRE_STACK(1);
             
-            if (isLocal)
+            if (LOX_PEEK(0).IsFalse())
             {
-                auto it = frame.GetValues() + index;
-                func->AddUpValue(AddLocalUpvalue(it));
+                ip += offset;
             }
             else
             {
-                GcPtr<Closure> parent = CallFramePeek(1).GetFunction();
-                
-                if (!parent->HasUpvalue(index))
-                {
-                    ThrowRuntimeException<Exceptions::RuntimeException>("invalid upvalue index");
-                }
-                
-                func->AddUpValue(func->GetUpvalue(index));
+                LOX_SKIP_FUSED(OpcodePop);
+                --sp;
             }
+            
+            LOX_DISPATCH();
         }
-    }
-    
-    void VirtualMachine::ExecuteCloseUpvalue()
-    {
-        CloseUpvalues(StackPeekIterator());
-        StackPop();
-    }
-    
-    void VirtualMachine::ExecuteClass()
-    {
-        GcPtr<String> name = ReadStringArgument();
-        
-        auto obj = AllocateObject<Class>(name);
-        
-        StackPush(Value(obj));
-    }
-    
-    void VirtualMachine::ExecuteGetProperty()
-    {
-        GcPtr<String> name = ReadStringArgument();
-        
-        auto obj = ExtractObject<Instance>(StackPeek());
         
-        std::optional<Value> field = obj->GetField(name);
-        
-        if (field)
+        LOX_OPCODE(SetLocalPop)
         {
-            StackPop();
-            StackPush(*field);
-            return;
+            uint8_t index = LOX_READ_BYTE();
+            LOX_CHECK_SLOT(index);
+            LOX_REQUIRE_STACK(1);
+            LOX_SKIP_FUSED(OpcodePop);
+            
+            slots[index] = LOX_POP();
+            LOX_DISPATCH();
         }
         
-        GcPtr<BoundMethod> bound = BindMethod(obj->GetClass(), name, obj);
-        
-        StackPop();
-        StackPush(Value(bound));
-    }
-    
-    void VirtualMachine::ExecuteSetProperty()
-    {
-        GcPtr<String> name = ReadStringArgument();
-        
-        auto obj = ExtractObject<Instance>(StackPeek(1));
-        
-        obj->SetField(name, StackPeek());
-        
-        Value val = StackPop();
-        StackPop();
-        StackPush(val);
-    }
-    
-    void VirtualMachine::ExecuteMethod()
-    {
-        GcPtr<String> name = ReadStringArgument();
+        LOX_OPCODE(SetGlobalSlotPop)
+        {
+            LOX_REQUIRE_STACK(1);
+            uint16_t slot = LOX_READ_SHORT();
+            LOX_CHECK_GLOBAL(slot);
+            LOX_CHECK_GLOBAL_DEFINED(slot);
+            LOX_SKIP_FUSED(OpcodePop);
+            
+            globals[slot] = LOX_POP();
+            LOX_DISPATCH();
+        }
         
-        auto method = ExtractObject<Closure>(StackPop());
-        auto klass = ExtractObject<Class>(StackPeek());
+        LOX_OPCODE(LessJumpIfFalse)
+        {
+            LOX_BINARY_OPERATION(std::less<DoubleRepr>, );
+            LOX_SKIP_FUSED(OpcodeJumpIfFalse);
+            goto OpcodeJumpIfFalsePopLabel;
+        }
         
-        klass->AddMethod(name, method);
-    }
-    
-    void VirtualMachine::ExecuteInvoke()
-    {
-        uint8_t argCount = CallFramePeek().ReadByte();
+        LOX_OPCODE(EqualJumpIfFalse)
+        {
+            LOX_EQUAL();
+            LOX_SKIP_FUSED(OpcodeJumpIfFalse);
+            goto OpcodeJumpIfFalsePopLabel;
+        }
         
-        GcPtr<String> name = ReadStringArgument();
+        // Quickened instructions.
         
-        auto obj = ExtractObject<Instance>(StackPeek(argCount));
+        LOX_OPCODE(AddDouble)
+        {
+            LOX_DOUBLE_BINARY_OPERATION(std::plus<DoubleRepr>, OpcodeAdd);
+            LOX_DISPATCH();
+        }
         
-        Invoke(obj, name, argCount);
-    }
-    
-    void VirtualMachine::ExecuteInherit()
-    {
-        auto to = ExtractObject<Class>(StackPeek());
-        auto from = ExtractObject<Class>(StackPeek(1));
+        LOX_OPCODE(SubstractDouble)
+        {
+            LOX_DOUBLE_BINARY_OPERATION(std::minus<DoubleRepr>, OpcodeSubstract);
+            LOX_DISPATCH();
+        }
         
-        to->Inherit(from);
+        LOX_OPCODE(MultiplyDouble)
+        {
+            LOX_DOUBLE_BINARY_OPERATION(std::multiplies<DoubleRepr>, OpcodeMultiply);
+            LOX_DISPATCH();
+        }
         
-        StackPop();
-    }
-    
-    void VirtualMachine::ExecuteGetSuper()
-    {
-        auto thisObj = ExtractObject<Instance>(StackPeek(1));
-        auto superObj = ExtractObject<Class>(StackPeek());
+        LOX_OPCODE(GreaterDouble)
+        {
+            LOX_DOUBLE_BINARY_OPERATION(std::greater<DoubleRepr>, OpcodeGreater);
+            LOX_DISPATCH();
+        }
         
-        GcPtr<String> name = ReadStringArgument();
+        LOX_OPCODE(LessDouble)
+        {
+            LOX_DOUBLE_BINARY_OPERATION(std::less<DoubleRepr>, OpcodeLess);
+            LOX_DISPATCH();
+        }
         
-        GcPtr<BoundMethod> bound = BindMethod(superObj, name, thisObj);
+        // A field of an instance, whose shape is in the cache.
+        LOX_OPCODE(GetPropertyField)
+        {
+            LOX_REQUIRE_STACK(1);
+            Value val = LOX_PEEK(0);
+            
+            GcPtr<Instance> obj;
+            std::optional<std::size_t> slot;
+            
+            // A wrong name constant of unverified code is reported by `GetProperty`.
+            if (val.IsObject<Instance>() && (Verified || chunk->HasConstant(*ip)))
+            {
+                obj = val.AsObject()->As<Instance>();
+                slot = chunk->GetInlineCache(*ip).LookupFieldSlot(obj->GetShape());
+            }
+            
+            if (!slot)
+            {
+                LOX_QUICKEN(OpcodeGetProperty, 0);
+                goto OpcodeGetPropertyLabel;
+            }
+            
+            ++ip;
+            LOX_PEEK(0) = obj->GetSlot(*slot);
+            LOX_DISPATCH();
+        }
         
-        StackPop();
-        StackPop();
-        StackPush(Value(bound));
-    }
-    
-    void VirtualMachine::ExecuteInvokeSuper()
-    {
-        uint8_t argsCount = CallFramePeek().ReadByte();
-        GcPtr<String> name = ReadStringArgument();
+        LOX_OPCODE(CallClosure)
+        {
+            uint8_t argCount = *ip;
+            LOX_REQUIRE_STACK(argCount + 1);
+            Value callee = LOX_PEEK(argCount);
+            
+            if (!callee.IsObject<Closure>())
+            {
+                LOX_QUICKEN(OpcodeCall, 0);
+                goto OpcodeCallLabel;
+            }
+            
+            ++ip;
+            
+            LOX_SAVE_STATE();
+            CallFunction(callee.AsObject()->As<Closure>(), argCount);
+            LOX_LOAD_STATE();
+            
+            LOX_DISPATCH();
+        }
         
-        GcPtr<Class> super = ExtractObject<Class>(StackPop());
+        LOX_UNKNOWN_OPCODE()
+        {
+            LOX_SAVE_STATE();
+            ThrowRuntimeException<Exceptions::UnknownInstruction>(frame->GetPreviousByte());
+        }
         
-        InvokeFromClass(super, name, argsCount);
+        #if !LOX_COMPUTED_GOTO
+            } // switch
+        } // while
+        #endif
+        
+        #undef LOX_SAVE_STATE
+        #undef LOX_LOAD_STATE
+        #undef LOX_READ_BYTE
+        #undef LOX_READ_SHORT
+        #undef LOX_READ_CONSTANT
+        #undef LOX_READ_STRING
+        #undef LOX_INLINE_CACHE
+        #undef LOX_PUSH
+        #undef LOX_POP
+        #undef LOX_PEEK
+        #undef LOX_REQUIRE_STACK
+        #undef LOX_CHECK_SLOT
+        #undef LOX_CHECK_UPVALUE
+        #undef LOX_CHECK_GLOBAL
+        #undef LOX_CHECK_GLOBAL_DEFINED
+        #undef LOX_BINARY_OPERATION
+        #undef LOX_EQUAL
+        #undef LOX_SKIP_FUSED
+        #undef LOX_QUICKEN
+        #undef LOX_DOUBLE_BINARY_OPERATION
+        #undef LOX_DISPATCH_PROLOGUE
+        #undef LOX_DISPATCH
+        #undef LOX_OPCODE
+        #undef LOX_UNKNOWN_OPCODE
     }
     
     // Runtime operations.
@@ -503,6 +1182,7 @@ namespace Lox
             GcPtr<Upvalue> next = openUpvalues->GetNextUpvalue();
             
             upvalue->Close();
+            memory.WriteBarrier(upvalue, upvalue->GetValue());
             
             openUpvalues = next;
         }
@@ -539,9 +1219,40 @@ namespace Lox
             ThrowRuntimeException<Exceptions::WrongArgumentsCount>(func->GetArity(), argCount);
         }
         
+        // The only stack overflow check of the function, `Run` pushes without checks.
+        std::optional<std::size_t> stackSize = GetMaxStackSize(func);
+        if (!stackSize)
+        {
+            ThrowRuntimeException<Exceptions::RuntimeException>("malformed bytecode");
+        }
+        
+        if (static_cast<std::size_t>(stack.end() - stackTop) < *stackSize)
+        {
+            ThrowRuntimeException<Exceptions::StackOverflow>();
+        }
+        
         CallFramePush(CallFrame(func, StackPeekIterator(argCount)));
     }
     
+    std::optional<std::size_t> VirtualMachine::GetMaxStackSize(GcPtr<Closure> func)
+    {
+        Chunk& chunk = func->GetChunk();
+        
+        if (!chunk.GetMaxStackSize())
+        {
+            std::optional<std::size_t> size = ChunkChecker(chunk).ComputeMaxStackSize();
+            
+            if (!size)
+            {
+                return std::nullopt;
+            }
+            
+            chunk.SetMaxStackSize(*size);
+        }
+        
+        return chunk.GetMaxStackSize();
+    }
+    
     void VirtualMachine::CallNative(GcPtr<Native> func, uint8_t argCount)
     {
         if (func->GetArity() != argCount)
@@ -550,13 +1261,16 @@ namespace Lox
         }
         
         NativeFn& fn = func->GetNativeFn();
-        Value val = (func->GetNativeFn())(*this, StackPeekIterator(argCount));
+        Value val = fn(*this, StackPeekIterator(argCount));
+        
+        // Replace the native and its arguments with the result.
+        stackTop -= argCount + 1;
         StackPush(val);
     }
     
     void VirtualMachine::CallClass(GcPtr<Class> klass, uint8_t argCount)
     {
-        auto obj = AllocateObject<Instance>(klass);
+        auto obj = AllocateObject<Instance>(klass, emptyShape);
         
         std::optional<GcPtr<Closure>> init = klass->GetMethod(initStr);
         if (init)
@@ -582,9 +1296,9 @@ namespace Lox
         CallFunction(method->GetMethod(), argCount);
     }
     
-    void VirtualMachine::Invoke(GcPtr<Instance> obj, GcPtr<String> name, uint8_t argCount)
+    void VirtualMachine::Invoke(GcPtr<Instance> obj, GcPtr<String> name, uint8_t argCount, InlineCache& cache)
     {
-        std::optional<Value> field = obj->GetField(name);
+        std::optional<Value> field = GetField(obj, name, cache);
         
         if (field)
         {
@@ -592,13 +1306,13 @@ namespace Lox
         }
         else
         {
-            InvokeFromClass(obj->GetClass(), name, argCount);
+            InvokeFromClass(obj->GetClass(), name, argCount, cache);
         }
     }
     
-    void VirtualMachine::InvokeFromClass(GcPtr<Class> obj, GcPtr<String> name, uint8_t argCount)
+    void VirtualMachine::InvokeFromClass(GcPtr<Class> obj, GcPtr<String> name, uint8_t argCount, InlineCache& cache)
     {
-        std::optional<GcPtr<Closure>> method = obj->GetMethod(name);
+        std::optional<GcPtr<Closure>> method = FindMethod(obj, name, cache);
         
         if (method)
         {
@@ -610,9 +1324,10 @@ namespace Lox
         }
     }
     
-    GcPtr<BoundMethod> VirtualMachine::BindMethod(GcPtr<Class> klass, GcPtr<String> name, GcPtr<Instance> obj)
+    GcPtr<BoundMethod> VirtualMachine::BindMethod(GcPtr<Class> klass, GcPtr<String> name, GcPtr<Instance> obj,
+                                                  InlineCache& cache)
     {
-        std::optional<GcPtr<Closure>> method = klass->GetMethod(name);
+        std::optional<GcPtr<Closure>> method = FindMethod(klass, name, cache);
         
         if (!method)
         {
@@ -622,6 +1337,137 @@ namespace Lox
         return AllocateObject<BoundMethod>(obj, *method);
     }
     
+    std::optional<Value> VirtualMachine::GetField(GcPtr<Instance> obj, GcPtr<String> name, InlineCache& cache)
+    {
+        GcPtr<Shape> shape = obj->GetShape();
+        
+        const InlineCache::FieldEntry* entry = cache.LookupField(shape);
+        if (entry != nullptr && entry->transition.IsNullptr())
+        {
+            if (entry->slot == InlineCache::MissingSlot)
+            {
+                return std::nullopt;
+            }
+            
+            return obj->GetSlot(entry->slot);
+        }
+        
+        std::optional<std::size_t> slot = shape->FindSlot(name);
+        
+        if (slot)
+        {
+            cache.UpdateField(shape, *slot);
+        }
+        else if (shape->GetSlotsCount() == Configuration::MaxShapeSlots)
+        {
+            // The field may be in the overflow dictionary, which is not cached.
+            return obj->GetField(name);
+        }
+        else
+        {
+            cache.UpdateField(shape, InlineCache::MissingSlot);
+        }
+        
+        memory.WriteBarrier(CallFramePeek().GetFunction());
+        
+        if (!slot)
+        {
+            return std::nullopt;
+        }
+        
+        return obj->GetSlot(*slot);
+    }
+    
+    void VirtualMachine::SetField(GcPtr<Instance> obj, GcPtr<String> name, Value val, InlineCache& cache)
+    {
+        GcPtr<Shape> shape = obj->GetShape();
+        
+        const InlineCache::FieldEntry* entry = cache.LookupField(shape);
+        if (entry != nullptr && entry->slot != InlineCache::MissingSlot)
+        {
+            if (entry->transition.IsNullptr())
+            {
+                obj->SetSlot(entry->slot, val);
+            }
+            else
+            {
+                GcPtr<Shape> newShape = entry->transition;
+                
+                obj->AddSlot(newShape, val);
+                memory.WriteBarrier(obj, newShape);
+                memory.AccountPayload(obj);
+            }
+            
+            return;
+        }
+        
+        std::optional<std::size_t> slot = shape->FindSlot(name);
+        
+        if (slot)
+        {
+            obj->SetSlot(*slot, val);
+            cache.UpdateField(shape, *slot);
+        }
+        else if (shape->GetSlotsCount() == Configuration::MaxShapeSlots)
+        {
+            obj->AddOverflowField(name, val);
+            memory.WriteBarrier(obj, name);
+            memory.AccountPayload(obj);
+            return;
+        }
+        else
+        {
+            GcPtr<Shape> newShape = TransitionShape(shape, name);
+            
+            obj->AddSlot(newShape, val);
+            memory.WriteBarrier(obj, newShape);
+            memory.AccountPayload(obj);
+            
+            cache.UpdateField(shape, newShape->GetSlotsCount() - 1, newShape);
+        }
+        
+        memory.WriteBarrier(CallFramePeek().GetFunction());
+    }
+    
+    GcPtr<Shape> VirtualMachine::TransitionShape(GcPtr<Shape> shape, GcPtr<String> name)
+    {
+        std::optional<GcPtr<Shape>> existing = shape->GetTransition(name);
+        
+        if (existing)
+        {
+            return *existing;
+        }
+        
+        GcPtr<Shape> newShape = AllocateObject<Shape>(shape, name);
+        
+        shape->AddTransition(name, newShape);
+        memory.WriteBarrier(shape, newShape);
+        memory.AccountPayload(shape);
+        
+        return newShape;
+    }
+    
+    std::optional<GcPtr<Closure>> VirtualMachine::FindMethod(GcPtr<Class> klass, GcPtr<String> name,
+                                                             InlineCache& cache)
+    {
+        GcPtr<Closure> cached = cache.Lookup(klass);
+        if (!cached.IsNullptr())
+        {
+            return cached;
+        }
+        
+        std::optional<GcPtr<Closure>> method = klass->GetMethod(name);
+        
+        if (method)
+        {
+            // The cache lives in the chunk of the running function.
+            cache.Update(klass, *method);
+            memory.WriteBarrier(CallFramePeek().GetFunction());
+        }
+        
+        return method;
+    }
+    
     GcPtr<Upvalue> VirtualMachine::AddLocalUpvalue(StackIterator it)
     {
         GcPtr<Upvalue> list = openUpvalues;
@@ -676,17 +1522,13 @@ namespace Lox
     }
     
     template <typename BinOp>
-    void VirtualMachine::BinaryOperation()
+    Value VirtualMachine::BinaryOperation(Value a, Value b)
     {
-        Value b = StackPop();
-        Value a = StackPop();
-        
         if (std::is_same_v<BinOp, std::plus<DoubleRepr>> && a.IsObject<String>() && b.IsObject<String>())
         {
             GcPtr<String> str1 = a.AsObject<String>();
             GcPtr<String> str2 = b.AsObject<String>();
-            StackPush(Value(Concatenate(str1, str2)));
-            return;
+            return Value(Concatenate(str1, str2));
         }
         
         auto aDouble = ExtractValue<DoubleRepr>(a);
@@ -700,17 +1542,45 @@ namespace Lox
             }
         }
         
-        StackPush(Value(BinOp{}(aDouble, bDouble)));
+        return Value(BinOp{}(aDouble, bDouble));
     }
     
     GcPtr<String> VirtualMachine::Concatenate(GcPtr<String> a, GcPtr<String> b)
     {
-        const std::string& str1 = a->GetCppString();
-        const std::string& str2 = b->GetCppString();
+        std::size_t length = a->GetLength() + b->GetLength();
+        
+        if (length < Configuration::MinBuilderStringLength)
+        {
+            std::string newStr;
+            newStr.reserve(length);
+            newStr.append(a->GetView()).append(b->GetView());
+            
+            return AllocateObject<String>(std::move(newStr));
+        }
+        
+        std::size_t growth;
+        std::shared_ptr<std::string> buffer = String::Append(*a, *b, growth);
+        
+        return AllocateObject<String>(std::move(buffer), length, growth);
+    }
+    
+    bool VirtualMachine::StringsEqual(GcPtr<String> str1, GcPtr<String> str2)
+    {
+        GcPtr<String> interned1 = str1->GetInterned();
+        GcPtr<String> interned2 = str2->GetInterned();
+        
+        if (!interned1.IsNullptr() && !interned2.IsNullptr())
+        {
+            return interned1 == interned2;
+        }
         
-        std::string newStr = str1 + str2;
+        if (str1->GetHash() != str2->GetHash())
+        {
+            return false;
+        }
         
-        return AllocateObject<String>(std::move(newStr));
+        // Once interned, the strings are compared by pointer.
+        return InternString(str1) == InternString(str2);
     }
     
     // Stacks.
@@ -760,21 +1630,6 @@ namespace Lox
         ++stackTop;
     }
     
-    Value VirtualMachine::StackPop()
-    {
-        if (stackTop == stack.begin())
-        {
-            ThrowRuntimeException<Exceptions::StackUnderflow>();
-        }
-        
-        return *--stackTop;
-    }
-    
-    Value VirtualMachine::StackPeek(std::size_t offset)
-    {
-        return *StackPeekIterator(offset);
-    }
-    
     StackIterator VirtualMachine::StackPeekIterator(std::size_t offset)
     {
         if (stackTop - offset < stack.begin())
@@ -785,32 +1640,16 @@ namespace Lox
         return stackTop - offset - 1;
     }
     
-    Value VirtualMachine::StackGet(std::size_t index)
-    {
-        auto values = CallFramePeek().GetValues();
-        
-        if (values + index >= stack.end())
-        {
-            ThrowRuntimeException<Exceptions::InvalidStackAccess>();
-        }
-        
-        return values[index];
-    }
+    // Debug.
     
-    void VirtualMachine::StackSet(std::size_t index, Value newVal)
+    void VirtualMachine::StopProfiler()
     {
-        auto values = CallFramePeek().GetValues();
-        
-        if (values + index >= stack.end())
+        if (profiler)
         {
-            ThrowRuntimeException<Exceptions::InvalidStackAccess>();
+            profiler->Stop();
         }
-        
-        values[index] = newVal;
     }
     
-    // Debug.
-    
     void VirtualMachine::TraceExecution(std::ostream& out) const
     {
         PrintStack(out);
@@ -858,39 +1697,47 @@ namespace Lox
     
     void VirtualMachine::MarkRoots()
     {
-        for (auto& entry: strings)
-        {
-            MemoryManager::MarkObject(entry.second);
-        }
+        memory.MarkObject(initStr);
         
-        for (auto& entry: globals)
+        // Names in `globalSlots` are the same as in `globalNames`.
+        for (std::size_t slot = 0; slot < globals.size(); ++slot)
         {
-            // NOTE: Keys in unordered map are const.
-            
-            // So, there is no other way
-            MemoryManager::MarkObject(static_cast<GcPtr<String>>(entry.first));
-            MemoryManager::MarkValue(entry.second);
+            memory.MarkObject(globalNames[slot]);
+            memory.MarkValue(globals[slot]);
         }
         
+        memory.MarkValue(undefined);
+        
         GcPtr<Upvalue> upvalue = openUpvalues;
         while (!upvalue.IsNullptr())
         {
             GcPtr<Upvalue> next = upvalue->GetNextUpvalue();
             
-            MemoryManager::MarkObject(upvalue);
+            memory.MarkObject(upvalue);
             
             upvalue = next;
         }
         
+        memory.MarkObject(emptyShape);
+        
         for (std::size_t i = 0; i < framesCount; ++i)
         {
             CallFrame& frame = frames[i];
-            MemoryManager::MarkObject(frame.GetFunction());
+            memory.MarkObject(frame.GetFunction());
         }
         
         for (auto it = stack.begin(); it < stackTop; ++it)
         {
-            MemoryManager::MarkValue(*it);
+            memory.MarkValue(*it);
         }
     }
+    
+    void VirtualMachine::SweepWeakReferences()
+    {
+        // The entries go before the strings are deleted, `FindString` reads the keys.
+        strings.EraseIf([this](GcPtr<String> str, std::monostate)
+                        {
+                            return !memory.IsReachable(str);
+                        });
+    }
 }
@@ -3,7 +3,9 @@
 namespace Lox
 {
     VirtualMachineConfiguration::VirtualMachineConfiguration(std::ostream& userOutput, std::istream& userInput, std::ostream& debugOutput)
-        : userOutput(userOutput), userInput(userInput), debugOutput(debugOutput)
+        : userOutput(userOutput), userInput(userInput), debugOutput(debugOutput),
+          traceExecution(false), profileOpcodes(false), sampleInterval(0), stressGC(false), incrementalGCBudget(0),
+          markingThreads(1), backgroundSweeping(false), logGC(false), dumpChunkAfterCompile(false)
     {
             
     }
@@ -22,4 +24,94 @@ namespace Lox
     {
         return debugOutput;
     }
+    
+    bool VirtualMachineConfiguration::GetTraceExecution() const
+    {
+        return traceExecution;
+    }
+    
+    void VirtualMachineConfiguration::SetTraceExecution(bool value)
+    {
+        traceExecution = value;
+    }
+    
+    bool VirtualMachineConfiguration::GetProfileOpcodes() const
+    {
+        return profileOpcodes;
+    }
+    
+    void VirtualMachineConfiguration::SetProfileOpcodes(bool value)
+    {
+        profileOpcodes = value;
+    }
+    
+    std::size_t VirtualMachineConfiguration::GetSampleInterval() const
+    {
+        return sampleInterval;
+    }
+    
+    void VirtualMachineConfiguration::SetSampleInterval(std::size_t value)
+    {
+        sampleInterval = value;
+    }
+    
+    bool VirtualMachineConfiguration::GetStressGC() const
+    {
+        return stressGC;
+    }
+    
+    void VirtualMachineConfiguration::SetStressGC(bool value)
+    {
+        stressGC = value;
+    }
+    
+    std::size_t VirtualMachineConfiguration::GetIncrementalGCBudget() const
+    {
+        return incrementalGCBudget;
+    }
+    
+    void VirtualMachineConfiguration::SetIncrementalGCBudget(std::size_t value)
+    {
+        incrementalGCBudget = value;
+    }
+    
+    std::size_t VirtualMachineConfiguration::GetMarkingThreads() const
+    {
+        return markingThreads;
+    }
+    
+    void VirtualMachineConfiguration::SetMarkingThreads(std::size_t value)
+    {
+        markingThreads = value;
+    }
+    
+    bool VirtualMachineConfiguration::GetBackgroundSweeping() const
+    {
+        return backgroundSweeping;
+    }
+    
+    void VirtualMachineConfiguration::SetBackgroundSweeping(bool value)
+    {
+        backgroundSweeping = value;
+    }
+    
+    bool VirtualMachineConfiguration::GetLogGC() const
+    {
+        return logGC;
+    }
+    
+    void VirtualMachineConfiguration::SetLogGC(bool value)
+    {
+        logGC = value;
+    }
+    
+    bool VirtualMachineConfiguration::GetDumpChunkAfterCompile() const
+    {
+        return dumpChunkAfterCompile;
+    }
+    
+    void VirtualMachineConfiguration::SetDumpChunkAfterCompile(bool value)
+    {
+        dumpChunkAfterCompile = value;
+    }
 }
@@ -0,0 +1,162 @@
+#include "Lox/Runtime/BackgroundSweeper.hpp"
+
+namespace Lox
+{
+    BackgroundSweeper::BackgroundSweeper()
+            : finished(true), hasDeadObjects(false), stopping(false), thread(&BackgroundSweeper::Run, this)
+    {
+    
+    }
+    
+    BackgroundSweeper::~BackgroundSweeper()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        
+        workAvailable.notify_one();
+        thread.join();
+    }
+    
+    void BackgroundSweeper::Start(GcPtr<Object> list)
+    {
+        if (!list)
+        {
+            return;
+        }
+        
+        {
+            std::lock_guard lock(mutex);
+            objects = list;
+            finished = false;
+        }
+        
+        workAvailable.notify_one();
+    }
+    
+    void BackgroundSweeper::TakeDeadObjects(std::vector<DeadObject>& result)
+    {
+        std::lock_guard lock(mutex);
+        
+        result.insert(result.end(), deadObjects.begin(), deadObjects.end());
+        deadObjects.clear();
+        hasDeadObjects = false;
+    }
+    
+    void BackgroundSweeper::MoveSurvivorsTo(GcPtr<Object>& list)
+    {
+        std::lock_guard lock(mutex);
+        
+        if (survivors)
+        {
+            lastSurvivor->SetNext(list);
+            list = survivors;
+        }
+        
+        survivors = GcPtr<Object>();
+        lastSurvivor = GcPtr<Object>();
+    }
+    
+    void BackgroundSweeper::Wait()
+    {
+        std::unique_lock lock(mutex);
+        sweepFinished.wait(lock, [this]
+        {
+            return finished.load();
+        });
+    }
+    
+    void BackgroundSweeper::Run()
+    {
+        std::unique_lock lock(mutex);
+        
+        while (true)
+        {
+            workAvailable.wait(lock, [this]
+            {
+                return stopping || objects;
+            });
+            
+            // The current sweeping is finished before the stop.
+            if (objects)
+            {
+                GcPtr<Object> list = objects;
+                objects = GcPtr<Object>();
+                
+                lock.unlock();
+                Sweep(list);
+                lock.lock();
+                
+                finished = true;
+                sweepFinished.notify_all();
+            }
+            
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+    
+    void BackgroundSweeper::Sweep(GcPtr<Object> list)
+    {
+        std::vector<DeadObject> batch;
+        GcPtr<Object> first;
+        GcPtr<Object> last;
+        
+        GcPtr<Object> obj = list;
+        while (obj)
+        {
+            GcPtr<Object> next = obj->GetNext();
+            
+            if (obj->IsMarked())
+            {
+                obj->Unmark();
+                obj->SetNext(first);
+                
+                if (!last)
+                {
+                    last = obj;
+                }
+                
+                first = obj;
+            }
+            else
+            {
+                ObjectType type = obj->GetType();
+                std::size_t payloadSize = obj->GetAccountedPayloadSize();
+                Object* raw = obj.GetRawPointer();
+                raw->~Object();
+                
+                batch.push_back({raw, type, payloadSize});
+                if (batch.size() == BatchSize)
+                {
+                    GiveDeadObjects(batch);
+                }
+            }
+            
+            obj = next;
+        }
+        
+        GiveDeadObjects(batch);
+        
+        std::lock_guard lock(mutex);
+        survivors = first;
+        lastSurvivor = last;
+    }
+    
+    void BackgroundSweeper::GiveDeadObjects(std::vector<DeadObject>& batch)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+        
+        std::lock_guard lock(mutex);
+        
+        deadObjects.insert(deadObjects.end(), batch.begin(), batch.end());
+        hasDeadObjects = true;
+        batch.clear();
+    }
+}
@@ -1,25 +1,49 @@
 #include "Lox/Runtime/MemoryManager.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 #include "Lox/Configuration.hpp"
 
+#include "Lox/Runtime/Objects/String.hpp"
+#include "Lox/Runtime/Objects/Closure.hpp"
+#include "Lox/Runtime/Objects/Native.hpp"
+#include "Lox/Runtime/Objects/Upvalue.hpp"
+#include "Lox/Runtime/Objects/Class.hpp"
+#include "Lox/Runtime/Objects/Instance.hpp"
+#include "Lox/Runtime/Objects/BoundMethod.hpp"
+#include "Lox/Runtime/Objects/Shape.hpp"
+
 namespace Lox
 {
     MemoryManager::MemoryManager(RootsSource& roots)
-            : roots(roots), objects(), allowedGC(false)
+            : roots(roots), youngObjects(), oldObjects(), phase(Phase::Idle), incrementalBudget(0), nextStep(0),
+              sweepObjects(), allowedGC(false), collectingYoung(false), stressGC(false), logGC(false),
+              markingInParallel(false),
+              bytesPerType{}, objectsPerType{}, bytesAllocated(0), youngBytesAllocated(0),
+              peakBytesAllocated(0), nextGC(Configuration::InitialNextGC),
+              minorCollections(0), majorCollections(0), longestPause(0)
     {
     
     }
     
     MemoryManager::~MemoryManager()
     {
-        GcPtr<Object> obj = objects;
-        while (obj)
+        // The dead objects of the background sweeping are to be freed.
+        if (backgroundSweeper && phase == Phase::Sweeping)
         {
-            GcPtr<Object> next = obj->GetNext();
-            DeleteObject(obj);
-            obj = next;
+            FinishIncrementalCollection();
+        }
+        
+        for (GcPtr<Object> list : {youngObjects, oldObjects, sweepObjects})
+        {
+            GcPtr<Object> obj = list;
+            while (obj)
+            {
+                GcPtr<Object> next = obj->GetNext();
+                DeleteObject(obj);
+                obj = next;
+            }
         }
     }
     
@@ -30,13 +54,104 @@ namespace Lox
             return;
         }
         
-        if constexpr (Configuration::StressGC)
+        if (phase == Phase::Sweeping && SweepOldGenerationStep(Configuration::LazySweepObjects))
+        {
+            FinishSweeping();
+        }
+        
+        if (stressGC)
+        {
+            // The incremental marking makes a step on every allocation.
+            if (phase == Phase::Marking)
+            {
+                CollectGarbageStep();
+            }
+            else if (phase == Phase::Idle && (minorCollections + 1) % Configuration::StressMajorGCInterval == 0)
+            {
+                StartMajorCollection();
+            }
+            
+            CollectYoungGeneration();
+            return;
+        }
+        
+        if (phase == Phase::Marking)
+        {
+            if (bytesAllocated >= nextStep)
+            {
+                CollectGarbageStep();
+            }
+        }
+        else if (phase == Phase::Idle && bytesAllocated >= nextGC)
+        {
+            StartMajorCollection();
+        }
+        
+        if (youngBytesAllocated >= Configuration::YoungGenerationSize)
+        {
+            CollectYoungGeneration();
+        }
+    }
+    
+    void MemoryManager::StartMajorCollection()
+    {
+        if (incrementalBudget == 0)
+        {
+            CollectGarbageLazily();
+        }
+        else
+        {
+            CollectGarbageStep();
+        }
+    }
+    
+    void MemoryManager::SetStressGC(bool value)
+    {
+        stressGC = value;
+    }
+    
+    void MemoryManager::SetLogGC(bool value)
+    {
+        logGC = value;
+    }
+    
+    void MemoryManager::SetIncrementalBudget(std::size_t value)
+    {
+        incrementalBudget = value;
+    }
+    
+    void MemoryManager::SetMarkingThreads(std::size_t value)
+    {
+        if (value <= 1)
+        {
+            parallelMarker.reset();
+        }
+        else if (!parallelMarker || parallelMarker->GetThreadsCount() != value)
+        {
+            parallelMarker = std::make_unique<ParallelMarker>(*this, value);
+        }
+    }
+    
+    void MemoryManager::SetBackgroundSweeping(bool value)
+    {
+        if (value == static_cast<bool>(backgroundSweeper))
+        {
+            return;
+        }
+        
+        // The sweeping in progress is finished the old way.
+        if (phase == Phase::Sweeping)
+        {
+            FinishIncrementalCollection();
+        }
+        
+        if (value)
         {
-            CollectGarbage();
+            backgroundSweeper = std::make_unique<BackgroundSweeper>();
         }
         else
         {
-            LOX_UNIMPLEMENTED("Lox::MemoryManager no stress GC");
+            backgroundSweeper.reset();
         }
     }
     
@@ -52,31 +167,258 @@ namespace Lox
     
     void MemoryManager::CollectGarbage()
     {
+        auto start = std::chrono::steady_clock::now();
+        
+        CollectGarbageLazily();
+        FinishIncrementalCollection();
+        
+        RecordPause(start);
+    }
+    
+    void MemoryManager::CollectGarbageLazily()
+    {
+        auto start = std::chrono::steady_clock::now();
+        
+        if (phase != Phase::Idle)
+        {
+            FinishIncrementalCollection();
+        }
+        
         LogStages("Begin");
         
+        collectingYoung = false;
+        
         MarkStage();
-        SweepStage();
+        SweepWeakReferences();
         
-        // UpdateNextGC();
+        // The remembered set is useless after a full collection: all survivors become old.
+        ClearRememberedSet();
+        
+        // The promoted objects are not swept.
+        StartSweeping();
+        SweepYoungGeneration();
+        
+        LogStages("MarkStage Done");
+        RecordPause(start);
+    }
+    
+    void MemoryManager::CollectYoungGeneration()
+    {
+        auto start = std::chrono::steady_clock::now();
+        
+        LogStages("Young Begin");
+        
+        collectingYoung = true;
+        
+        // The gray objects of the incremental marking wait for the end of this collection.
+        grayStack.swap(pausedGrayStack);
+        
+        MarkStage();
+        SweepWeakReferences();
+        
+        SweepYoungGeneration();
+        
+        ClearRememberedSet();
+        
+        grayStack.swap(pausedGrayStack);
+        
+        collectingYoung = false;
+        minorCollections++;
+        
+        LogStages("Young End");
+        RecordPause(start);
+    }
+    
+    void MemoryManager::CollectGarbageStep()
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t budget = std::max<std::size_t>(incrementalBudget, 1);
+        
+        switch (phase)
+        {
+        case Phase::Idle:
+            BeginIncrementalCollection();
+            break;
+        case Phase::Marking:
+            if (TraceReferences(budget))
+            {
+                FinishMarking();
+            }
+            break;
+        case Phase::Sweeping:
+            if (SweepOldGenerationStep(budget))
+            {
+                FinishSweeping();
+            }
+            break;
+        }
+        
+        nextStep = bytesAllocated + Configuration::IncrementalStepBytes;
+        RecordPause(start);
+    }
+    
+    bool MemoryManager::IsCollecting() const
+    {
+        return phase != Phase::Idle;
+    }
+    
+    void MemoryManager::BeginIncrementalCollection()
+    {
+        LogStages("Incremental Begin");
+        
+        phase = Phase::Marking;
+        roots.MarkRoots();
+    }
+    
+    void MemoryManager::FinishMarking()
+    {
+        LogStages("Incremental FinishMarking Begin");
+        
+        // The roots are not guarded by the write barrier, and the young objects
+        // have not been traced at all.
+        roots.MarkRoots();
+        MarkYoungChildren();
+        TraceReferences();
+        
+        SweepWeakReferences();
+        
+        // The young generation lives on, and so does the remembered set, without the dead objects.
+        std::erase_if(rememberedSet, [](GcPtr<Object> obj)
+        {
+            return !obj->IsMarked();
+        });
+        
+        StartSweeping();
+        
+        LogStages("Incremental FinishMarking End");
+    }
+    
+    void MemoryManager::StartSweeping()
+    {
+        sweepObjects = oldObjects;
+        oldObjects = GcPtr<Object>();
+        phase = Phase::Sweeping;
+        
+        if (backgroundSweeper)
+        {
+            backgroundSweeper->Start(sweepObjects);
+            sweepObjects = GcPtr<Object>();
+        }
+    }
+    
+    void MemoryManager::FinishSweeping()
+    {
+        phase = Phase::Idle;
+        
+        nextGC = std::max(bytesAllocated * Configuration::HeapGrowFactor, Configuration::InitialNextGC);
+        majorCollections++;
+        
+        // The free cells are kept for the next allocations, but not more than the live heap.
+        allocator.Trim(bytesAllocated);
         
         LogStages("End");
     }
     
+    void MemoryManager::FinishIncrementalCollection()
+    {
+        if (phase == Phase::Marking)
+        {
+            TraceReferences();
+            FinishMarking();
+        }
+        
+        if (phase == Phase::Sweeping)
+        {
+            if (backgroundSweeper)
+            {
+                backgroundSweeper->Wait();
+            }
+            
+            SweepOldGenerationStep(std::numeric_limits<std::size_t>::max());
+            FinishSweeping();
+        }
+    }
+    
     void MemoryManager::MarkStage()
     {
         LogStages("MarkStage Begin");
         
         roots.MarkRoots();
         
+        if (collectingYoung)
+        {
+            MarkRememberedSet();
+        }
+        
+        // The young collections and the incremental steps are small, they are traced here.
+        if (parallelMarker && !collectingYoung && phase == Phase::Idle)
+        {
+            markingInParallel = true;
+            parallelMarker->Trace(grayStack);
+            markingInParallel = false;
+        }
+        else
+        {
+            TraceReferences();
+        }
+        
         LogStages("MarkStage End");
     }
     
-    void MemoryManager::SweepStage()
+    void MemoryManager::MarkRememberedSet()
     {
-        LogStages("SweepStage Begin");
+        // Remembered objects are old, so they are not marked themselves, only their children.
+        for (GcPtr<Object> obj : rememberedSet)
+        {
+            obj->MarkChildren(*this);
+        }
+    }
+    
+    bool MemoryManager::TraceReferences(std::size_t budget)
+    {
+        for (; budget != 0 && !grayStack.empty(); --budget)
+        {
+            GcPtr<Object> obj = grayStack.back();
+            grayStack.pop_back();
+            
+            obj->MarkChildren(*this);
+        }
+        
+        return grayStack.empty();
+    }
+    
+    void MemoryManager::MarkYoungChildren()
+    {
+        for (GcPtr<Object> obj = youngObjects; obj; obj = obj->GetNext())
+        {
+            obj->MarkChildren(*this);
+        }
+    }
+    
+    void MemoryManager::SweepWeakReferences()
+    {
+        LogStages("SweepWeakReferences Begin");
         
-        GcPtr<Object> prev;
-        GcPtr<Object> obj = objects;
+        roots.SweepWeakReferences();
+        
+        LogStages("SweepWeakReferences End");
+    }
+    
+    void MemoryManager::ClearRememberedSet()
+    {
+        for (GcPtr<Object> obj : rememberedSet)
+        {
+            obj->SetRemembered(false);
+        }
+        
+        rememberedSet.clear();
+    }
+    
+    void MemoryManager::SweepYoungGeneration()
+    {
+        LogStages("SweepStage Young Begin");
+        
+        GcPtr<Object> obj = youngObjects;
         
         while (obj)
         {
@@ -84,44 +426,185 @@ namespace Lox
             
             if (obj->IsMarked())
             {
+                // Promotion.
                 obj->Unmark();
-                prev = obj;
-                obj = next;
+                obj->SetOld();
+                obj->SetNext(oldObjects);
+                oldObjects = obj;
+                
+                // The incremental marking has not seen the object, it survives and is traced.
+                if (phase == Phase::Marking)
+                {
+                    obj->SetMarked();
+                    pausedGrayStack.push_back(obj);
+                }
             }
             else
             {
-                if (!prev)
-                {
-                    objects = next;
-                }
-                else
+                DeleteObject(obj);
+            }
+            
+            obj = next;
+        }
+        
+        youngObjects = GcPtr<Object>();
+        youngBytesAllocated = 0;
+        
+        LogStages("SweepStage Young End");
+    }
+    
+    bool MemoryManager::SweepOldGenerationStep(std::size_t budget)
+    {
+        if (backgroundSweeper)
+        {
+            // Read before the dead objects are taken, so none is given after them.
+            bool finished = backgroundSweeper->IsFinished();
+            
+            if (backgroundSweeper->HasDeadObjects())
+            {
+                backgroundSweeper->TakeDeadObjects(sweptObjects);
+                
+                for (BackgroundSweeper::DeadObject dead : sweptObjects)
                 {
-                    prev->SetNext(next);
+                    FreeObject(dead.memory, dead.type, dead.payloadSize);
                 }
                 
+                sweptObjects.clear();
+            }
+            
+            if (finished)
+            {
+                backgroundSweeper->MoveSurvivorsTo(oldObjects);
+            }
+            
+            return finished;
+        }
+        
+        for (; budget != 0 && sweepObjects; --budget)
+        {
+            GcPtr<Object> obj = sweepObjects;
+            sweepObjects = obj->GetNext();
+            
+            if (obj->IsMarked())
+            {
+                obj->Unmark();
+                obj->SetNext(oldObjects);
+                oldObjects = obj;
+            }
+            else
+            {
                 DeleteObject(obj);
-                
-                obj = next;
             }
         }
         
-        LogStages("SweepStage End");
+        return !sweepObjects;
+    }
+    
+    void MemoryManager::AccountAllocation(ObjectType type, std::size_t size)
+    {
+        objectsPerType[static_cast<std::size_t>(type)]++;
+        AccountBytes(type, size);
+    }
+    
+    void MemoryManager::AccountPayload(GcPtr<Object> obj)
+    {
+        std::size_t accounted = obj->GetAccountedPayloadSize();
+        obj->SetAccountedPayloadSize(obj->GetPayloadSize());
+        std::size_t size = obj->GetAccountedPayloadSize();
+        
+        if (size > accounted)
+        {
+            AccountBytes(obj->GetType(), size - accounted);
+        }
+        else
+        {
+            bytesPerType[static_cast<std::size_t>(obj->GetType())] -= accounted - size;
+            bytesAllocated -= accounted - size;
+        }
+    }
+    
+    void MemoryManager::AccountBytes(ObjectType type, std::size_t size)
+    {
+        bytesPerType[static_cast<std::size_t>(type)] += size;
+        
+        // A grown payload is new memory as well, so it brings the next minor collection closer.
+        bytesAllocated += size;
+        youngBytesAllocated += size;
+        peakBytesAllocated = std::max(peakBytesAllocated, bytesAllocated);
     }
     
     void MemoryManager::DeleteObject(GcPtr<Object> obj)
     {
         LogObject("DeleteObject", obj);
-        obj.Delete();
+        
+        ObjectType type = obj->GetType();
+        std::size_t payloadSize = obj->GetAccountedPayloadSize();
+        Object* raw = obj.GetRawPointer();
+        raw->~Object();
+        
+        FreeObject(raw, type, payloadSize);
+    }
+    
+    void MemoryManager::FreeObject(void* memory, ObjectType type, std::size_t payloadSize)
+    {
+        std::size_t size = GetObjectSize(type) + payloadSize;
+        
+        bytesPerType[static_cast<std::size_t>(type)] -= size;
+        objectsPerType[static_cast<std::size_t>(type)]--;
+        bytesAllocated -= size;
+        
+        allocator.Free(memory);
+    }
+    
+    std::size_t MemoryManager::GetObjectSize(ObjectType type)
+    {
+        switch (type)
+        {
+            #define LOX_OBJECT_TYPE_SIZE(name) \
+                case ObjectType::name: return sizeof(name);
+            
+            LOX_OBJECT_TYPE_LIST(LOX_OBJECT_TYPE_SIZE)
+            
+            #undef LOX_OBJECT_TYPE_SIZE
+        }
+        
+        LOX_UNREACHABLE("Lox::MemoryManager unknown object type");
+        return 0;
     }
     
     void MemoryManager::MarkObject(GcPtr<Object> obj)
     {
-        if (!obj.IsNullptr() && !obj->IsMarked())
+        // Only the stop-the-world major marking is parallel, so no generation is skipped.
+        if (markingInParallel)
         {
-            LogObject("Mark", obj);
-            obj->SetMarked();
-            obj->MarkChildren();
+            if (obj)
+            {
+                parallelMarker->MarkObject(obj);
+            }
+            
+            return;
         }
+        
+        if (obj.IsNullptr() || obj->IsMarked())
+        {
+            return;
+        }
+        
+        // A minor collection does not trace the old generation.
+        if (collectingYoung && obj->IsOld())
+        {
+            return;
+        }
+        
+        // An incremental major collection does not trace the young generation, see `FinishMarking`.
+        if (phase == Phase::Marking && !collectingYoung && !obj->IsOld())
+        {
+            return;
+        }
+        
+        LogObject("Mark", obj);
+        obj->SetMarked();
+        grayStack.push_back(obj);
     }
     
     void MemoryManager::MarkValue(Value val)
@@ -132,21 +615,89 @@ namespace Lox
         }
     }
     
-    void MemoryManager::LogObject(const char* str, GcPtr<Object> obj)
+    bool MemoryManager::IsReachable(GcPtr<Object> obj) const
+    {
+        // A minor collection keeps the whole old generation, an incremental major one keeps
+        // the whole young generation.
+        return obj->IsMarked() || (collectingYoung && obj->IsOld())
+               || (phase == Phase::Marking && !collectingYoung && !obj->IsOld());
+    }
+    
+    // Statistics.
+    
+    std::size_t MemoryManager::GetBytesAllocated() const
+    {
+        return bytesAllocated;
+    }
+    
+    std::size_t MemoryManager::GetBytesAllocated(ObjectType type) const
+    {
+        return bytesPerType[static_cast<std::size_t>(type)];
+    }
+    
+    std::size_t MemoryManager::GetObjectsCount(ObjectType type) const
+    {
+        return objectsPerType[static_cast<std::size_t>(type)];
+    }
+    
+    std::size_t MemoryManager::GetPeakBytesAllocated() const
+    {
+        return peakBytesAllocated;
+    }
+    
+    std::size_t MemoryManager::GetYoungBytesAllocated() const
+    {
+        return youngBytesAllocated;
+    }
+    
+    std::size_t MemoryManager::GetNextGC() const
+    {
+        return nextGC;
+    }
+    
+    std::size_t MemoryManager::GetMinorCollectionsCount() const
+    {
+        return minorCollections;
+    }
+    
+    std::size_t MemoryManager::GetMajorCollectionsCount() const
+    {
+        return majorCollections;
+    }
+    
+    std::size_t MemoryManager::GetFreeBytes() const
+    {
+        return allocator.GetFreeBytes();
+    }
+    
+    std::size_t MemoryManager::GetPagesCount() const
+    {
+        return allocator.GetPagesCount();
+    }
+    
+    std::chrono::nanoseconds MemoryManager::GetLongestPause() const
+    {
+        return longestPause;
+    }
+    
+    void MemoryManager::RecordPause(std::chrono::steady_clock::time_point start)
+    {
+        auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        longestPause = std::max(longestPause, pause);
+    }
+    
+    // Logging.
+    
+    void MemoryManager::LogObjectImpl(const char* str, GcPtr<Object> obj)
     {
-        if constexpr (!Configuration::LogGC)
-        {
-            return;
-        }
-        
         Log(str);
         std::cout << obj->GetType() << ' ';
         obj.PrintPointerValue(std::cout) << std::endl;
     }
     
-    void MemoryManager::LogStages(const char* str)
+    void MemoryManager::LogStages(const char* str) const
     {
-        if constexpr (!Configuration::LogGC)
+        if (!logGC)
         {
             return;
         }
@@ -158,4 +709,4 @@ namespace Lox
     {
         return std::cout << "- GC: " << str << ' ';
     }
-}
\ No newline at end of file
+}
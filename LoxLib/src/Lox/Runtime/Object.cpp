@@ -1,25 +1,18 @@
 #include "Lox/Runtime/Object.hpp"
 
+#include <algorithm>
+
 #include "Lox/Runtime/MemoryManager.hpp"
+#include "Lox/Runtime/ObjectAllocator.hpp"
 
 namespace Lox
 {
     Object::Object(GcPtr<Lox::Object> next, Lox::ObjectType type)
-            : marked(false), next(next), type(type)
+            : old(false), remembered(false), type(type), accountedPayloadSize(0), next(next)
     {
     
     }
     
-    ObjectType Object::GetType() const
-    {
-        return type;
-    }
-    
-    bool Object::Is(ObjectType otherType) const
-    {
-        return type == otherType;
-    }
-    
     GcPtr<Object> Object::GetNext()
     {
         return next;
@@ -32,17 +25,52 @@ namespace Lox
     
     void Object::SetMarked()
     {
-        marked = true;
+        ObjectAllocator::SetMarked(this);
     }
     
     void Object::Unmark()
     {
-        marked = false;
+        ObjectAllocator::Unmark(this);
     }
     
     bool Object::IsMarked() const
     {
-        return marked;
+        return ObjectAllocator::IsMarked(this);
+    }
+    
+    bool Object::IsOld() const
+    {
+        return old;
+    }
+    
+    void Object::SetOld()
+    {
+        old = true;
+    }
+    
+    bool Object::IsRemembered() const
+    {
+        return remembered;
+    }
+    
+    void Object::SetRemembered(bool newRemembered)
+    {
+        remembered = newRemembered;
+    }
+    
+    std::size_t Object::GetPayloadSize() const
+    {
+        return 0;
+    }
+    
+    std::size_t Object::GetAccountedPayloadSize() const
+    {
+        return accountedPayloadSize;
+    }
+    
+    void Object::SetAccountedPayloadSize(std::size_t size)
+    {
+        accountedPayloadSize = static_cast<std::uint32_t>(std::min(size, MaxAccountedPayloadSize));
     }
     
     std::ostream& operator<<(std::ostream& out, const Object& obj)
@@ -0,0 +1,98 @@
+#include "Lox/Runtime/ObjectAllocator.hpp"
+
+#include "Lox/Util/Assert.hpp"
+
+namespace Lox
+{
+    ObjectAllocator::ObjectAllocator()
+            : availablePages{}, freeBytes(0), pagesCount(0)
+    {
+    
+    }
+    
+    ObjectAllocator::~ObjectAllocator()
+    {
+        Trim(0);
+        LOX_ASSERT(pagesCount == 0, "Lox::ObjectAllocator is destroyed with live objects");
+    }
+    
+    void ObjectAllocator::Trim(std::size_t limit)
+    {
+        for (Page* page : availablePages)
+        {
+            while (page != nullptr && freeBytes > limit)
+            {
+                Page* next = page->next;
+                
+                if (page->liveCells == 0)
+                {
+                    RemoveAvailablePage(page);
+                    FreePage(page);
+                }
+                
+                page = next;
+            }
+        }
+    }
+    
+    std::size_t ObjectAllocator::GetFreeBytes() const
+    {
+        return freeBytes;
+    }
+    
+    std::size_t ObjectAllocator::GetPagesCount() const
+    {
+        return pagesCount;
+    }
+    
+    ObjectAllocator::Page* ObjectAllocator::AllocatePage(std::size_t sizeClass)
+    {
+        void* memory = ::operator new(PageSize, std::align_val_t(PageSize));
+        
+        Page* page = ::new(memory) Page{};
+        page->bump = static_cast<std::byte*>(memory) + FirstCellOffset;
+        page->sizeClass = sizeClass;
+        page->cellSize = GetCellSize(sizeClass);
+        
+        LOX_POISON_CELL(page->bump, PageSize - FirstCellOffset);
+        
+        AddAvailablePage(page);
+        pagesCount++;
+        
+        return page;
+    }
+    
+    void ObjectAllocator::FreePage(Page* page)
+    {
+        // All the used cells of an empty page are in its free list.
+        std::byte* firstCell = reinterpret_cast<std::byte*>(page) + FirstCellOffset;
+        freeBytes -= page->bump - firstCell;
+        
+        LOX_UNPOISON_CELL(firstCell, PageSize - FirstCellOffset);
+        
+        page->~Page();
+        ::operator delete(page, std::align_val_t(PageSize));
+        pagesCount--;
+    }
+    
+    void* ObjectAllocator::AllocateLarge(std::size_t size)
+    {
+        void* memory = ::operator new(FirstCellOffset + size, std::align_val_t(PageSize));
+        
+        Page* page = ::new(memory) Page{};
+        page->sizeClass = LargeSizeClass;
+        page->cellSize = size;
+        page->liveCells = 1;
+        
+        pagesCount++;
+        
+        return static_cast<std::byte*>(memory) + FirstCellOffset;
+    }
+    
+    void ObjectAllocator::FreeLarge(Page* page)
+    {
+        page->~Page();
+        ::operator delete(page, std::align_val_t(PageSize));
+        pagesCount--;
+    }
+}
@@ -30,9 +30,9 @@ namespace Lox
         return ObjectType::BoundMethod;
     }
     
-    void BoundMethod::MarkChildren()
+    void BoundMethod::MarkChildren(MemoryManager& memory)
     {
-        MemoryManager::MarkObject(reciever);
-        MemoryManager::MarkObject(method);
+        memory.MarkObject(reciever);
+        memory.MarkObject(method);
     }
 }
\ No newline at end of file
@@ -7,7 +7,7 @@
 namespace Lox
 {
     Class::Class(GcPtr<Object> next, GcPtr<String> name)
-            : Object(next, ObjectType::Class), name(name)
+            : Object(next, ObjectType::Class), name(name), version(0)
     {
     
     }
@@ -24,34 +24,47 @@ namespace Lox
     
     void Class::AddMethod(GcPtr<String> methodName, GcPtr<Closure> func)
     {
-        methods[methodName] = func;
+        methods.Insert(methodName, func);
+        version++;
     }
     
     std::optional<GcPtr<Closure>> Class::GetMethod(GcPtr<String> methodName)
     {
-        auto it = methods.find(methodName);
+        GcPtr<Closure>* method = methods.Find(methodName);
         
-        if (it == methods.end())
+        if (!method)
         {
             return std::nullopt;
         }
         
-        return it->second;
+        return *method;
     }
 
-void Class::Inherit(GcPtr<Class> other)
-{
-    methods.insert(other->methods.begin(), other->methods.end());
-}
+    void Class::Inherit(GcPtr<Class> other)
+    {
+        methods.InsertAll(other->methods);
+        version++;
+    }
+    
+    std::size_t Class::GetVersion() const
+    {
+        return version;
+    }
     
     std::ostream& Class::Print(std::ostream& out, PrintFlags flags) const
     {
         return out << "<class " << name->GetCppString() << ">";
     }
     
-    void Class::MarkChildren()
+    void Class::MarkChildren(MemoryManager& memory)
     {
-        MemoryManager::MarkObject(name);
+        memory.MarkObject(name);
+        
+        methods.ForEach([&memory](GcPtr<String> methodName, GcPtr<Closure> method)
+                        {
+                            memory.MarkObject(methodName);
+                            memory.MarkObject(method);
+                        });
     }
     
     ObjectType Class::GetStaticType()
@@ -56,23 +56,33 @@ namespace Lox
         return chunk;
     }
     
+    std::size_t Closure::GetPayloadSize() const
+    {
+        return chunk.GetPayloadSize() + upvalues.capacity() * sizeof(GcPtr<Upvalue>);
+    }
+    
     std::ostream& Closure::Print(std::ostream& out, PrintFlags flags) const
     {
         return out << "<fn " << name->GetCppString() << ">";
     }
     
-    void Closure::MarkChildren()
+    void Closure::MarkChildren(MemoryManager& memory)
     {
-        MemoryManager::MarkObject(name);
+        memory.MarkObject(name);
         
         for (auto it = chunk.ConstantsBegin(); it != chunk.ConstantsEnd(); ++it)
         {
-            MemoryManager::MarkValue(*it);
+            memory.MarkValue(*it);
         }
         
         for (auto upvalue : upvalues)
         {
-            MemoryManager::MarkObject(upvalue);
+            memory.MarkObject(upvalue);
+        }
+        
+        for (InlineCache& cache : chunk.GetInlineCaches())
+        {
+            cache.Mark(memory);
         }
     }
     
@@ -4,8 +4,8 @@
 
 namespace Lox
 {
-    Instance::Instance(GcPtr<Object> next, GcPtr<Class> klass)
-            : Object(next, ObjectType::Instance), klass(klass)
+    Instance::Instance(GcPtr<Object> next, GcPtr<Class> klass, GcPtr<Shape> shape)
+            : Object(next, ObjectType::Instance), klass(klass), shape(shape)
     {
     
     }
@@ -20,21 +20,99 @@ namespace Lox
         return klass;
     }
     
+    GcPtr<Shape> Instance::GetShape()
+    {
+        return shape;
+    }
+    
     std::optional<Value> Instance::GetField(GcPtr<String> str)
     {
-        auto it = fields.find(str);
+        std::optional<std::size_t> slot = shape->FindSlot(str);
+        
+        if (slot)
+        {
+            return slots[*slot];
+        }
+        
+        if (overflow)
+        {
+            auto it = overflow->find(str);
+            
+            if (it != overflow->end())
+            {
+                return it->second;
+            }
+        }
+        
+        return std::nullopt;
+    }
+    
+    bool Instance::SetExistingField(GcPtr<String> str, Value newVal)
+    {
+        std::optional<std::size_t> slot = shape->FindSlot(str);
+        
+        if (slot)
+        {
+            slots[*slot] = newVal;
+            return true;
+        }
         
-        if (it == fields.end())
+        if (overflow)
         {
-            return std::nullopt;
+            auto it = overflow->find(str);
+            
+            if (it != overflow->end())
+            {
+                it->second = newVal;
+                return true;
+            }
         }
         
-        return it->second;
+        return false;
     }
     
-    void Instance::SetField(GcPtr<String> str, Value newVal)
+    Value Instance::GetSlot(std::size_t slot) const
     {
-        fields[str] = newVal;
+        LOX_ASSERT(slot < slots.size(), "Lox::Instance slot out of range");
+        return slots[slot];
+    }
+    
+    void Instance::SetSlot(std::size_t slot, Value newVal)
+    {
+        LOX_ASSERT(slot < slots.size(), "Lox::Instance slot out of range");
+        slots[slot] = newVal;
+    }
+    
+    void Instance::AddSlot(GcPtr<Shape> newShape, Value val)
+    {
+        LOX_ASSERT(newShape->GetSlotsCount() == slots.size() + 1, "Lox::Instance wrong shape transition");
+        
+        shape = newShape;
+        slots.push_back(val);
+    }
+    
+    void Instance::AddOverflowField(GcPtr<String> str, Value val)
+    {
+        if (!overflow)
+        {
+            overflow = std::make_unique<std::unordered_map<GcPtr<String>, Value>>();
+        }
+        
+        (*overflow)[str] = val;
+    }
+    
+    std::size_t Instance::GetPayloadSize() const
+    {
+        std::size_t size = slots.capacity() * sizeof(Value);
+        
+        // The buckets and the nodes of the map, roughly.
+        if (overflow)
+        {
+            size += sizeof(*overflow) + overflow->bucket_count() * sizeof(void*)
+                    + overflow->size() * (sizeof(std::pair<const GcPtr<String>, Value>) + sizeof(void*));
+        }
+        
+        return size;
     }
     
     std::ostream& Instance::Print(std::ostream& out, PrintFlags flags) const
@@ -47,13 +125,23 @@ namespace Lox
         return ObjectType::Instance;
     }
     
-    void Instance::MarkChildren()
+    void Instance::MarkChildren(MemoryManager& memory)
     {
-        MemoryManager::MarkObject(klass);
+        memory.MarkObject(klass);
+        memory.MarkObject(shape);
+        
+        for (Value val : slots)
+        {
+            memory.MarkValue(val);
+        }
         
-        for (auto& it : fields)
+        if (overflow)
         {
-            MemoryManager::MarkValue(it.second);
+            for (auto& it : *overflow)
+            {
+                memory.MarkObject(static_cast<GcPtr<String>>(it.first));
+                memory.MarkValue(it.second);
+            }
         }
     }
-}
\ No newline at end of file
+}
@@ -40,9 +40,9 @@ namespace Lox
         return out << "<native " << name->GetCppString() << ">";
     }
     
-    void Native::MarkChildren()
+    void Native::MarkChildren(MemoryManager& memory)
     {
-        MemoryManager::MarkObject(name);
+        memory.MarkObject(name);
     }
     
     ObjectType Native::GetStaticType()
@@ -0,0 +1,90 @@
+#include "Lox/Runtime/Objects/Shape.hpp"
+
+#include "Lox/Runtime/MemoryManager.hpp"
+
+namespace Lox
+{
+    Shape::Shape(GcPtr<Object> next)
+            : Object(next, ObjectType::Shape)
+    {
+    
+    }
+    
+    Shape::Shape(GcPtr<Object> next, GcPtr<Shape> parent, GcPtr<String> key)
+            : Object(next, ObjectType::Shape), keys(parent->keys)
+    {
+        keys.push_back(key);
+    }
+    
+    std::optional<std::size_t> Shape::FindSlot(GcPtr<String> key) const
+    {
+        // Shapes are small, so a linear search over the interned names is enough.
+        for (std::size_t i = 0; i < keys.size(); ++i)
+        {
+            if (keys[i] == key)
+            {
+                return i;
+            }
+        }
+        
+        return std::nullopt;
+    }
+    
+    std::size_t Shape::GetSlotsCount() const
+    {
+        return keys.size();
+    }
+    
+    const std::vector<GcPtr<String>>& Shape::GetKeys() const
+    {
+        return keys;
+    }
+    
+    std::optional<GcPtr<Shape>> Shape::GetTransition(GcPtr<String> key)
+    {
+        auto it = transitions.find(key);
+        
+        if (it == transitions.end())
+        {
+            return std::nullopt;
+        }
+        
+        return it->second;
+    }
+    
+    void Shape::AddTransition(GcPtr<String> key, GcPtr<Shape> shape)
+    {
+        transitions[key] = shape;
+    }
+    
+    std::size_t Shape::GetPayloadSize() const
+    {
+        // The buckets and the nodes of the transitions, roughly.
+        return keys.capacity() * sizeof(GcPtr<String>) + transitions.bucket_count() * sizeof(void*)
+               + transitions.size() * (sizeof(std::pair<const GcPtr<String>, GcPtr<Shape>>) + sizeof(void*));
+    }
+    
+    std::ostream& Shape::Print(std::ostream& out, PrintFlags flags) const
+    {
+        return out << "<shape " << keys.size() << ">";
+    }
+    
+    ObjectType Shape::GetStaticType()
+    {
+        return ObjectType::Shape;
+    }
+    
+    void Shape::MarkChildren(MemoryManager& memory)
+    {
+        for (GcPtr<String> key : keys)
+        {
+            memory.MarkObject(key);
+        }
+        
+        for (auto& entry : transitions)
+        {
+            memory.MarkObject(static_cast<GcPtr<String>>(entry.first));
+            memory.MarkObject(entry.second);
+        }
+    }
+}
@@ -2,22 +2,107 @@
 
 #include <iomanip>
 
+#include "Lox/Runtime/MemoryManager.hpp"
+
 namespace Lox
 {
     String::String(GcPtr<Object> next, std::string&& movedStr)
-            : Object(next, ObjectType::String), str(movedStr), hash(std::hash<std::string>{}(str))
+            : Object(next, ObjectType::String), str(std::move(movedStr)), length(str.size()),
+              bufferGrowth(0), hash(ComputeHash(str)), hashComputed(true)
+    {
+    
+    }
+    
+    String::String(GcPtr<Object> next, std::string&& movedStr, std::size_t hash)
+            : Object(next, ObjectType::String), str(std::move(movedStr)), length(str.size()),
+              bufferGrowth(0), hash(hash), hashComputed(true)
+    {
+    
+    }
+    
+    String::String(GcPtr<Object> next, std::shared_ptr<std::string> buffer, std::size_t length,
+                   std::size_t bufferGrowth)
+            : Object(next, ObjectType::String), buffer(std::move(buffer)), length(length),
+              bufferGrowth(bufferGrowth), hash(0), hashComputed(false)
     {
     
     }
     
     const std::string& String::GetCppString() const
     {
+        if (buffer)
+        {
+            str.assign(buffer->data(), length);
+            buffer.reset();
+        }
+        
+        return str;
+    }
+    
+    std::string_view String::GetView() const
+    {
+        if (buffer)
+        {
+            return std::string_view(buffer->data(), length);
+        }
+        
         return str;
     }
     
-    std::size_t String::GetHash() const
+    std::size_t String::GetLength() const
+    {
+        return length;
+    }
+    
+    void String::ComputeLazyHash() const
+    {
+        hash = ComputeHash(GetView());
+        hashComputed = true;
+    }
+    
+    void String::SetInterned(GcPtr<String> str)
+    {
+        interned = str;
+    }
+    
+    std::shared_ptr<std::string> String::Append(const String& a, const String& b, std::size_t& growth)
     {
-        return hash;
+        // Nothing was appended after `a`, so its buffer can grow. `std::string` doubles the
+        // capacity, so the appends are amortized O(1) per character.
+        if (a.buffer && a.buffer->size() == a.length)
+        {
+            std::shared_ptr<std::string> result = a.buffer;
+            std::size_t capacity = result->capacity();
+            
+            if (b.buffer == a.buffer)
+            {
+                // `s + s`, the view of `b` is invalidated by the append.
+                std::string copy(b.GetView());
+                result->append(copy);
+            }
+            else
+            {
+                result->append(b.GetView());
+            }
+            
+            growth = result->capacity() - capacity;
+            return result;
+        }
+        
+        auto result = std::make_shared<std::string>();
+        result->reserve(2 * (a.length + b.length));
+        result->append(a.GetView());
+        result->append(b.GetView());
+        
+        growth = result->capacity();
+        return result;
+    }
+    
+    std::size_t String::GetPayloadSize() const
+    {
+        // The characters of a short string are inside of its structure.
+        std::size_t heapCapacity = str.capacity() > std::string().capacity() ? str.capacity() : 0;
+        return heapCapacity + bufferGrowth;
     }
     
     std::ostream& String::Print(std::ostream& out, PrintFlags flags) const
@@ -26,19 +111,19 @@ namespace Lox
         {
             // Wow, so that's why there is `std::quoted`.
             // It's also used to escape symbols!
-            return out << std::quoted(str);
+            return out << std::quoted(GetView());
         }
         
-        return out << str;
+        return out << GetView();
     }
     
-    void String::MarkChildren()
+    void String::MarkChildren(MemoryManager& memory)
     {
-    
+        memory.MarkObject(interned);
     }
     
     ObjectType String::GetStaticType()
     {
         return ObjectType::String;
     }
-}
\ No newline at end of file
+}
@@ -54,11 +54,11 @@ namespace Lox
         return slot == &closed;
     }
     
-    void Upvalue::MarkChildren()
+    void Upvalue::MarkChildren(MemoryManager& memory)
     {
         // NOTE: Marking of opened values is the VM responsibility.
         
-        MemoryManager::MarkValue(closed);
+        memory.MarkValue(closed);
     }
     
     ObjectType Upvalue::GetStaticType()
@@ -0,0 +1,175 @@
+#include "Lox/Runtime/ParallelMarker.hpp"
+
+#include <algorithm>
+
+#include "Lox/Runtime/MemoryManager.hpp"
+#include "Lox/Runtime/ObjectAllocator.hpp"
+
+namespace Lox
+{
+    /// The gray stack of the thread, which runs `ParallelMarker::Work`.
+    static thread_local std::vector<GcPtr<Object>>* currentStack = nullptr;
+    
+    ParallelMarker::ParallelMarker(MemoryManager& memory, std::size_t threadsCount)
+            : memory(memory), packetsCount(0), busyThreads(0), finishedWorkers(0), traceIndex(0),
+              stopping(false)
+    {
+        for (std::size_t i = 1; i < threadsCount; ++i)
+        {
+            workers.emplace_back(&ParallelMarker::RunWorker, this);
+        }
+    }
+    
+    ParallelMarker::~ParallelMarker()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        
+        workAvailable.notify_all();
+        
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+    
+    void ParallelMarker::Trace(std::vector<GcPtr<Object>>& grayStack)
+    {
+        {
+            std::lock_guard lock(mutex);
+            
+            // The roots are split, so all the threads have work from the start.
+            std::size_t packetSize = std::clamp<std::size_t>(grayStack.size() / (workers.size() + 1), 1, PacketSize);
+            for (auto it = grayStack.begin(); it != grayStack.end();)
+            {
+                auto end = it + std::min<std::size_t>(packetSize, grayStack.end() - it);
+                packets.emplace_back(it, end);
+                it = end;
+            }
+            
+            grayStack.clear();
+            packetsCount = packets.size();
+            
+            // A thread is busy until it waits for a packet, even if it has not started yet.
+            busyThreads = workers.size() + 1;
+            finishedWorkers = 0;
+            traceIndex++;
+        }
+        
+        workAvailable.notify_all();
+        
+        Work(callerStack);
+        
+        std::unique_lock lock(mutex);
+        workerFinished.wait(lock, [this]
+        {
+            return finishedWorkers == workers.size();
+        });
+    }
+    
+    void ParallelMarker::MarkObject(GcPtr<Object> obj)
+    {
+        if (ObjectAllocator::TrySetMarked(obj.GetRawPointer()))
+        {
+            currentStack->push_back(obj);
+        }
+    }
+    
+    std::size_t ParallelMarker::GetThreadsCount() const
+    {
+        return workers.size() + 1;
+    }
+    
+    void ParallelMarker::RunWorker()
+    {
+        Packet stack;
+        std::uint64_t lastTrace = 0;
+        
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                workAvailable.wait(lock, [this, lastTrace]
+                {
+                    return stopping || traceIndex != lastTrace;
+                });
+                
+                if (stopping)
+                {
+                    return;
+                }
+                
+                lastTrace = traceIndex;
+            }
+            
+            Work(stack);
+            
+            {
+                std::lock_guard lock(mutex);
+                finishedWorkers++;
+            }
+            
+            workerFinished.notify_one();
+        }
+    }
+    
+    void ParallelMarker::Work(Packet& stack)
+    {
+        currentStack = &stack;
+        
+        while (true)
+        {
+            while (!stack.empty())
+            {
+                GcPtr<Object> obj = stack.back();
+                stack.pop_back();
+                
+                obj->MarkChildren(memory);
+                
+                if (stack.size() >= 2 * PacketSize && packetsCount.load(std::memory_order_relaxed) == 0)
+                {
+                    GivePacket(stack);
+                }
+            }
+            
+            std::unique_lock lock(mutex);
+            busyThreads--;
+            
+            // Only a busy thread can give a packet.
+            workAvailable.wait(lock, [this]
+            {
+                return !packets.empty() || busyThreads == 0;
+            });
+            
+            if (packets.empty())
+            {
+                workAvailable.notify_all();
+                break;
+            }
+            
+            busyThreads++;
+            stack = std::move(packets.back());
+            packets.pop_back();
+            packetsCount = packets.size();
+        }
+        
+        currentStack = nullptr;
+    }
+    
+    void ParallelMarker::GivePacket(Packet& stack)
+    {
+        // The bottom of the stack is the oldest gray objects, probably with larger subgraphs.
+        Packet packet(stack.begin(), stack.begin() + PacketSize);
+        stack.erase(stack.begin(), stack.begin() + PacketSize);
+        
+        {
+            std::lock_guard lock(mutex);
+            packets.push_back(std::move(packet));
+            packetsCount = packets.size();
+        }
+        
+        workAvailable.notify_one();
+    }
+}
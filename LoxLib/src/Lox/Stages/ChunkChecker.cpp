@@ -1,166 +1,398 @@
 #include "Lox/Stages/ChunkChecker.hpp"
 
+#include <algorithm>
+#include <vector>
+
 #include "Lox/Configuration.hpp"
 
 #include "Lox/Interpreter/Opcode.hpp"
 
+#include "Lox/Runtime/Objects/Closure.hpp"
+
 namespace Lox
 {
+    // Functions are verified recursively, the code of the compiler never nests that deep.
+    static constexpr std::size_t MaxFunctionsDepth = 256;
+    
     ChunkChecker::ChunkChecker(const Chunk& chunk)
-            : chunk(chunk), stackSize(0)
+            : ChunkChecker(chunk, 0, 0, 0)
+    {
+    
+    }
+    
+    ChunkChecker::ChunkChecker(const Chunk& chunk, std::size_t arity, std::size_t upvaluesCount)
+            : ChunkChecker(chunk, arity, upvaluesCount, 0)
     {
     
     }
     
-    bool ChunkChecker::Check()
+    ChunkChecker::ChunkChecker(const Chunk& chunk, std::size_t arity, std::size_t upvaluesCount, std::size_t depth)
+            : chunk(chunk), arity(arity), upvaluesCount(upvaluesCount), depth(depth)
     {
-        // TODO: Is that even the right check?
-        // TODO: How to check with jumps?
+    
+    }
+    
+    bool ChunkChecker::Check() const
+    {
+        if (depth > MaxFunctionsDepth || chunk.GetCodeSize() == 0)
+        {
+            return false;
+        }
         
-        return true;
+        // Decode the whole chunk first, so the jumps can be checked to land on instructions.
+        std::vector<bool> instructions(chunk.GetCodeSize(), false);
+        
+        for (std::size_t offset = 0; offset < chunk.GetCodeSize();)
+        {
+            std::optional<std::size_t> size = GetInstructionSize(chunk, offset);
+            if (!size)
+            {
+                return false;
+            }
+            
+            instructions[offset] = true;
+            offset += *size;
+        }
+        
+        // The VM executes a superinstruction together with the instructions after it.
+        for (std::size_t offset = 0; offset < chunk.GetCodeSize(); offset += *GetInstructionSize(chunk, offset))
+        {
+            if (!CheckFused(offset, instructions))
+            {
+                return false;
+            }
+        }
         
-        auto ip = chunk.CodeBegin();
+        // The stack height before every instruction, -1 if it is not reached yet.
+        std::vector<int> heights(chunk.GetCodeSize(), -1);
+        std::vector<std::size_t> worklist;
         
-        while (true)
+        auto reach = [&](std::size_t offset, int height)
         {
-            if (ip == chunk.CodeEnd())
+            if (offset >= chunk.GetCodeSize() || !instructions[offset])
             {
                 return false;
             }
             
-            uint8_t byte = *ip++;
-            auto opcode = static_cast<Opcode>(byte);
+            if (heights[offset] == -1)
+            {
+                heights[offset] = height;
+                worklist.push_back(offset);
+                return true;
+            }
+            
+            return heights[offset] == height;
+        };
+        
+        reach(0, 0);
+        
+        while (!worklist.empty())
+        {
+            std::size_t offset = worklist.back();
+            worklist.pop_back();
+            
+            std::size_t size = *GetInstructionSize(chunk, offset);
+            Opcode opcode = GetBaseOpcode(static_cast<Opcode>(chunk.GetCode(offset)));
+            uint8_t firstOperand = size > 1 ? chunk.GetCode(offset + 1) : 0;
+            int height = heights[offset];
+            
+            if (static_cast<std::size_t>(height) < GetOpcodeStackInputs(opcode, firstOperand)
+                || !CheckOperands(offset, height)
+                || !CheckFunction(offset))
+            {
+                return false;
+            }
+            
+            height += GetOpcodeStackEffect(opcode, firstOperand);
+            if (height > static_cast<int>(Configuration::StackSize))
+            {
+                return false;
+            }
+            
+            std::size_t next = offset + size;
+            std::size_t jump = size == 3 ? (chunk.GetCode(offset + 1) << 8) | chunk.GetCode(offset + 2) : 0;
+            
+            bool ok = true;
             
             switch (opcode)
             {
-            case OpcodeNot:
-            case OpcodeNegate:
-            case OpcodeEqual:
-            case OpcodePrint:
-                if (stackSize < 1)
-                {
-                    return false;
-                }
+            case OpcodeReturn:
                 break;
             
-            case OpcodeAdd:
-            case OpcodeSubstract:
-            case OpcodeMultiply:
-            case OpcodeDivide:
-            case OpcodeLess:
-            case OpcodeGreater:
-                if (stackSize < 2)
-                {
-                    return false;
-                }
+            case OpcodeJump:
+                ok = reach(next + jump, height);
                 break;
             
-            case OpcodePop:
-                if (stackSize == 0)
-                {
-                    return false;
-                }
+            case OpcodeJumpIfFalse:
+                ok = reach(next + jump, height) && reach(next, height);
                 break;
             
-            case OpcodeNil:
-            case OpcodeTrue:
-            case OpcodeFalse:
+            case OpcodeLoop:
+                ok = jump <= next && reach(next - jump, height);
                 break;
             
-            case OpcodeJump:
-            case OpcodeJumpIfFalse:
-            {
-                if (ip == chunk.CodeEnd())
-                {
-                    return false;
-                }
-                
-                uint8_t first = *ip++;
-                
-                if (ip == chunk.CodeEnd())
-                {
-                    return false;
-                }
-                
-                uint8_t second = *ip++;
-                
-                uint16_t addr = (first << 8) | second;
-                
+            default:
+                ok = reach(next, height);
                 break;
             }
             
-            case OpcodeDefineGlobal:
-            case OpcodeGetGlobal:
-            case OpcodeSetGlobal:
-            case OpcodePushConstant:
+            if (!ok)
             {
-                if (ip == chunk.CodeEnd())
-                {
-                    return false;
-                }
-                
-                uint8_t index = *ip++;
-                
-                if (!chunk.HasConstant(index)
-                    || (opcode != OpcodePushConstant && !chunk.GetConstant(index).IsObject(ObjectType::String)))
-                {
-                    return false;
-                }
-                
-                if (opcode == OpcodeSetGlobal)
-                {
-                    if (stackSize < 1)
-                    {
-                        return false;
-                    }
-                }
-                
-                break;
+                return false;
             }
+        }
+        
+        return true;
+    }
+    
+    bool ChunkChecker::CheckOperands(std::size_t offset, std::size_t height) const
+    {
+        Opcode opcode = GetBaseOpcode(static_cast<Opcode>(chunk.GetCode(offset)));
+        
+        // The slot 0 of the frame is the function (or `this`), then the arguments.
+        std::size_t localsCount = 1 + arity + height;
+        
+        auto isString = [this](std::size_t index)
+        {
+            return chunk.HasConstant(index) && chunk.GetConstant(index).IsObject(ObjectType::String);
+        };
+        
+        switch (opcode)
+        {
+        case OpcodePushConstant:
+            return chunk.HasConstant(chunk.GetCode(offset + 1));
+        
+        case OpcodeDefineGlobal:
+        case OpcodeGetGlobal:
+        case OpcodeSetGlobal:
+        case OpcodeClass:
+        case OpcodeGetProperty:
+        case OpcodeSetProperty:
+        case OpcodeMethod:
+        case OpcodeGetSuper:
+            return isString(chunk.GetCode(offset + 1));
+        
+        case OpcodeInvoke:
+        case OpcodeInvokeSuper:
+            return isString(chunk.GetCode(offset + 2));
+        
+        case OpcodeGetLocal:
+        case OpcodeSetLocal:
+            return chunk.GetCode(offset + 1) < localsCount;
+        
+        case OpcodeGetUpvalue:
+        case OpcodeSetUpvalue:
+            return chunk.GetCode(offset + 1) < upvaluesCount;
+        
+        case OpcodeFillUpvalues:
+        {
+            std::size_t count = chunk.GetCode(offset + 1);
             
-            case OpcodeSetLocal:
-            case OpcodeGetLocal:
+            for (std::size_t i = 0; i < count; ++i)
             {
-                if (opcode == OpcodeSetLocal && stackSize < 1)
-                {
-                    return false;
-                }
+                bool isLocal = chunk.GetCode(offset + 2 + 2 * i) != 0;
+                std::size_t index = chunk.GetCode(offset + 3 + 2 * i);
                 
-                if (ip == chunk.CodeEnd())
+                if (index >= (isLocal ? localsCount : upvaluesCount))
                 {
                     return false;
                 }
-                
-                uint8_t index = *ip++;
-                
-                if (index >= stackSize)
-                {
-                    return false;
-                }
-                
-                break;
             }
             
-            case OpcodeReturn:
+            return true;
+        }
+        
+        default:
+            return true;
+        }
+    }
+    
+    bool ChunkChecker::CheckFused(std::size_t offset, const std::vector<bool>& instructions) const
+    {
+        std::span<const Opcode> parts = GetFusedOpcodes(static_cast<Opcode>(chunk.GetCode(offset)));
+        if (parts.empty())
+        {
+            return true;
+        }
+        
+        std::size_t next = offset + *GetInstructionSize(chunk, offset);
+        
+        for (std::size_t i = 1; i < parts.size(); ++i)
+        {
+            if (next >= chunk.GetCodeSize() || !instructions[next]
+                || GetBaseOpcode(static_cast<Opcode>(chunk.GetCode(next))) != parts[i])
             {
-                if (ip == chunk.CodeEnd())
-                {
-                    return stackSize == 0;
-                }
-                
-                break;
+                return false;
             }
             
-            default:
+            next += *GetInstructionSize(chunk, next);
+        }
+        
+        return true;
+    }
+    
+    bool ChunkChecker::CheckFunction(std::size_t offset) const
+    {
+        if (GetBaseOpcode(static_cast<Opcode>(chunk.GetCode(offset))) != OpcodePushConstant)
+        {
+            return true;
+        }
+        
+        Value constant = chunk.GetConstant(chunk.GetCode(offset + 1));
+        if (!constant.IsObject(ObjectType::Closure))
+        {
+            return true;
+        }
+        
+        // The compiler fills the upvalues of the closure right after pushing it, so the
+        // function has at least as many upvalues as `Opcode::FillUpvalues` adds.
+        std::size_t next = offset + 2;
+        std::size_t count = 0;
+        
+        if (next + 1 < chunk.GetCodeSize() && chunk.GetCode(next) == OpcodeFillUpvalues)
+        {
+            count = chunk.GetCode(next + 1);
+        }
+        
+        GcPtr<Closure> func = constant.AsObject<Closure>();
+        return ChunkChecker(func->GetChunk(), func->GetArity(), count, depth + 1).Check();
+    }
+    
+    std::optional<std::size_t> ChunkChecker::ComputeMaxStackSize() const
+    {
+        // The highest stack height before every instruction, -1 if it is not reached yet.
+        // An instruction is visited again when a higher height comes to it, so a loop
+        // which grows the stack ends with the `Configuration::StackSize` limit.
+        std::vector<int> heights(chunk.GetCodeSize(), -1);
+        std::vector<std::size_t> worklist;
+        
+        auto reach = [&](std::size_t offset, int height)
+        {
+            if (offset >= chunk.GetCodeSize() || height > static_cast<int>(Configuration::StackSize))
+            {
                 return false;
             }
             
-            stackSize += GetOpcodeStackEffect(opcode);
+            if (height > heights[offset])
+            {
+                heights[offset] = height;
+                worklist.push_back(offset);
+            }
             
-            if (stackSize > Configuration::StackSize || stackSize < 0)
+            return true;
+        };
+        
+        if (!reach(0, 0))
+        {
+            return std::nullopt;
+        }
+        
+        int maxHeight = 0;
+        
+        while (!worklist.empty())
+        {
+            std::size_t offset = worklist.back();
+            worklist.pop_back();
+            
+            std::optional<std::size_t> size = GetInstructionSize(chunk, offset);
+            if (!size)
             {
-                return false;
+                return std::nullopt;
+            }
+            
+            Opcode opcode = GetBaseOpcode(static_cast<Opcode>(chunk.GetCode(offset)));
+            uint8_t firstOperand = *size > 1 ? chunk.GetCode(offset + 1) : 0;
+            
+            int height = heights[offset] + GetOpcodeStackEffect(opcode, firstOperand);
+            if (height < 0)
+            {
+                return std::nullopt;
+            }
+            
+            // No instruction grows the stack higher than its result.
+            maxHeight = std::max(maxHeight, height);
+            
+            std::size_t next = offset + *size;
+            std::size_t jump = *size == 3 ? (chunk.GetCode(offset + 1) << 8) | chunk.GetCode(offset + 2) : 0;
+            
+            bool ok = true;
+            
+            switch (opcode)
+            {
+            case OpcodeReturn:
+                break;
+            
+            case OpcodeJump:
+                ok = reach(next + jump, height);
+                break;
+            
+            case OpcodeJumpIfFalse:
+                ok = reach(next + jump, height) && reach(next, height);
+                break;
+            
+            case OpcodeLoop:
+                ok = jump <= next && reach(next - jump, height);
+                break;
+            
+            default:
+                ok = reach(next, height);
+                break;
+            }
+            
+            if (!ok)
+            {
+                return std::nullopt;
+            }
+        }
+        
+        return maxHeight;
+    }
+    
+    std::optional<std::size_t> ChunkChecker::GetInstructionSize(const Chunk& chunk, std::size_t offset)
+    {
+        uint8_t byte = chunk.GetCode(offset);
+        
+        if (byte >= OpcodesCount)
+        {
+            return std::nullopt;
+        }
+        
+        std::size_t size = 1;
+        
+        switch (GetOpcodeType(static_cast<Opcode>(byte)))
+        {
+        case OpcodeType::Simple:
+            size = 1;
+            break;
+        
+        case OpcodeType::Constant:
+        case OpcodeType::Byte:
+            size = 2;
+            break;
+        
+        case OpcodeType::Jump:
+        case OpcodeType::Loop:
+        case OpcodeType::Invoke:
+        case OpcodeType::Short:
+            size = 3;
+            break;
+        
+        case OpcodeType::Closure:
+            if (offset + 1 >= chunk.GetCodeSize())
+            {
+                return std::nullopt;
             }
+            
+            // Upvalues count, then a pair of bytes for each upvalue.
+            size = 2 + 2 * chunk.GetCode(offset + 1);
+            break;
+        }
+        
+        if (offset + size > chunk.GetCodeSize())
+        {
+            return std::nullopt;
         }
+        
+        return size;
     }
 }
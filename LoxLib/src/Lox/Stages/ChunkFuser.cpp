@@ -0,0 +1,105 @@
+#include "Lox/Stages/ChunkFuser.hpp"
+
+#include <optional>
+
+#include "Lox/Runtime/Objects/Closure.hpp"
+
+#include "Lox/Stages/ChunkChecker.hpp"
+
+namespace Lox
+{
+    ChunkFuser::ChunkFuser(Chunk& chunk)
+            : chunk(chunk)
+    {
+    
+    }
+    
+    std::size_t ChunkFuser::Fuse()
+    {
+        std::size_t count = 0;
+        
+        for (std::size_t offset = 0; offset < chunk.GetCodeSize();)
+        {
+            std::size_t size = GetFullSize(offset);
+            if (size == 0)
+            {
+                // Malformed tail, it is left for the checker.
+                break;
+            }
+            
+            #define LOX_SUPERINSTRUCTIONS_MATCH(name, ...)                          \
+                if (std::size_t matched = Match(offset, GetFusedOpcodes(Opcode##name))) \
+                {                                                                   \
+                    chunk.GetCode(offset) = Opcode##name;                           \
+                    offset += matched;                                              \
+                    count++;                                                        \
+                    continue;                                                       \
+                }
+            
+            LOX_SUPERINSTRUCTIONS_LIST(LOX_SUPERINSTRUCTIONS_MATCH);
+            
+            #undef LOX_SUPERINSTRUCTIONS_MATCH
+            
+            offset += size;
+        }
+        
+        for (auto it = chunk.ConstantsBegin(); it != chunk.ConstantsEnd(); ++it)
+        {
+            if (it->IsObject(ObjectType::Closure))
+            {
+                count += ChunkFuser(it->AsObject<Closure>()->GetChunk()).Fuse();
+            }
+        }
+        
+        return count;
+    }
+    
+    std::size_t ChunkFuser::Match(std::size_t offset, std::span<const Opcode> parts) const
+    {
+        std::size_t start = offset;
+        
+        for (Opcode part: parts)
+        {
+            if (offset >= chunk.GetCodeSize() || chunk.GetCode(offset) != part)
+            {
+                return 0;
+            }
+            
+            std::optional<std::size_t> size = ChunkChecker::GetInstructionSize(chunk, offset);
+            if (!size)
+            {
+                return 0;
+            }
+            
+            offset += *size;
+        }
+        
+        return offset - start;
+    }
+    
+    std::size_t ChunkFuser::GetFullSize(std::size_t offset) const
+    {
+        std::optional<std::size_t> size = ChunkChecker::GetInstructionSize(chunk, offset);
+        if (!size)
+        {
+            return 0;
+        }
+        
+        std::span<const Opcode> parts = GetFusedOpcodes(static_cast<Opcode>(chunk.GetCode(offset)));
+        std::size_t next = offset + *size;
+        
+        // The fused instructions are skipped, so they are not fused again.
+        for (std::size_t i = 1; i < parts.size() && next < chunk.GetCodeSize(); ++i)
+        {
+            std::optional<std::size_t> partSize = ChunkChecker::GetInstructionSize(chunk, next);
+            if (!partSize)
+            {
+                break;
+            }
+            
+            next += *partSize;
+        }
+        
+        return next - offset;
+    }
+}
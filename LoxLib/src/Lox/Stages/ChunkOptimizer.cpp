@@ -1,5 +1,7 @@
 #include "Lox/Stages/ChunkOptimizer.hpp"
 
+#include <algorithm>
+#include <optional>
 #include <type_traits>
 
 #include "Lox/Configuration.hpp"
@@ -17,6 +19,7 @@
 
 #include "Lox/Util/Assert.hpp"
 
+#include "Lox/Stages/ChunkChecker.hpp"
 #include "Lox/Stages/Exceptions/OptimizerFailure.hpp"
 
 namespace Lox
@@ -29,92 +32,91 @@ namespace Lox
     
     void ChunkOptimizer::Optimize()
     {
-        for (; ip < chunk.GetCodeSize(); ++ip)
+        UpdateJumps(0, 0);
+        
+        while (ip < chunk.GetCodeSize())
         {
+            std::optional<std::size_t> size = ChunkChecker::GetInstructionSize(chunk, ip);
+            if (!size)
+            {
+                // Malformed tail, there is nothing to fold in it.
+                break;
+            }
+            
+            // The values pushed before a jump target are unknown on the path of the jump.
+            if (jumpTargets[ip])
+            {
+                constantsStack.clear();
+            }
+            
+            bool folded = false;
+            
             switch (static_cast<Opcode>(chunk.GetCode(ip)))
             {
             case OpcodePushConstant:
+            case OpcodeNil:
+            case OpcodeTrue:
+            case OpcodeFalse:
             {
                 StackPush(ip);
-                ++ip; // Skip argument.
                 break;
             }
             
             case OpcodeNot:
             {
-                if (constantsStack.empty())
+                if (!constantsStack.empty())
                 {
-                    break;
+                    Fold(1, Value(PeekValue(StackPeek()).IsFalse()));
+                    folded = true;
                 }
                 
-                std::size_t line = chunk.GetCodeLine(ip);
-                
-                Value oldVal = PopValue(StackPop());
-                Value newVal(oldVal.IsFalse());
-                RemoveInstruction(ip);
-                PushValue(newVal, line, ip);
-                --ip; // Reread value.
                 break;
             }
             
             case OpcodeNegate:
             {
-                if (constantsStack.empty())
+                if (!constantsStack.empty())
                 {
-                    break;
+                    Fold(1, NegateValue(PeekValue(StackPeek())));
+                    folded = true;
                 }
                 
-                std::size_t line = chunk.GetCodeLine(ip);
-                
-                Value oldVal = PopValue(StackPop());
-                Value newVal = NegateValue(oldVal);
-                RemoveInstruction(ip);
-                PushValue(newVal, line, ip);
-                --ip; // Reread value.
-                break;
-            }
-            
-            case OpcodeNil:
-            case OpcodeTrue:
-            case OpcodeFalse:
-            {
-                StackPush(ip);
                 break;
             }
             
             case OpcodeAdd:
             {
-                BinaryOperation<std::plus<double>>();
+                folded = BinaryOperation<std::plus<double>>();
                 break;
             }
             
             case OpcodeSubstract:
             {
-                BinaryOperation<std::minus<double>>();
+                folded = BinaryOperation<std::minus<double>>();
                 break;
             }
             
             case OpcodeMultiply:
             {
-                BinaryOperation<std::multiplies<double>>();
+                folded = BinaryOperation<std::multiplies<double>>();
                 break;
             }
             
             case OpcodeDivide:
             {
-                BinaryOperation<std::divides<double>>();
+                folded = BinaryOperation<std::divides<double>>();
                 break;
             }
             
             case OpcodeGreater:
             {
-                BinaryOperation<std::greater<double>>();
+                folded = BinaryOperation<std::greater<double>>();
                 break;
             }
             
             case OpcodeLess:
             {
-                BinaryOperation<std::less<double>>();
+                folded = BinaryOperation<std::less<double>>();
                 break;
             }
             
@@ -126,17 +128,11 @@ namespace Lox
                     break;
                 }
                 
-                std::size_t line = chunk.GetCodeLine(ip);
-                
-                Value b = PopValue(StackPop());
-                Value a = PopValue(StackPop());
-                
-                Value newVal(a == b);
-                
-                RemoveInstruction(ip);
-                PushValue(newVal, line, ip);
-                --ip; // Reread the value.
+                Value b = PeekValue(constantsStack[constantsStack.size() - 1]);
+                Value a = PeekValue(constantsStack[constantsStack.size() - 2]);
                 
+                Fold(2, Value(a == b));
+                folded = true;
                 break;
             }
             
@@ -144,6 +140,12 @@ namespace Lox
                 constantsStack.clear();
                 break;
             }
+            
+            // The folded value is read again, it may be folded further.
+            if (!folded)
+            {
+                ip += *size;
+            }
         }
     }
     
@@ -154,23 +156,34 @@ namespace Lox
     }
     
     template <typename BinOp>
-    void ChunkOptimizer::BinaryOperation()
+    bool ChunkOptimizer::BinaryOperation()
     {
         if (constantsStack.size() < 2)
         {
             constantsStack.clear();
-            return;
+            return false;
         }
         
+        Value b = PeekValue(constantsStack[constantsStack.size() - 1]);
+        Value a = PeekValue(constantsStack[constantsStack.size() - 2]);
+        
+        Fold(2, PerformBinaryOperation<BinOp>(a, b));
+        return true;
+    }
+    
+    void ChunkOptimizer::Fold(std::size_t valuesCount, Value val)
+    {
         std::size_t line = chunk.GetCodeLine(ip);
         
-        Value b = PopValue(StackPop());
-        Value a = PopValue(StackPop());
-        Value newVal = PerformBinaryOperation<BinOp>(a, b);
+        // The value is inserted before the removals, so a jump to the first folded
+        // instruction lands on the value.
+        std::size_t size = PushValue(val, line, ip);
+        RemoveInstruction(ip + size);
         
-        RemoveInstruction(ip);
-        PushValue(newVal, line, ip);
-        --ip; // Reread the opcode.
+        for (std::size_t i = 0; i < valuesCount; ++i)
+        {
+            RemoveInstruction(StackPop());
+        }
     }
     
     template <typename Op>
@@ -237,18 +250,12 @@ namespace Lox
         }
     }
     
-    Value ChunkOptimizer::PopValue(std::size_t index)
-    {
-        // This function changes the ip.
-        Value val = PeekValue(index);
-        RemoveInstruction(index);
-        return val;
-    }
-    
-    void ChunkOptimizer::PushValue(Lox::Value val, std::size_t line, std::size_t index)
+    std::size_t ChunkOptimizer::PushValue(Lox::Value val, std::size_t line, std::size_t index)
     {
         // This function won't change the ip.
         
+        std::size_t size = 1;
+        
         switch (val.GetType())
         {
         case ValueType::Nil:
@@ -269,10 +276,14 @@ namespace Lox
             
             chunk.InsertCode(index, OpcodePushConstant, line);
             chunk.InsertCode(index + 1, constantIndex, line);
+            size = 2;
             
             break;
         }
         }
+        
+        UpdateJumps(index, static_cast<std::ptrdiff_t>(size));
+        return size;
     }
     
     template <typename T, typename... Args>
@@ -327,27 +338,71 @@ namespace Lox
     
     void ChunkOptimizer::RemoveInstruction(std::size_t at)
     {
-        auto opcode = static_cast<Opcode>(chunk.GetCode(at));
+        std::optional<std::size_t> size = ChunkChecker::GetInstructionSize(chunk, at);
+        LOX_ASSERT(size.has_value(), "Lox::ChunkOptimizer removing malformed instruction");
         
-        unsigned removeCount = 1;
+        chunk.EraseCode(chunk.CodeBegin() + at, chunk.CodeBegin() + at + *size);
+        UpdateJumps(at, -static_cast<std::ptrdiff_t>(*size));
         
-        switch (GetOpcodeType(opcode))
+        if (at < ip)
         {
-        case OpcodeType::Constant:
-        case OpcodeType::Byte:
-            removeCount++;
-            break;
-        default:
-            break;
+            ip -= *size;
         }
+    }
+    
+    void ChunkOptimizer::UpdateJumps(std::size_t at, std::ptrdiff_t delta)
+    {
+        // Jump offsets are relative, so the jumps over the changed bytes are patched. The
+        // targets inside the removed bytes move to the code, that follows them.
+        std::size_t removedEnd = delta < 0 ? at - delta : at;
+        
+        auto move = [&](std::size_t target)
+        {
+            if (delta >= 0)
+            {
+                return target > at ? target + delta : target;
+            }
+            
+            return target >= removedEnd ? target + delta : std::min(target, at);
+        };
+        
+        jumpTargets.assign(chunk.GetCodeSize() + 1, false);
         
-        for (unsigned i = 0; i < removeCount; i++)
+        for (std::size_t offset = 0; offset < chunk.GetCodeSize();)
         {
-            chunk.EraseCode(at);
-            if (ip != 0 && at < ip)
+            std::optional<std::size_t> size = ChunkChecker::GetInstructionSize(chunk, offset);
+            if (!size)
             {
-                --ip;
+                break;
             }
+            
+            Opcode opcode = GetBaseOpcode(static_cast<Opcode>(chunk.GetCode(offset)));
+            
+            if (opcode == OpcodeJump || opcode == OpcodeJumpIfFalse || opcode == OpcodeLoop)
+            {
+                std::size_t oldNext = (offset < at ? offset : offset - delta) + 3;
+                std::size_t jump = (chunk.GetCode(offset + 1) << 8) | chunk.GetCode(offset + 2);
+                std::size_t oldTarget = opcode == OpcodeLoop ? oldNext - jump : oldNext + jump;
+                
+                std::size_t target = move(oldTarget);
+                std::size_t next = offset + 3;
+                std::size_t newJump = opcode == OpcodeLoop ? next - target : target - next;
+                
+                if (newJump > UINT16_MAX)
+                {
+                    throw Exceptions::OptimizerFailure("too long jump");
+                }
+                
+                chunk.GetCode(offset + 1) = (newJump >> 8) & 0xff;
+                chunk.GetCode(offset + 2) = newJump & 0xff;
+                
+                if (target < jumpTargets.size())
+                {
+                    jumpTargets[target] = true;
+                }
+            }
+            
+            offset += *size;
         }
     }
 }
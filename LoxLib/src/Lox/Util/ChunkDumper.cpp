@@ -165,6 +165,21 @@ namespace Lox
         return location + 2;
     }
     
+    Chunk::CodeIterator ChunkDumper::ShortInstruction(Chunk::CodeIterator location)
+    {
+        if (location + 1 == chunk.CodeEnd() || location + 2 == chunk.CodeEnd())
+        {
+            out << "## no argument ##" << std::endl;
+            return chunk.CodeEnd();
+        }
+        
+        uint16_t index = (location[1] << 8) | location[2];
+        
+        out << std::setw(4) << std::left << index << std::right << std::endl;
+        
+        return location + 3;
+    }
+    
     Chunk::CodeIterator ChunkDumper::JumpInstruction(Chunk::CodeIterator location)
     {
         if (location + 1 == chunk.CodeEnd())
@@ -4,6 +4,8 @@
 #include <exception>
 #include <cstring>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "Lox/Util/ChunkSerialization.hpp"
 
@@ -36,6 +38,9 @@ namespace Lox
 
         void ReadCode();
         void ReadConstants();
+        
+        /// Runs of lines: the count of elements and their line.
+        std::vector<std::pair<std::size_t, std::size_t>> ReadLines(std::size_t size);
 
         Value ReadValue();
         GcPtr<Object> ReadObject();
@@ -94,27 +99,75 @@ namespace Lox
     void ChunkReader::ReadCode()
     {
         std::size_t size = ReadSize(in);
-
-        for (std::size_t i = 0; i < size; ++i)
+        
+        std::vector<uint8_t> code(size);
+        in.read(reinterpret_cast<char*>(code.data()), size);
+        
+        if (in.fail())
         {
-            uint8_t byte = in.get();
-            auto line = ReadData<std::size_t>(ChunkInfo::SizeOfSize);
-
-            chunk.PushCode(byte, line);
+            throw ReadError();
+        }
+        
+        std::size_t i = 0;
+        
+        for (auto [count, line]: ReadLines(size))
+        {
+            for (std::size_t end = i + count; i < end; ++i)
+            {
+                chunk.PushCode(code[i], line);
+            }
         }
     }
 
     void ChunkReader::ReadConstants()
     {
         std::size_t size = ReadSize(in);
+        
+        std::vector<Value> constants;
 
         for (std::size_t i = 0 ; i < size; ++i)
         {
-            Value val = ReadValue();
-            auto line = ReadData<std::size_t>(ChunkInfo::SizeOfSize);
-                
-            chunk.PushConstant(val, line);
+            constants.push_back(ReadValue());
+        }
+        
+        std::size_t i = 0;
+        
+        for (auto [count, line]: ReadLines(size))
+        {
+            for (std::size_t end = i + count; i < end; ++i)
+            {
+                chunk.PushConstant(constants[i], line);
+            }
+        }
+    }
+    
+    std::vector<std::pair<std::size_t, std::size_t>> ChunkReader::ReadLines(std::size_t size)
+    {
+        std::size_t runsCount = ReadSize(in);
+        
+        std::vector<std::pair<std::size_t, std::size_t>> runs;
+        std::size_t total = 0;
+        
+        for (std::size_t i = 0; i < runsCount; ++i)
+        {
+            std::size_t count = ReadSize(in);
+            auto line = ReadData<std::size_t>(ChunkInfo::LineSize);
+            
+            if (in.fail() || count > size - total)
+            {
+                throw ReadError();
+            }
+            
+            total += count;
+            runs.emplace_back(count, line);
         }
+        
+        if (total != size)
+        {
+            throw ReadError();
+        }
+        
+        return runs;
     }
 
     Value ChunkReader::ReadValue()
@@ -128,8 +181,9 @@ namespace Lox
             return NIL;
         case ValueType::Bool:
         {
-            auto var = ReadData<bool>(ChunkInfo::ValueSize);
-            return Value(var);
+            // Booleans are written as 8 bytes, see `ChunkWriter::WriteValue`.
+            auto var = ReadData<uint64_t>(ChunkInfo::ValueSize);
+            return Value(var != 0);
         }
         case ValueType::Double:
         {
@@ -30,8 +30,9 @@ namespace Lox
         for (std::size_t i = 0; i < chunk.GetCodeSize(); ++i)
         {
             WriteData(chunk.GetCode(i), 1);
-            WriteData(chunk.GetCodeLine(i), ChunkInfo::LineSize);
         }
+        
+        WriteLines(chunk.GetCodeLines());
     }
     
     void ChunkWriter::WriteConstants()
@@ -41,7 +42,19 @@ namespace Lox
         for (std::size_t i = 0; i < chunk.GetConstantsCount(); ++i)
         {
             WriteValue(chunk.GetConstant(i));
-            WriteData(chunk.GetConstantLine(i), ChunkInfo::LineSize);
+        }
+        
+        WriteLines(chunk.GetConstantsLines());
+    }
+    
+    void ChunkWriter::WriteLines(const LinesArray& lines)
+    {
+        WriteSize(lines.GetRuns().size());
+        
+        for (std::size_t i = 0; i < lines.GetRuns().size(); ++i)
+        {
+            WriteSize(lines.GetRunLength(i));
+            WriteData(lines.GetRuns()[i].line, ChunkInfo::LineSize);
         }
     }
     